@@ -10,6 +10,8 @@
 #include <vector>
 #include <array>
 #include <algorithm>
+#include <string>
+#include <cmath>
 
 
 
@@ -18,25 +20,61 @@ namespace unda {
 		static inline double meanFreePath(double totalVolume, double totalSurface) { 
 			return 4.0 * (totalVolume / totalSurface); 
 		}
+		// Edges of the ISM frequency bins, in Hz.
+		static const std::array<std::array<float, 2>, 6> bandEdges = { {
+			{ 20.0f, 125.0f }, { 125.0f, 250.0f }, { 250.0f, 500.0f }, { 500.0f, 1000.0f }, { 1000.0f, 2000.0f }, { 2000.0f, 20000.0f }
+		} };
+
+		// Fractional-octave bands on base-two nominal centres, 1 kHz * 2^(k / bandsPerOctave) from k = firstIndex,
+		// with the top edge capped at 20 kHz.
+		template<size_t N> inline std::array<std::array<float, 2>, N> FractionalOctaveBands(int firstIndex, int bandsPerOctave) {
+			std::array<std::array<float, 2>, N> edges;
+			double halfBand = pow(2.0, 0.5 / (double)bandsPerOctave);
+			for (size_t band = 0; band < N; band++) {
+				double centre = 1000.0 * pow(2.0, (double)(firstIndex + (int)band) / (double)bandsPerOctave);
+				edges[band] = { (float)(centre / halfBand), (float)std::min(centre * halfBand, 20000.0) };
+			}
+			return edges;
+		}
+
+		// Edges of the N band layouts the models are built for: 6 is bandEdges, 10 the octave bands
+		// from 31.5 Hz to 16 kHz and 31 the third-octave bands from 20 Hz to 20 kHz.
+		template<size_t N> const std::array<std::array<float, 2>, N>& BandEdges();
+		template<> inline const std::array<std::array<float, 2>, 6>& BandEdges<6>() { return bandEdges; }
+		template<> inline const std::array<std::array<float, 2>, 10>& BandEdges<10>() {
+			static const std::array<std::array<float, 2>, 10> edges = FractionalOctaveBands<10>(-5, 1);
+			return edges;
+		}
+		template<> inline const std::array<std::array<float, 2>, 31>& BandEdges<31>() {
+			static const std::array<std::array<float, 2>, 31> edges = FractionalOctaveBands<31>(-17, 3);
+			return edges;
+		}
+
+		// What continues the IR past the hybrid transition.
+		enum class LateTailModel { Noise, FDN, RayTraced, RadianceTransfer };
+
 		static inline double alphaToBeta(double alpha) {
 			return sqrt(1.0 - alpha);
 		}
 
-		class Material {
+		// Absorption per band, N as in BandEdges.
+		template<size_t N>
+		class BasicMaterial {
 		public:
-			Material(const std::string& _label, const std::array<double, 6>& _alphaCoefficients)
+			BasicMaterial(const std::string& _label, const std::array<double, N>& _alphaCoefficients)
 				: label(_label)
 				, alphaCoefficients(_alphaCoefficients)
 			{}
-			Material() = default;
+			BasicMaterial() = default;
 			std::string label;
-			std::array<double, 6> alphaCoefficients;
-			inline std::array<double, 6> getBetaCoefficients() {
-				std::array<double, 6> beta = alphaCoefficients;
+			std::array<double, N> alphaCoefficients;
+			inline std::array<double, N> getBetaCoefficients() {
+				std::array<double, N> beta = alphaCoefficients;
 				std::for_each(beta.begin(), beta.end(), [](double& coeff) { coeff = sqrt(1.0 - coeff); });
 				return beta;
 			}
 		};
+		typedef BasicMaterial<6> Material;
 		namespace Materials {
 			static Material floor = Material("Floor", { 0.087307, 0.08230, 0.144615, 0.20076, 0.24653, 0.26692 });
 			static Material fabric = Material("Fabric", { 0.02999, 0.119999, 0.150000, 0.270000, 0.370000, 0.419999 });
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "../utils/SIMD.h"
+#include <cstddef>
+#include <cmath>
+
+
+namespace unda {
+	namespace acoustics {
+		constexpr unsigned int maxAmbisonicOrder = 3;
+		constexpr size_t AmbisonicChannelCount(unsigned int order) { return (size_t)(order + 1) * (order + 1); }
+
+		// Real spherical harmonics up to third order, ACN channel order and SN3D normalisation (AmbiX), for
+		// the unit direction (x, y, z) with x to the front, y to the left and z up. All 16 are written to
+		// the aligned coefficients. Each is k * a * b, with a and b low order monomials gathered a register
+		// at a time, so past the monomials it's two multiplies per four channels.
+		inline void EvaluateSphericalHarmonics(float x, float y, float z, float* coefficients) {
+			static const float sqrt3 = sqrtf(3.0f), sqrt15 = sqrtf(15.0f), sqrt3_8 = sqrtf(3.0f / 8.0f), sqrt5_8 = sqrtf(5.0f / 8.0f);
+			const float x2 = x * x, y2 = y * y, z2 = z * z;
+			const float x2my2 = x2 - y2, z5 = 5.0f * z2 - 1.0f;
+			// W Y Z X | V T R S | U Q O M | K L N P
+			simd::store(coefficients,      simd::set(1.0f, y, z, x));
+			simd::store(coefficients + 4,  simd::mul(simd::set(sqrt3, sqrt3, 0.5f, sqrt3),
+				simd::mul(simd::set(x, y, 3.0f * z2 - 1.0f, x), simd::set(y, z, 1.0f, z))));
+			simd::store(coefficients + 8,  simd::mul(simd::set(0.5f * sqrt3, sqrt5_8, sqrt15, sqrt3_8),
+				simd::mul(simd::set(x2my2, y, x * y, y), simd::set(1.0f, 3.0f * x2 - y2, z, z5))));
+			simd::store(coefficients + 12, simd::mul(simd::set(0.5f, sqrt3_8, 0.5f * sqrt15, sqrt5_8),
+				simd::mul(simd::set(z, x, z, x), simd::set(5.0f * z2 - 3.0f, z5, x2my2, x2 - 3.0f * y2))));
+		}
+
+		// Spherical harmonic degree of an ACN channel.
+		inline unsigned int AmbisonicDegree(size_t channel) {
+			unsigned int degree = 0;
+			while (AmbisonicChannelCount(degree) <= channel) degree++;
+			return degree;
+		}
+	}
+}
@@ -0,0 +1,213 @@
+#include "AudioFile.h"
+#include <algorithm>
+
+namespace unda {
+	AudioFileReader::AudioFileReader(const std::string& filePath, size_t _blockFrames, double sampleRate)
+		: blockFrames(std::max<size_t>(1, _blockFrames))
+	{
+		file = sf_open(filePath.c_str(), SFM_READ, &info);
+		if (!file) {
+			UNDA_ERROR("Could not open " + filePath + " ...");
+			info = SF_INFO();
+			return;
+		}
+		outputRate = (double)info.samplerate;
+		outputFrames = (size_t)info.frames;
+		if (sampleRate > 0 && (int)sampleRate != info.samplerate) {
+			size_t nChannels = getChannelCount();
+			for (size_t channel = 0; channel < nChannels; channel++)
+				resamplers.push_back(std::make_unique<Resampler>((double)info.samplerate, sampleRate));
+			size_t inputFrames = std::max(blockFrames, resamplers[0]->getLatency());
+			channelBlock.resize(inputFrames);
+			converted.assign(nChannels, std::vector<float>(resamplers[0]->getMaximumOutput(inputFrames)));
+			outputRate = sampleRate;
+			outputFrames = resamplers[0]->getOutputLength((size_t)info.frames);
+		}
+		if (info.channels > 1 || !resamplers.empty()) block.resize(blockFrames * (size_t)info.channels);
+	}
+
+	AudioFileReader::~AudioFileReader()
+	{
+		if (file) sf_close(file);
+	}
+
+	size_t AudioFileReader::readBlock(size_t nFrames)
+	{
+		return (size_t)sf_readf_float(file, block.data(), (sf_count_t)nFrames);
+	}
+
+	size_t AudioFileReader::convertBlock()
+	{
+		// After the last block, the converters are flushed once with their latency in zeros.
+		size_t nChannels = getChannelCount();
+		size_t nRead = readBlock(blockFrames), nInput = nRead;
+		if (nRead == 0) {
+			if (flushed) return 0;
+			flushed = true;
+			nInput = resamplers[0]->getLatency();
+		}
+		size_t produced = 0;
+		for (size_t channel = 0; channel < nChannels; channel++) {
+			if (nRead == 0) std::fill(channelBlock.begin(), channelBlock.begin() + nInput, 0.0f);
+			else for (size_t n = 0; n < nRead; n++) channelBlock[n] = block[n * nChannels + channel];
+			produced = resamplers[channel]->process(channelBlock.data(), nInput, converted[channel].data());
+		}
+		convertedStart = 0;
+		convertedEnd = produced;
+		return produced;
+	}
+
+	size_t AudioFileReader::readConverted(float* const* output, float* mono, size_t nFrames)
+	{
+		size_t nChannels = getChannelCount();
+		size_t done = 0;
+		while (done < nFrames && framesDelivered < outputFrames) {
+			if (convertedStart == convertedEnd && convertBlock() == 0) break;
+			size_t count = std::min({ nFrames - done, convertedEnd - convertedStart, outputFrames - framesDelivered });
+			for (size_t channel = 0; channel < nChannels; channel++) {
+				const float* source = converted[channel].data() + convertedStart;
+				if (mono) {
+					if (channel == 0) std::copy(source, source + count, mono + done);
+					else for (size_t n = 0; n < count; n++) mono[done + n] += source[n];
+				}
+				else {
+					std::copy(source, source + count, output[channel] + done);
+				}
+			}
+			convertedStart += count;
+			framesDelivered += count;
+			done += count;
+		}
+		return done;
+	}
+
+	size_t AudioFileReader::read(float* const* output, size_t nFrames)
+	{
+		if (!file) return 0;
+		if (!resamplers.empty()) return readConverted(output, nullptr, nFrames);
+		size_t nChannels = getChannelCount();
+		if (nChannels == 1) return (size_t)sf_readf_float(file, output[0], (sf_count_t)nFrames);
+		size_t done = 0;
+		while (done < nFrames) {
+			size_t count = std::min(nFrames - done, blockFrames);
+			size_t nRead = readBlock(count);
+			for (size_t channel = 0; channel < nChannels; channel++) {
+				float* destination = output[channel] + done;
+				const float* source = block.data() + channel;
+				for (size_t n = 0; n < nRead; n++) destination[n] = source[n * nChannels];
+			}
+			done += nRead;
+			if (nRead < count) break;
+		}
+		return done;
+	}
+
+	size_t AudioFileReader::readMono(float* output, size_t nFrames)
+	{
+		if (!file) return 0;
+		if (!resamplers.empty()) return readConverted(nullptr, output, nFrames);
+		size_t nChannels = getChannelCount();
+		if (nChannels == 1) return (size_t)sf_readf_float(file, output, (sf_count_t)nFrames);
+		size_t done = 0;
+		while (done < nFrames) {
+			size_t count = std::min(nFrames - done, blockFrames);
+			size_t nRead = readBlock(count);
+			const float* frame = block.data();
+			for (size_t n = 0; n < nRead; n++, frame += nChannels) {
+				float sample = 0;
+				for (size_t channel = 0; channel < nChannels; channel++) sample += frame[channel];
+				output[done + n] = sample;
+			}
+			done += nRead;
+			if (nRead < count) break;
+		}
+		return done;
+	}
+
+
+	AudioFileWriter::AudioFileWriter(const std::string& filePath, size_t _channels, double samplingFrequency, AudioSampleFormat format, size_t _blockFrames,
+									 double fileSampleRate)
+		: channels(_channels)
+		, blockFrames(std::max<size_t>(1, _blockFrames))
+	{
+		UNDA_ASSERT(channels > 0);
+		if (fileSampleRate <= 0) fileSampleRate = samplingFrequency;
+		SF_INFO wavInfo = SF_INFO();
+		wavInfo.samplerate = (int)fileSampleRate;
+		wavInfo.channels = (int)channels;
+		switch (format) {
+		case AudioSampleFormat::PCM24:   wavInfo.format = SF_FORMAT_WAV | SF_FORMAT_PCM_24; break;
+		case AudioSampleFormat::Float32: wavInfo.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT; break;
+		default:                         wavInfo.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16; break;
+		}
+		file = sf_open(filePath.c_str(), SFM_WRITE, &wavInfo);
+		if (!file) { UNDA_ERROR("Could not open " + filePath + " ..."); return; }
+		if (format != AudioSampleFormat::Float32) sf_command(file, SFC_SET_CLIPPING, nullptr, SF_TRUE);
+		if (channels > 1) block.resize(blockFrames * channels);
+		if ((int)fileSampleRate != (int)samplingFrequency) {
+			for (size_t channel = 0; channel < channels; channel++)
+				resamplers.push_back(std::make_unique<Resampler>(samplingFrequency, fileSampleRate));
+			converted.assign(channels, std::vector<float>(resamplers[0]->getMaximumOutput(std::max(blockFrames, resamplers[0]->getLatency()))));
+			pointers.resize(channels);
+		}
+	}
+
+	size_t AudioFileWriter::write(const float* const* input, size_t nFrames)
+	{
+		if (!file) return 0;
+		if (resamplers.empty()) return writeInterleaved(input, nFrames);
+		size_t done = 0;
+		while (done < nFrames) {
+			size_t count = std::min(nFrames - done, blockFrames), produced = 0;
+			for (size_t channel = 0; channel < channels; channel++) {
+				produced = resamplers[channel]->process(input[channel] + done, count, converted[channel].data());
+				pointers[channel] = converted[channel].data();
+			}
+			if (writeInterleaved(pointers.data(), produced) < produced) break;
+			done += count;
+		}
+		framesTaken += done;
+		return done;
+	}
+
+	size_t AudioFileWriter::writeInterleaved(const float* const* input, size_t nFrames)
+	{
+		if (channels == 1) {
+			size_t nWritten = (size_t)sf_writef_float(file, input[0], (sf_count_t)nFrames);
+			framesWritten += nWritten;
+			return nWritten;
+		}
+		size_t done = 0;
+		while (done < nFrames) {
+			size_t count = std::min(nFrames - done, blockFrames);
+			for (size_t channel = 0; channel < channels; channel++) {
+				const float* source = input[channel] + done;
+				float* destination = block.data() + channel;
+				for (size_t n = 0; n < count; n++) destination[n * channels] = source[n];
+			}
+			size_t nWritten = (size_t)sf_writef_float(file, block.data(), (sf_count_t)count);
+			done += nWritten;
+			if (nWritten < count) break;
+		}
+		framesWritten += done;
+		return done;
+	}
+
+	void AudioFileWriter::close()
+	{
+		if (!file) return;
+		if (!resamplers.empty()) {
+			// Push the last inputs out of the filters and trim to the converted length.
+			std::vector<float> zeros(resamplers[0]->getLatency(), 0.0f);
+			size_t produced = 0;
+			for (size_t channel = 0; channel < channels; channel++) {
+				produced = resamplers[channel]->process(zeros.data(), zeros.size(), converted[channel].data());
+				pointers[channel] = converted[channel].data();
+			}
+			size_t total = resamplers[0]->getOutputLength(framesTaken);
+			writeInterleaved(pointers.data(), std::min(produced, total > framesWritten ? total - framesWritten : 0));
+		}
+		sf_close(file);
+		file = nullptr;
+	}
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "../utils/Settings.h"
+#include "../utils/Utils.h"
+#include "Resampler.h"
+#include <sndfile.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+
+namespace unda {
+
+	enum class AudioSampleFormat { PCM16, PCM24, Float32 };
+
+
+	// Block-wise reading over libsndfile, into one caller buffer per channel.
+	// Interleaved frames go through a fixed block of blockFrames frames, so memory does not grow with
+	// the file. Mono files are read straight into the caller's buffer.
+	// Given a sampleRate other than the file's, every channel is converted on the way through by a
+	// streaming Resampler, and the frame count and rate reported are those after conversion.
+	class AudioFileReader {
+	public:
+		AudioFileReader(const std::string& filePath, size_t _blockFrames = 4096, double sampleRate = 0);
+		~AudioFileReader();
+
+		bool isOpen() const { return file != nullptr; }
+		size_t getChannelCount() const { return (size_t)info.channels; }
+		double getSampleRate() const { return outputRate; }
+		double getFileSampleRate() const { return (double)info.samplerate; }
+		size_t getFrameCount() const { return outputFrames; }
+
+		// Up to nFrames per channel. Returns the frames read, 0 at the end of the file.
+		size_t read(float* const* channels, size_t nFrames);
+		// Up to nFrames of the channels summed.
+		size_t readMono(float* output, size_t nFrames);
+
+	private:
+		SNDFILE* file = nullptr;
+		SF_INFO info = SF_INFO();
+		size_t blockFrames;
+		std::vector<float> block;	// blockFrames x channels, interleaved
+		double outputRate = 0;
+		size_t outputFrames = 0;
+
+		// Conversion state, empty when the rates match
+		std::vector<std::unique_ptr<Resampler>> resamplers;
+		std::vector<float> channelBlock;
+		std::vector<std::vector<float>> converted;	// per channel, one block's worth after conversion
+		size_t convertedStart = 0, convertedEnd = 0, framesDelivered = 0;
+		bool flushed = false;
+
+		size_t readBlock(size_t nFrames);
+		size_t convertBlock();
+		size_t readConverted(float* const* channels, float* mono, size_t nFrames);
+
+		DISABLE_COPY_ASSIGN(AudioFileReader)
+	};
+
+
+	// Block-wise writing over libsndfile, from one caller buffer per channel.
+	// PCM output is clipped rather than wrapped. The file is finalised by close or the destructor.
+	// Given a fileSampleRate other than samplingFrequency, the channels are converted on the way out,
+	// and close flushes the converters so the file holds the whole converted signal.
+	class AudioFileWriter {
+	public:
+		AudioFileWriter(const std::string& filePath, size_t _channels, double samplingFrequency = unda::sampleRate,
+						AudioSampleFormat format = AudioSampleFormat::PCM16, size_t _blockFrames = 4096, double fileSampleRate = 0);
+		~AudioFileWriter() { close(); }
+
+		bool isOpen() const { return file != nullptr; }
+		size_t getFramesWritten() const { return framesWritten; }
+
+		// nFrames per channel. Returns the frames taken, which are all written once close returns.
+		size_t write(const float* const* channels, size_t nFrames);
+		void close();
+
+	private:
+		SNDFILE* file = nullptr;
+		size_t channels;
+		size_t blockFrames;
+		std::vector<float> block;	// blockFrames x channels, interleaved
+		size_t framesWritten = 0;
+
+		// Conversion state, empty when the rates match
+		std::vector<std::unique_ptr<Resampler>> resamplers;
+		std::vector<std::vector<float>> converted;
+		std::vector<const float*> pointers;
+		size_t framesTaken = 0;
+
+		size_t writeInterleaved(const float* const* input, size_t nFrames);
+
+		DISABLE_COPY_ASSIGN(AudioFileWriter)
+	};
+}
@@ -0,0 +1,127 @@
+#include "AudioOutput.h"
+#include <algorithm>
+#include <cmath>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+	#include <mmsystem.h>
+#endif
+
+
+namespace unda {
+
+#ifdef _WIN32
+	struct AudioOutput::Device {
+		HWAVEOUT handle = nullptr;
+		HANDLE done = nullptr;			// signalled whenever a buffer comes back
+		std::vector<WAVEHDR> headers;
+		std::vector<int16_t> frames;	// nBuffers x blockSize x 2
+	};
+#else
+	struct AudioOutput::Device {};
+#endif
+
+	AudioOutput::AudioOutput(double _sampleRate, size_t _blockSize, size_t _nBuffers)
+		: sampleRate(_sampleRate)
+		, blockSize(_blockSize)
+		, nBuffers(std::max(_nBuffers, (size_t)2))
+		, block(_blockSize)
+	{
+	}
+
+	AudioOutput::~AudioOutput()
+	{
+		stop();
+	}
+
+	void AudioOutput::fill(int16_t* frames)
+	{
+		callback(block.data(), blockSize);
+		for (size_t n = 0; n < blockSize; n++)
+			frames[2 * n] = frames[2 * n + 1] = (int16_t)std::lround(32767.0f * std::max(-1.0f, std::min(1.0f, block[n])));
+	}
+
+#ifdef _WIN32
+	bool AudioOutput::start(Callback _callback)
+	{
+		stop();
+		callback = std::move(_callback);
+		device = std::make_unique<Device>();
+		device->done = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+		WAVEFORMATEX format{};
+		format.wFormatTag = WAVE_FORMAT_PCM;
+		format.nChannels = 2;
+		format.nSamplesPerSec = (DWORD)sampleRate;
+		format.wBitsPerSample = 16;
+		format.nBlockAlign = format.nChannels * format.wBitsPerSample / 8;
+		format.nAvgBytesPerSec = format.nSamplesPerSec * format.nBlockAlign;
+		if (!device->done || waveOutOpen(&device->handle, WAVE_MAPPER, &format, (DWORD_PTR)device->done, 0, CALLBACK_EVENT) != MMSYSERR_NOERROR) {
+			UNDA_ERROR("Could not open the audio output");
+			if (device->done) CloseHandle(device->done);
+			device.reset();
+			return false;
+		}
+		device->frames.assign(nBuffers * blockSize * 2, 0);
+		device->headers.assign(nBuffers, WAVEHDR());
+		for (size_t buffer = 0; buffer < nBuffers; buffer++) {
+			WAVEHDR& header = device->headers[buffer];
+			header.lpData = (LPSTR)&device->frames[buffer * blockSize * 2];
+			header.dwBufferLength = (DWORD)(blockSize * 2 * sizeof(int16_t));
+			waveOutPrepareHeader(device->handle, &header, sizeof(WAVEHDR));
+		}
+		running = true;
+		thread = std::thread(&AudioOutput::run, this);
+		return true;
+	}
+
+	void AudioOutput::stop()
+	{
+		if (!device) return;
+		running = false;
+		SetEvent(device->done);
+		if (thread.joinable()) thread.join();
+		waveOutReset(device->handle);
+		for (WAVEHDR& header : device->headers)
+			waveOutUnprepareHeader(device->handle, &header, sizeof(WAVEHDR));
+		waveOutClose(device->handle);
+		CloseHandle(device->done);
+		device.reset();
+	}
+
+	void AudioOutput::run()
+	{
+		// Every buffer is queued once, then refilled as soon as the device is done with it.
+		for (WAVEHDR& header : device->headers) {
+			fill((int16_t*)header.lpData);
+			waveOutWrite(device->handle, &header, sizeof(WAVEHDR));
+		}
+		// They come back in the order they were queued.
+		size_t next = 0;
+		while (running) {
+			WaitForSingleObject(device->done, INFINITE);
+			while (running && (device->headers[next].dwFlags & WHDR_DONE)) {
+				WAVEHDR& header = device->headers[next];
+				fill((int16_t*)header.lpData);
+				waveOutWrite(device->handle, &header, sizeof(WAVEHDR));
+				next = (next + 1) % nBuffers;
+			}
+		}
+	}
+#else
+	bool AudioOutput::start(Callback)
+	{
+		UNDA_ERROR("No audio output on this platform");
+		return false;
+	}
+
+	void AudioOutput::stop()
+	{
+	}
+
+	void AudioOutput::run()
+	{
+	}
+#endif
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "../utils/Settings.h"
+#include "../utils/Utils.h"
+#include "DSP.h"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <cstdint>
+
+
+namespace unda {
+
+	// Mono playback on the default output device, both channels alike. A thread of its own keeps nBuffers
+	// blocks of blockSize frames queued, asking the callback for every block as the device hands one back,
+	// so the latency is about nBuffers blocks. waveOut on Windows, elsewhere start fails and nothing plays.
+	class AudioOutput {
+	public:
+		// Fills nFrames samples in [-1, 1], on the output thread. Must not block.
+		typedef std::function<void(float* output, size_t nFrames)> Callback;
+
+		AudioOutput(double _sampleRate = unda::sampleRate, size_t _blockSize = unda::dspBlockSize, size_t _nBuffers = 8);
+		~AudioOutput();
+
+		bool start(Callback _callback);
+		void stop();
+		bool isRunning() const { return running; }
+
+	private:
+		double sampleRate;
+		size_t blockSize, nBuffers;
+		Callback callback;
+		Signal block;
+		std::thread thread;
+		std::atomic<bool> running{ false };
+
+		struct Device;
+		std::unique_ptr<Device> device;
+
+		void run();
+		// The next block from the callback, as 16 bit stereo frames.
+		void fill(int16_t* frames);
+
+		DISABLE_COPY_ASSIGN(AudioOutput)
+	};
+}
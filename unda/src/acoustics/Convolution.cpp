@@ -0,0 +1,466 @@
+#include "Convolution.h"
+#include <chrono>
+#include <limits>
+#include <mutex>
+
+namespace unda {
+	PartitionedConvolver::PartitionedConvolver(size_t _maximumIRLength, size_t _blockSize, size_t _crossfadeBlocks)
+		: blockSize(_blockSize)
+		, fftSize(2 * _blockSize)
+		, maximumPartitions(std::max<size_t>(1, (_maximumIRLength + _blockSize - 1) / _blockSize))
+		, crossfadeBlocks(std::max<size_t>(1, _crossfadeBlocks))
+	{
+		// pffft real transforms need a multiple of 32.
+		UNDA_ASSERT(blockSize > 0 && fftSize % 32 == 0);
+		fftSetup = FFTCache::getSetup(fftSize);
+		delayLine.assign(maximumPartitions * fftSize, 0.0f);
+		window.assign(fftSize, 0.0f);
+		accumulator.assign(fftSize, 0.0f);
+		fadeAccumulator.assign(fftSize, 0.0f);
+		workSpace.assign(fftSize, 0.0f);
+		inputBlock.assign(blockSize, 0.0f);
+		outputBlock.assign(blockSize, 0.0f);
+	}
+
+	PartitionedConvolver::~PartitionedConvolver()
+	{
+		delete current;
+		delete fadingOut;
+		delete retiring;
+		delete pending.exchange(nullptr);
+		delete retired.exchange(nullptr);
+	}
+
+	void PartitionedConvolver::setImpulseResponse(const Signal& impulseResponse)
+	{
+		// Whatever the audio thread has finished with.
+		delete retired.exchange(nullptr, std::memory_order_acq_rel);
+
+		size_t count = (impulseResponse.size() + blockSize - 1) / blockSize;
+		if (count > maximumPartitions) {
+			UNDA_LOG_MESSAGE("PartitionedConvolver: IR of " + std::to_string(impulseResponse.size()) + " samples truncated to "
+							 + std::to_string(getMaximumIRLength()));
+			count = maximumPartitions;
+		}
+		Partitions* next = new Partitions();
+		next->count = count;
+		next->spectra.assign(count * fftSize, 0.0f);
+		FFTBuffer padded = FFTCache::acquire(fftSize), work = FFTCache::acquire(fftSize);
+		const float scaling = 1.0f / (float)fftSize;
+		for (size_t partition = 0; partition < count; partition++) {
+			// Partition in the first half, zeros in the second: only the last blockSize samples of each
+			// inverse transform are then free of circular wrap-around.
+			std::fill(padded.begin(), padded.end(), 0.0f);
+			size_t start = partition * blockSize;
+			size_t length = std::min(blockSize, impulseResponse.size() - start);
+			for (size_t n = 0; n < length; n++) padded[n] = impulseResponse[start + n] * scaling;
+			pffft_transform(fftSetup, padded.data(), next->spectra.data() + partition * fftSize, work.data(), pffft_direction_t::PFFFT_FORWARD);
+		}
+
+		// Replaces an IR the audio thread has not picked up yet.
+		delete pending.exchange(next, std::memory_order_acq_rel);
+	}
+
+	void PartitionedConvolver::reset()
+	{
+		std::fill(delayLine.begin(), delayLine.end(), 0.0f);
+		std::fill(window.begin(), window.end(), 0.0f);
+		std::fill(inputBlock.begin(), inputBlock.end(), 0.0f);
+		std::fill(outputBlock.begin(), outputBlock.end(), 0.0f);
+		delayLineHead = 0;
+		blockFill = 0;
+		delete fadingOut;
+		delete retiring;
+		fadingOut = retiring = nullptr;
+		crossfadePosition = 0;
+	}
+
+	void PartitionedConvolver::process(const float* input, float* output, size_t nFrames)
+	{
+		size_t n = 0;
+		while (n < nFrames) {
+			size_t count = std::min(nFrames - n, blockSize - blockFill);
+			// Input first, output may alias it.
+			std::copy(input + n, input + n + count, inputBlock.begin() + blockFill);
+			std::copy(outputBlock.begin() + blockFill, outputBlock.begin() + blockFill + count, output + n);
+			blockFill += count;
+			n += count;
+			if (blockFill == blockSize) {
+				processBlock();
+				blockFill = 0;
+			}
+		}
+	}
+
+	void PartitionedConvolver::convolvePartitions(const Partitions& partitions, float* result)
+	{
+		std::fill(result, result + fftSize, 0.0f);
+		for (size_t partition = 0; partition < partitions.count; partition++) {
+			size_t slot = (delayLineHead + maximumPartitions - partition) % maximumPartitions;
+			pffft_zconvolve_accumulate(fftSetup, delayLine.data() + slot * fftSize, partitions.spectra.data() + partition * fftSize, result, 1.0f);
+		}
+		pffft_transform(fftSetup, result, result, workSpace.data(), pffft_direction_t::PFFFT_BACKWARD);
+	}
+
+	void PartitionedConvolver::processBlock()
+	{
+		// Hand back the IR faded out last time, once the producer has emptied the slot.
+		if (retiring) {
+			Partitions* expected = nullptr;
+			if (retired.compare_exchange_strong(expected, retiring, std::memory_order_acq_rel)) retiring = nullptr;
+		}
+		// One swap at a time: a new IR waits until the previous crossfade has been handed back.
+		if (!fadingOut && !retiring && pending.load(std::memory_order_relaxed)) {
+			if (Partitions* next = pending.exchange(nullptr, std::memory_order_acq_rel)) {
+				fadingOut = current;
+				current = next;
+				crossfadePosition = 0;
+			}
+		}
+
+		// Slide the window and push its spectrum onto the delay line.
+		std::copy(window.begin() + blockSize, window.end(), window.begin());
+		std::copy(inputBlock.begin(), inputBlock.end(), window.begin() + blockSize);
+		pffft_transform(fftSetup, window.data(), delayLine.data() + delayLineHead * fftSize, workSpace.data(), pffft_direction_t::PFFFT_FORWARD);
+
+		if (current) {
+			convolvePartitions(*current, accumulator.data());
+			std::copy(accumulator.begin() + blockSize, accumulator.end(), outputBlock.begin());
+		}
+		else {
+			std::fill(outputBlock.begin(), outputBlock.end(), 0.0f);
+		}
+
+		if (fadingOut) {
+			// Linear: both IRs see the same input, so their outputs are strongly correlated.
+			convolvePartitions(*fadingOut, fadeAccumulator.data());
+			const float* old = fadeAccumulator.data() + blockSize;
+			const float step = 1.0f / (float)(crossfadeBlocks * blockSize);
+			for (size_t n = 0; n < blockSize; n++) {
+				float gain = (float)(crossfadePosition * blockSize + n + 1) * step;
+				outputBlock[n] = old[n] + gain * (outputBlock[n] - old[n]);
+			}
+			if (++crossfadePosition == crossfadeBlocks) {
+				retiring = fadingOut;
+				fadingOut = nullptr;
+			}
+		}
+
+		delayLineHead = (delayLineHead + 1) % maximumPartitions;
+	}
+
+
+	NonUniformConvolver::NonUniformConvolver(const Signal& kernel, size_t _firstBlockSize, size_t _maximumBlockSize, unsigned int _nThreads)
+		: kernelLength(kernel.size())
+		, chunkSize(0)
+		, nThreads(std::max(1u, _nThreads))
+	{
+		UNDA_ASSERT(kernelLength > 0 && _firstBlockSize >= 16 && _maximumBlockSize >= _firstBlockSize);
+		for (const std::array<size_t, 3>& layout : partitionLayout(kernelLength, _firstBlockSize, _maximumBlockSize)) {
+			Segment segment;
+			segment.blockSize = layout[0];
+			segment.offset = layout[1];
+			segment.nPartitions = layout[2];
+			segments.push_back(std::move(segment));
+		}
+
+		size_t maximumOffset = 0;
+		for (Segment& segment : segments) {
+			segment.fftSize = 2 * segment.blockSize;
+			segment.fftSetup = FFTCache::getSetup(segment.fftSize);
+			segment.spectra.assign(segment.nPartitions * segment.fftSize, 0.0f);
+			segment.delayLine.assign(segment.nPartitions * segment.fftSize, 0.0f);
+			segment.window.assign(segment.fftSize, 0.0f);
+			FFTBuffer padded = FFTCache::acquire(segment.fftSize), work = FFTCache::acquire(segment.fftSize);
+			const float scaling = 1.0f / (float)segment.fftSize;
+			for (size_t partition = 0; partition < segment.nPartitions; partition++) {
+				std::fill(padded.begin(), padded.end(), 0.0f);
+				size_t start = segment.offset + partition * segment.blockSize;
+				size_t length = std::min(segment.blockSize, kernelLength - start);
+				for (size_t n = 0; n < length; n++) padded[n] = kernel[start + n] * scaling;
+				pffft_transform(segment.fftSetup, padded.data(), segment.spectra.data() + partition * segment.fftSize, work.data(), pffft_direction_t::PFFFT_FORWARD);
+			}
+			chunkSize = std::max(chunkSize, segment.blockSize);
+			maximumOffset = std::max(maximumOffset, segment.offset);
+		}
+
+		for (size_t index = 0; index < segments.size(); index++) {
+			const Segment& segment = segments[index];
+			size_t nRanges = segment.blockSize == chunkSize ? std::min<size_t>(nThreads, segment.nPartitions) : 1;
+			for (size_t range = 0; range < nRanges; range++) {
+				Task task;
+				task.segment = index;
+				task.firstPartition = segment.nPartitions * range / nRanges;
+				task.lastPartition = segment.nPartitions * (range + 1) / nRanges;
+				task.accumulator.assign(segment.fftSize, 0.0f);
+				task.workSpace.assign(segment.fftSize, 0.0f);
+				task.output.assign(chunkSize, 0.0f);
+				tasks.push_back(std::move(task));
+			}
+		}
+		workSpace.assign(2 * chunkSize, 0.0f);
+		// Chunk c writes [c + offset, c + offset + chunkSize) and releases [c, c + chunkSize).
+		outputRing.assign((maximumOffset + 2 * chunkSize - 1) / chunkSize * chunkSize, 0.0f);
+	}
+
+	std::vector<std::array<size_t, 3>> NonUniformConvolver::partitionLayout(size_t kernelLength, size_t firstBlockSize, size_t maximumBlockSize)
+	{
+		// Two partitions per size, doubling until the maximum, which then takes the rest of the IR.
+		std::vector<std::array<size_t, 3>> layout;
+		size_t offset = 0, blockSize = firstBlockSize;
+		while (offset < kernelLength) {
+			size_t size = std::min(blockSize, maximumBlockSize);
+			size_t remaining = (kernelLength - offset + size - 1) / size;
+			size_t nPartitions = size == maximumBlockSize ? remaining : std::min<size_t>(2, remaining);
+			layout.push_back({ size, offset, nPartitions });
+			offset += nPartitions * size;
+			blockSize *= 2;
+		}
+		return layout;
+	}
+
+	double NonUniformConvolver::estimateCost(size_t signalLength, size_t kernelLength, const ConvolutionCostModel& model, size_t firstBlockSize, size_t maximumBlockSize)
+	{
+		std::vector<std::array<size_t, 3>> layout = partitionLayout(kernelLength, firstBlockSize, maximumBlockSize);
+		// Every segment runs over the whole output: a forward and an inverse transform per block, and
+		// one spectrum product per partition.
+		double nOutput = (double)(signalLength + kernelLength - 1), cost = model.callOverhead;
+		for (const std::array<size_t, 3>& segment : layout) {
+			double fftSize = 2.0 * (double)segment[0];
+			double perBlock = 2.0 * model.fftButterfly * fftSize * log2(fftSize) + model.spectrumMultiplyAdd * fftSize * (double)segment[2];
+			cost += nOutput / (double)segment[0] * perBlock;
+		}
+		return cost;
+	}
+
+	void NonUniformConvolver::reset()
+	{
+		for (Segment& segment : segments) {
+			std::fill(segment.delayLine.begin(), segment.delayLine.end(), 0.0f);
+			std::fill(segment.window.begin(), segment.window.end(), 0.0f);
+			segment.head = 0;
+		}
+		std::fill(outputRing.begin(), outputRing.end(), 0.0f);
+		chunkPosition = 0;
+	}
+
+	void NonUniformConvolver::accumulatePartitions(const Segment& segment, size_t firstPartition, size_t lastPartition, Task& task)
+	{
+		float* result = task.accumulator.data();
+		std::fill(result, result + segment.fftSize, 0.0f);
+		for (size_t partition = firstPartition; partition < lastPartition; partition++) {
+			size_t slot = (segment.head + segment.nPartitions - partition) % segment.nPartitions;
+			pffft_zconvolve_accumulate(segment.fftSetup, segment.delayLine.data() + slot * segment.fftSize, segment.spectra.data() + partition * segment.fftSize, result, 1.0f);
+		}
+		pffft_transform(segment.fftSetup, result, result, task.workSpace.data(), pffft_direction_t::PFFFT_BACKWARD);
+	}
+
+	void NonUniformConvolver::runTask(Task& task, const float* input)
+	{
+		Segment& segment = segments[task.segment];
+		size_t B = segment.blockSize;
+		if (B == chunkSize) {
+			// Input already on the delay line.
+			accumulatePartitions(segment, task.firstPartition, task.lastPartition, task);
+			std::copy(task.accumulator.begin() + B, task.accumulator.begin() + 2 * B, task.output.begin());
+			return;
+		}
+		for (size_t block = 0; block < chunkSize / B; block++) {
+			std::copy(segment.window.begin() + B, segment.window.end(), segment.window.begin());
+			std::copy(input + block * B, input + (block + 1) * B, segment.window.begin() + B);
+			pffft_transform(segment.fftSetup, segment.window.data(), segment.delayLine.data() + segment.head * segment.fftSize, task.workSpace.data(), pffft_direction_t::PFFFT_FORWARD);
+			accumulatePartitions(segment, 0, segment.nPartitions, task);
+			std::copy(task.accumulator.begin() + B, task.accumulator.begin() + 2 * B, task.output.begin() + block * B);
+			segment.head = (segment.head + 1) % segment.nPartitions;
+		}
+	}
+
+	void NonUniformConvolver::processChunk(utils::WorkerPool& pool, const float* input, float* output)
+	{
+		// The chunk sized segment is transformed once here, its partition ranges only read the delay line.
+		for (Segment& segment : segments) {
+			if (segment.blockSize != chunkSize) continue;
+			std::copy(segment.window.begin() + chunkSize, segment.window.end(), segment.window.begin());
+			std::copy(input, input + chunkSize, segment.window.begin() + chunkSize);
+			pffft_transform(segment.fftSetup, segment.window.data(), segment.delayLine.data() + segment.head * segment.fftSize, workSpace.data(), pffft_direction_t::PFFFT_FORWARD);
+		}
+
+		pool.run([this, input](unsigned int thread, unsigned int nWorkers) {
+			for (size_t i = thread; i < tasks.size(); i += nWorkers)
+				runTask(tasks[i], input);
+		});
+
+		for (Segment& segment : segments)
+			if (segment.blockSize == chunkSize) segment.head = (segment.head + 1) % segment.nPartitions;
+
+		size_t ringSize = outputRing.size();
+		for (const Task& task : tasks) {
+			size_t start = (chunkPosition + segments[task.segment].offset) % ringSize;
+			for (size_t n = 0; n < chunkSize; n++)
+				outputRing[(start + n) % ringSize] += task.output[n];
+		}
+		size_t start = chunkPosition % ringSize;
+		std::copy(outputRing.begin() + start, outputRing.begin() + start + chunkSize, output);
+		std::fill(outputRing.begin() + start, outputRing.begin() + start + chunkSize, 0.0f);
+		chunkPosition += chunkSize;
+	}
+
+	Signal NonUniformConvolver::convolve(const Signal& signal)
+	{
+		reset();
+		utils::WorkerPool pool(getPoolSize());
+		Signal output(signal.size() + kernelLength - 1), inputChunk(chunkSize), outputChunk(chunkSize);
+		for (size_t position = 0; position < output.size(); position += chunkSize) {
+			std::fill(inputChunk.begin(), inputChunk.end(), 0.0f);
+			if (position < signal.size())
+				std::copy(signal.begin() + position, signal.begin() + std::min(signal.size(), position + chunkSize), inputChunk.begin());
+			processChunk(pool, inputChunk.data(), outputChunk.data());
+			std::copy(outputChunk.begin(), outputChunk.begin() + std::min(chunkSize, output.size() - position), output.begin() + position);
+		}
+		return output;
+	}
+
+	int NonUniformConvolver::convolveFile(const std::string& inputPath, const std::string& outputPath, float* peak, AudioSampleFormat format, double fileSampleRate)
+	{
+		AudioFileReader reader(inputPath, chunkSize, unda::sampleRate);
+		if (!reader.isOpen()) return -1;
+		AudioFileWriter writer(outputPath, 1, unda::sampleRate, format, chunkSize, fileSampleRate);
+		if (!writer.isOpen()) return -1;
+
+		reset();
+		utils::WorkerPool pool(getPoolSize());
+		size_t outputLength = reader.getFrameCount() + kernelLength - 1;
+		Signal inputChunk(chunkSize), outputChunk(chunkSize);
+		float maximum = 0.0f;
+		int error = 0;
+		for (size_t position = 0; position < outputLength; position += chunkSize) {
+			size_t nRead = reader.readMono(inputChunk.data(), chunkSize);
+			std::fill(inputChunk.begin() + nRead, inputChunk.end(), 0.0f);
+			processChunk(pool, inputChunk.data(), outputChunk.data());
+			size_t nWrite = std::min(chunkSize, outputLength - position);
+			for (size_t n = 0; n < nWrite; n++) maximum = std::max(maximum, std::abs(outputChunk[n]));
+			const float* channels[] = { outputChunk.data() };
+			if (writer.write(channels, nWrite) != nWrite) {
+				UNDA_ERROR("Could not write " + outputPath);
+				error = -1;
+				break;
+			}
+		}
+		if (peak) *peak = maximum;
+		return error;
+	}
+
+
+	namespace {
+		std::mutex costModelMutex;
+		ConvolutionCostModel costModel;
+
+		// Seconds per call of work, repeated until the total is long enough to trust the clock.
+		template<typename Work> double timeWork(Work work)
+		{
+			work();
+			size_t repeats = 0;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			double elapsed = 0;
+			do {
+				work();
+				repeats++;
+				elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			} while (elapsed < 0.02);
+			return elapsed / (double)repeats;
+		}
+	}
+
+	Signal DirectConvolution(const Signal& signal, const Signal& kernel)
+	{
+		if (signal.empty() || kernel.empty()) return Signal();
+		constexpr size_t tile = 4 * simd::width;
+		size_t K = kernel.size(), nOutput = signal.size() + K - 1;
+		size_t nTiled = (nOutput + tile - 1) / tile * tile;
+		// output[n] = sum_j reversed[j] * padded[n + j], with K - 1 zeros either side of the signal.
+		Signal reversed(kernel.rbegin(), kernel.rend());
+		Signal padded(nTiled + K - 1, 0.0f);
+		std::copy(signal.begin(), signal.end(), padded.begin() + K - 1);
+		simd::AlignedVector<float> tiled(nTiled);
+
+		const float* x = padded.data();
+		for (size_t n = 0; n < nTiled; n += tile) {
+			simd::float4 sum0 = simd::zero(), sum1 = simd::zero(), sum2 = simd::zero(), sum3 = simd::zero();
+			const float* window = x + n;
+			for (size_t j = 0; j < K; j++) {
+				simd::float4 tap = simd::set(reversed[j]);
+				sum0 = simd::madd(tap, simd::loadu(window + j), sum0);
+				sum1 = simd::madd(tap, simd::loadu(window + j + 4), sum1);
+				sum2 = simd::madd(tap, simd::loadu(window + j + 8), sum2);
+				sum3 = simd::madd(tap, simd::loadu(window + j + 12), sum3);
+			}
+			simd::store(&tiled[n], sum0);
+			simd::store(&tiled[n + 4], sum1);
+			simd::store(&tiled[n + 8], sum2);
+			simd::store(&tiled[n + 12], sum3);
+		}
+		return Signal(tiled.begin(), tiled.begin() + nOutput);
+	}
+
+	ConvolutionCostModel ConvolutionCostModel::calibrate()
+	{
+		ConvolutionCostModel model;
+		Signal signal(8192), kernel(64);
+		for (size_t n = 0; n < signal.size(); n++) signal[n] = (float)((n * 7919) % 1000) / 1000.0f - 0.5f;
+		for (size_t n = 0; n < kernel.size(); n++) kernel[n] = signal[n * 3];
+		model.directMultiplyAdd = timeWork([&]() { DirectConvolution(signal, kernel); }) / (double)(signal.size() * kernel.size());
+
+		const size_t N = 65536;
+		PFFFT_Setup* fftSetup = FFTCache::getSetup(N);
+		FFTBuffer a = FFTCache::acquire(N), b = FFTCache::acquire(N), work = FFTCache::acquire(N);
+		for (size_t n = 0; n < N; n++) a[n] = b[n] = signal[n % signal.size()];
+		model.fftButterfly = timeWork([&]() { pffft_transform(fftSetup, a.data(), a.data(), work.data(), pffft_direction_t::PFFFT_FORWARD); }) / ((double)N * log2((double)N));
+		model.spectrumMultiplyAdd = timeWork([&]() { pffft_zconvolve_accumulate(fftSetup, a.data(), b.data(), work.data(), 1.0f); }) / (double)N;
+
+		// Whatever a tiny FFT convolution costs beyond its arithmetic.
+		Signal tiny(16, 0.5f);
+		double tinyTime = timeWork([&]() { FFTConvolution(tiny, tiny); });
+		model.callOverhead = std::max(0.0, tinyTime - 3.0 * model.fftButterfly * 32.0 * 5.0 - model.spectrumMultiplyAdd * 32.0);
+		return model;
+	}
+
+	void SetConvolutionCostModel(const ConvolutionCostModel& model)
+	{
+		std::lock_guard<std::mutex> lock(costModelMutex);
+		costModel = model;
+	}
+
+	ConvolutionCostModel GetConvolutionCostModel()
+	{
+		std::lock_guard<std::mutex> lock(costModelMutex);
+		return costModel;
+	}
+
+	ConvolutionAlgorithm ChooseConvolutionAlgorithm(size_t signalLength, size_t kernelLength)
+	{
+		ConvolutionCostModel model = GetConvolutionCostModel();
+		double S = (double)signalLength, K = (double)kernelLength;
+		double direct = model.directMultiplyAdd * S * K;
+
+		size_t N = std::max<size_t>((size_t)unda::roundUpToNextPowerOfTwo((unsigned int)(signalLength + kernelLength - 1)), 32);
+		double fft = std::numeric_limits<double>::infinity();
+		if (N <= model.maximumFFTSize)
+			fft = model.callOverhead + 3.0 * model.fftButterfly * (double)N * log2((double)N) + model.spectrumMultiplyAdd * (double)N;
+
+		// Segments run side by side on all cores.
+		double partitioned = NonUniformConvolver::estimateCost(signalLength, kernelLength, model) / (double)std::max(1u, std::thread::hardware_concurrency());
+
+		if (direct <= fft && direct <= partitioned) return ConvolutionAlgorithm::Direct;
+		return fft <= partitioned ? ConvolutionAlgorithm::FFT : ConvolutionAlgorithm::Partitioned;
+	}
+
+	Signal Convolve(const Signal& signal, const Signal& kernel)
+	{
+		if (signal.empty() || kernel.empty()) return Signal();
+		switch (ChooseConvolutionAlgorithm(signal.size(), kernel.size())) {
+		case ConvolutionAlgorithm::Direct:      return DirectConvolution(signal, kernel);
+		case ConvolutionAlgorithm::FFT:         return FFTConvolution(signal, kernel);
+		default:                                return NonUniformConvolver(kernel).convolve(signal);
+		}
+	}
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "DSP.h"
+#include "../utils/Settings.h"
+#include "../utils/Utils.h"
+#include "../utils/SIMD.h"
+#include "../utils/WorkerPool.h"
+#include <pffft.h>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <thread>
+
+
+namespace unda {
+
+	// Streaming uniformly partitioned overlap-save convolution.
+	// The IR is cut into partitions of blockSize samples, each kept as the spectrum of a 2 * blockSize
+	// FFT. Every input block is transformed once and pushed onto a frequency-domain delay line, and one
+	// output block is the inverse transform of the sum of delay line x partition products, so a block
+	// costs two FFTs plus one complex multiply-add per partition, whatever the IR length.
+	// Input is gathered into whole blocks, so the output lags the input by exactly blockSize samples
+	// for any nFrames. All buffers are allocated up front: process never allocates, locks or frees.
+	//
+	// setImpulseResponse can be called from another thread (one producer at a time) while process runs,
+	// as Scene does with progressive snapshots and listener moves while AudioOutput plays through it (a
+	// move cancels the progressive render first, so they never overlap). The new partitions are built on
+	// the calling thread and handed over through an atomic slot; the audio thread picks them up at the
+	// next block boundary and crossfades from the old IR to the new one over crossfadeBlocks blocks, both
+	// running off the same delay line. The old partitions are handed back through a second slot and
+	// freed by the producer.
+	class PartitionedConvolver {
+	public:
+		PartitionedConvolver(size_t _maximumIRLength, size_t _blockSize = unda::dspBlockSize, size_t _crossfadeBlocks = 4);
+		~PartitionedConvolver();
+
+		// Thread-safe with respect to process. IRs longer than the maximum length are truncated.
+		void setImpulseResponse(const Signal& impulseResponse);
+		// Not thread-safe, clears the delay line and pending output.
+		void reset();
+
+		// Streaming, mono. input and output may alias.
+		void process(const float* input, float* output, size_t nFrames);
+
+		size_t getLatency() const { return blockSize; }
+		size_t getBlockSize() const { return blockSize; }
+		size_t getMaximumIRLength() const { return maximumPartitions * blockSize; }
+
+	private:
+		struct Partitions {
+			size_t count = 0;
+			simd::AlignedVector<float> spectra;		// count x fftSize, pffft internal order, scaled by 1 / fftSize
+		};
+
+		size_t blockSize, fftSize, maximumPartitions, crossfadeBlocks;
+		PFFFT_Setup* fftSetup = nullptr;		// shared, from FFTCache
+
+		// Audio thread state
+		simd::AlignedVector<float> delayLine;		// maximumPartitions x fftSize input spectra, ring
+		size_t delayLineHead = 0;
+		simd::AlignedVector<float> window;			// previous and current input block
+		simd::AlignedVector<float> accumulator, fadeAccumulator, workSpace;
+		Signal inputBlock, outputBlock;
+		size_t blockFill = 0;
+
+		Partitions* current = nullptr;
+		Partitions* fadingOut = nullptr;			// being crossfaded away from
+		Partitions* retiring = nullptr;				// waiting for a free retired slot
+		size_t crossfadePosition = 0;
+
+		// Handover, producer <-> audio thread
+		std::atomic<Partitions*> pending{ nullptr };
+		std::atomic<Partitions*> retired{ nullptr };
+
+		void processBlock();
+		void convolvePartitions(const Partitions& partitions, float* result);
+
+		DISABLE_COPY_ASSIGN(PartitionedConvolver)
+	};
+
+
+	// Per-operation costs in seconds used by Convolve to pick an algorithm. The defaults are rough
+	// figures for a current x64 core; calibrate measures them on the machine it runs on, in about 0.1 s.
+	// Measured costs vary from run to run, and so can the algorithm picked, and the output's rounding.
+	struct ConvolutionCostModel {
+		double directMultiplyAdd = 0.1e-9;		// per tap and output sample
+		double fftButterfly = 0.3e-9;			// per N log2 N of a real transform
+		double spectrumMultiplyAdd = 0.3e-9;	// per float of a zconvolve_accumulate
+		double callOverhead = 2e-6;				// per FFT based call
+		size_t maximumFFTSize = (size_t)1 << 23;	// single FFT buffers above this go partitioned
+
+		static ConvolutionCostModel calibrate();
+	};
+
+	enum class ConvolutionAlgorithm { Direct, FFT, Partitioned };
+
+	// Full linear convolution, the output has signal.size() + kernel.size() - 1 samples.
+	// Direct form FIR, vectorised over 16 output samples at a time. Best for short kernels.
+	Signal DirectConvolution(const Signal& signal, const Signal& kernel);
+	// Cheapest algorithm under the current cost model.
+	ConvolutionAlgorithm ChooseConvolutionAlgorithm(size_t signalLength, size_t kernelLength);
+	Signal Convolve(const Signal& signal, const Signal& kernel);
+	// Process-wide model used by ChooseConvolutionAlgorithm, the defaults unless one is set, e.g.
+	// SetConvolutionCostModel(ConvolutionCostModel::calibrate()) at startup.
+	void SetConvolutionCostModel(const ConvolutionCostModel& model);
+	ConvolutionCostModel GetConvolutionCostModel();
+
+
+	// Offline non-uniformly partitioned overlap-save convolution, for long signals against long IRs.
+	// The IR is split into segments whose block size doubles every two partitions, from firstBlockSize
+	// up to maximumBlockSize, after which the rest of the IR is one uniform segment at maximumBlockSize
+	// (Gardner's scheme: every segment starts at least one of its blocks into the IR). Each segment is
+	// a uniformly partitioned convolver over the whole input with its own delay line, and its output is
+	// added in at the segment's offset. The input is consumed in chunks of the largest block size, so
+	// memory is bounded by the IR and the partition sizes, never by the signal length.
+	// Segments are rendered in parallel on threads started once per convolve or convolveFile, and the
+	// partitions of the long last segment are split between them.
+	class NonUniformConvolver {
+	public:
+		NonUniformConvolver(const Signal& kernel, size_t _firstBlockSize = unda::dspBlockSize, size_t _maximumBlockSize = 16384,
+							unsigned int _nThreads = std::thread::hardware_concurrency());
+		~NonUniformConvolver() = default;
+
+		// Full convolution, signal.size() + kernel.size() - 1 samples.
+		Signal convolve(const Signal& signal);
+		// Streams a file through, mixed down to mono, in constant memory. Inputs at other rates are
+		// converted to unda::sampleRate on the way in, and the output to fileSampleRate if given.
+		// Float32 output by default so nothing clips; the returned peak can be used to normalise in a
+		// second pass.
+		int convolveFile(const std::string& inputPath, const std::string& outputPath, float* peak = nullptr,
+						 AudioSampleFormat format = AudioSampleFormat::Float32, double fileSampleRate = 0);
+
+		size_t getChunkSize() const { return chunkSize; }
+
+		// Block size, offset into the IR and partition count of every segment.
+		static std::vector<std::array<size_t, 3>> partitionLayout(size_t kernelLength, size_t firstBlockSize = unda::dspBlockSize, size_t maximumBlockSize = 16384);
+		// Single-threaded time for the whole convolution under model.
+		static double estimateCost(size_t signalLength, size_t kernelLength, const ConvolutionCostModel& model,
+								   size_t firstBlockSize = unda::dspBlockSize, size_t maximumBlockSize = 16384);
+
+	private:
+		struct Segment {
+			size_t blockSize = 0, fftSize = 0, offset = 0, nPartitions = 0;
+			PFFFT_Setup* fftSetup = nullptr;		// shared, from FFTCache
+			simd::AlignedVector<float> spectra;		// nPartitions x fftSize, scaled by 1 / fftSize
+			simd::AlignedVector<float> delayLine;	// nPartitions x fftSize, ring
+			simd::AlignedVector<float> window;
+			size_t head = 0;
+		};
+		// A run of one segment's partitions. Segments smaller than the chunk are one task and step
+		// through their blocks themselves; the chunk sized segment is shared out by partition ranges.
+		struct Task {
+			size_t segment = 0, firstPartition = 0, lastPartition = 0;
+			simd::AlignedVector<float> accumulator, workSpace;
+			Signal output;
+		};
+
+		size_t kernelLength, chunkSize;
+		unsigned int nThreads;
+		std::vector<Segment> segments;
+		std::vector<Task> tasks;
+		Signal outputRing;		// pending output, chunkSize past the furthest segment offset
+		simd::AlignedVector<float> workSpace;
+		size_t chunkPosition = 0;
+
+		void reset();
+		// Consumes chunkSize input samples and produces the next chunkSize output samples.
+		void processChunk(utils::WorkerPool& pool, const float* input, float* output);
+		void runTask(Task& task, const float* input);
+		void accumulatePartitions(const Segment& segment, size_t firstPartition, size_t lastPartition, Task& task);
+		unsigned int getPoolSize() const { return std::min(nThreads, (unsigned int)tasks.size()); }
+
+		DISABLE_COPY_ASSIGN(NonUniformConvolver)
+	};
+}
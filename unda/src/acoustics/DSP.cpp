@@ -1,4 +1,5 @@
 #include "DSP.h"
+#include "Convolution.h"
 
 
 namespace unda {
@@ -42,56 +43,29 @@ namespace unda {
 		}
 	}
 
-	int WriteAudioFile(const std::vector<Signal>& audioChannels, const std::string& filePath, double samplingFrequency)
+	int WriteAudioFile(const std::vector<Signal>& audioChannels, const std::string& filePath, double samplingFrequency, AudioSampleFormat format, double fileSampleRate)
 	{
-		int error = 0;
-		size_t channels = audioChannels.size();
-		size_t nSamples = channels * (size_t)audioChannels[0].size();
-		double* rawData = new double[nSamples];
-		double* ptr = rawData;
-		for (size_t i = 0; i < audioChannels[0].size(); i++) {
-			for (int j = 0; j < audioChannels.size(); j++) {
-				double* channelPtr = ptr + j;
-				*channelPtr = audioChannels[j][i];
-			}
-			ptr += channels;
-		}
-		SF_INFO wavInfo = SF_INFO();
-		wavInfo.samplerate = (int)samplingFrequency;
-		wavInfo.channels =  (int)channels;
-		wavInfo.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;	
-		SNDFILE* sndFile = sf_open((const char*)filePath.c_str(), SFM_WRITE, &wavInfo);
-		if (sf_error(sndFile) != SF_ERR_NO_ERROR) { UNDA_ERROR("Could not open " + filePath + " ..."); error = -1; }
-		sf_count_t written = sf_writef_double(sndFile, (const double*)rawData, (sf_count_t)nSamples);
-		sf_close(sndFile);
-		delete[] rawData;
-		return error;
+		if (audioChannels.empty()) { UNDA_ERROR("No channels to write to " + filePath); return -1; }
+		AudioFileWriter writer(filePath, audioChannels.size(), samplingFrequency, format, 4096, fileSampleRate);
+		if (!writer.isOpen()) return -1;
+		std::vector<const float*> channels;
+		for (const Signal& channel : audioChannels) channels.push_back(channel.data());
+		size_t nFrames = audioChannels[0].size();
+		return writer.write(channels.data(), nFrames) == nFrames ? 0 : -1;
 	}
 
 	Signal ReadAudioFileIntoMono(const std::string& filePath)
 	{
 		Signal out;
-		SF_INFO info;
-		SNDFILE* sndFile = sf_open(filePath.c_str(), SFM_READ, &info);
-		if ((int)info.samplerate != (int)unda::sampleRate) { UNDA_ERROR("Eror in file: " + filePath + " SampleRate has to be " + std::to_string((int)unda::sampleRate)); }
-		else if (info.frames == 0) { UNDA_ERROR("No frames in: " + filePath); }
+		AudioFileReader reader(filePath, 4096, unda::sampleRate);
+		if (!reader.isOpen()) return out;
+		if (reader.getFrameCount() == 0) { UNDA_ERROR("No frames in: " + filePath); }
 		else {
-			float* data = new float[(size_t)info.frames * (size_t)info.channels];
-			size_t nRead = (size_t)sf_read_float(sndFile, data, info.frames * info.channels);
-			out.resize(nRead);
-			float* iterator = data;
-			for (size_t i = 0; i < (size_t)(nRead / info.channels); i++) {
-				float sample = 0;
-				for (size_t channel = 0; channel < (size_t)info.channels; channel++) {
-					sample += float(*(iterator + channel));
-				}
-				out[i] = sample;
-				iterator += info.channels;
-			}
+			// Converted and mixed down block by block straight into the output.
+			out.resize(reader.getFrameCount());
+			out.resize(reader.readMono(out.data(), out.size()));
 			NormaliseSignal(out);
-			delete[] data;
 		}
-		sf_close(sndFile);
 		return out;
 	}
 
@@ -100,11 +74,13 @@ namespace unda {
 	{
 		size_t nConv = signal.size() + kernel.size() - 1; // Convolved Length = len_input + len_kernel - 1
 		size_t N = (size_t)unda::roundUpToNextPowerOfTwo((unsigned int)nConv); // PFFFT wants powers of two for efficiency
-		PFFFT_Setup* fftSetup = pffft_new_setup((int)N, pffft_transform_t::PFFFT_REAL);
-		float* paddedSignal = new float[N];
-		float* paddedKernel = new float[N];
-		float* workSpace    = new float[N];
-		float* convolution  = new float[N];
+		N = std::max<size_t>(N, 32); // and at least 32 for real transforms
+		PFFFT_Setup* fftSetup = FFTCache::getSetup(N);
+		FFTBuffer buffers = FFTCache::acquire(4 * N);
+		float* paddedSignal = buffers.data();
+		float* paddedKernel = paddedSignal + N;
+		float* workSpace    = paddedKernel + N;
+		float* convolution  = workSpace + N;
 		for (size_t i = 0; i < N; i++) {
 			// Zero padding inputs
 			paddedKernel[i] = i < kernel.size() ? kernel[i] : 0.0f;
@@ -119,14 +95,80 @@ namespace unda {
 		Signal out = Signal(nConv, 0);
 		for (size_t i = 0; i < nConv; i++)
 			out[i] = (Sample)((float)convolution[i] / (float)N); // Rescaling as PFFFT_BACKWARD(PFFFT_FORWARD(x)) = N*x
-		delete[] paddedSignal;
-		delete[] paddedKernel;
-		delete[] workSpace;
-		delete[] convolution;
-		pffft_destroy_setup(fftSetup);
 		return out;
 	}
 
+	int BatchFFTConvolution(const std::vector<Signal>& signals, const std::vector<Signal>& kernels, const std::vector<std::array<size_t, 2>>& pairs,
+							std::vector<Signal>& outputs, unsigned int nThreads)
+	{
+		if (outputs.size() != pairs.size()) { UNDA_ERROR("BatchFFTConvolution: one output channel per pair expected"); return -1; }
+		// A pair with an empty operand convolves to nothing, and is only zeroed.
+		size_t longestSignal = 0, longestKernel = 0;
+		std::vector<size_t> live;
+		for (size_t i = 0; i < pairs.size(); i++) {
+			if (pairs[i][0] >= signals.size() || pairs[i][1] >= kernels.size()) { UNDA_ERROR("BatchFFTConvolution: pair out of range"); return -1; }
+			if (signals[pairs[i][0]].empty() || kernels[pairs[i][1]].empty()) {
+				std::fill(outputs[i].begin(), outputs[i].end(), 0.0f);
+				continue;
+			}
+			live.push_back(i);
+			longestSignal = std::max(longestSignal, signals[pairs[i][0]].size());
+			longestKernel = std::max(longestKernel, kernels[pairs[i][1]].size());
+		}
+		if (live.empty()) return 0;
+		nThreads = std::max(1u, nThreads);
+
+		// One size for everything, so any signal spectrum can meet any kernel spectrum.
+		size_t N = (size_t)unda::roundUpToNextPowerOfTwo((unsigned int)(longestSignal + longestKernel - 1));
+		N = std::max<size_t>(N, 32);
+		PFFFT_Setup* fftSetup = FFTCache::getSetup(N);
+
+		// Only operands that appear in a pair are transformed. The 1/N of the inverse goes on the kernels.
+		std::vector<const Signal*> operands;
+		std::vector<float> scaling;
+		std::vector<size_t> signalSlot(signals.size(), SIZE_MAX), kernelSlot(kernels.size(), SIZE_MAX);
+		for (size_t i : live) {
+			const std::array<size_t, 2>& pair = pairs[i];
+			if (signalSlot[pair[0]] == SIZE_MAX) { signalSlot[pair[0]] = operands.size(); operands.push_back(&signals[pair[0]]); scaling.push_back(1.0f); }
+			if (kernelSlot[pair[1]] == SIZE_MAX) { kernelSlot[pair[1]] = operands.size(); operands.push_back(&kernels[pair[1]]); scaling.push_back(1.0f / (float)N); }
+		}
+		FFTBuffer spectra = FFTCache::acquire(operands.size() * N);
+
+		std::vector<std::thread> workers;
+		for (unsigned int thread = 0; thread < nThreads && thread < operands.size(); thread++) {
+			workers.push_back(std::thread([&, thread]() {
+				FFTBuffer workSpace = FFTCache::acquire(N);
+				for (size_t i = thread; i < operands.size(); i += nThreads) {
+					const Signal& operand = *operands[i];
+					float* spectrum = spectra.data() + i * N;
+					for (size_t n = 0; n < N; n++) spectrum[n] = n < operand.size() ? operand[n] * scaling[i] : 0.0f;
+					pffft_transform(fftSetup, spectrum, spectrum, workSpace.data(), pffft_direction_t::PFFFT_FORWARD);
+				}
+			}));
+		}
+		for (std::thread& worker : workers) worker.join();
+
+		workers.clear();
+		for (unsigned int thread = 0; thread < nThreads && thread < live.size(); thread++) {
+			workers.push_back(std::thread([&, thread]() {
+				FFTBuffer product = FFTCache::acquire(N), workSpace = FFTCache::acquire(N);
+				for (size_t next = thread; next < live.size(); next += nThreads) {
+					size_t i = live[next];
+					std::fill(product.begin(), product.end(), 0.0f);
+					pffft_zconvolve_accumulate(fftSetup, spectra.data() + signalSlot[pairs[i][0]] * N, spectra.data() + kernelSlot[pairs[i][1]] * N, product.data(), 1.0);
+					pffft_transform(fftSetup, product.data(), product.data(), workSpace.data(), pffft_direction_t::PFFFT_BACKWARD);
+					Signal& output = outputs[i];
+					size_t nConv = signals[pairs[i][0]].size() + kernels[pairs[i][1]].size() - 1;
+					size_t nCopy = std::min(output.size(), nConv);
+					std::copy(product.begin(), product.begin() + nCopy, output.begin());
+					std::fill(output.begin() + nCopy, output.end(), 0.0f);
+				}
+			}));
+		}
+		for (std::thread& worker : workers) worker.join();
+		return 0;
+	}
+
 
 	Signal designLPF(unsigned int M, float fc)
 	{
@@ -150,6 +192,27 @@ namespace unda {
 		return h;
 	}
 
+	simd::AlignedVector<float> DesignFractionalDelay(size_t phases, size_t taps, size_t offset)
+	{
+		// The taps reach to the window's zeros at +-taps / 2. Unit sum rows keep an arrival's area, and its
+		// level after interpolation, independent of where it falls between samples.
+		simd::AlignedVector<float> table(phases * taps, 0.0f);
+		double halfSpan = (double)taps / 2.0;
+		for (size_t phase = 0; phase < phases; phase++) {
+			float* row = &table[phase * taps];
+			double sum = 0;
+			for (size_t tap = 0; tap < taps; tap++) {
+				double x = (double)tap - (double)offset - (double)phase / (double)phases;
+				double window = 0.42 + 0.5 * cos(pi * x / halfSpan) + 0.08 * cos(2.0 * pi * x / halfSpan);
+				double value = x == 0 ? 1.0 : sin(pi * x) / (pi * x) * window;
+				row[tap] = (float)value;
+				sum += value;
+			}
+			for (size_t tap = 0; tap < taps; tap++) row[tap] = (float)(row[tap] / sum);
+		}
+		return table;
+	}
+
 
 	Signal designHPF(unsigned int M, float fc)
 	{
@@ -198,10 +261,260 @@ namespace unda {
 	}
 	void Filter::convolveToSignal(Signal& signal)
 	{
+		// Always FFT, so the output doesn't depend on the cost model.
 		Signal convolution = FFTConvolution(signal, h);
 		convolution.erase(convolution.begin(), convolution.begin() + h.size() / 2);
 		convolution.erase(convolution.begin() + signal.size() - 1, convolution.end());
 		ZeroCrossingFadeInOut(convolution);
 		signal.swap(convolution);
 	}
+
+
+	std::vector<unsigned int> BandDecimation(const std::vector<std::array<float, 2>>& bandEdges, float fs)
+	{
+		std::vector<unsigned int> decimation;
+		for (const std::array<float, 2>& edges : bandEdges) {
+			unsigned int factor = 1;
+			while (fs / (float)(2 * factor) >= 4.0f * edges[1]) factor *= 2;
+			decimation.push_back(factor);
+		}
+		return decimation;
+	}
+
+
+	std::unique_ptr<IFilterBank> createFilterBank(BandFilterType type, const std::vector<std::array<float, 2>>& bandEdges, float fs, bool multirate)
+	{
+		if (type == BandFilterType::IIR) {
+			if (multirate) {
+				UNDA_LOG_MESSAGE("Multirate bands are FIR only, the IIR crossover runs at full rate.");
+			}
+			return std::make_unique<CrossoverFilterBank>(bandEdges, fs);
+		}
+		return std::make_unique<FilterBank>(bandEdges, fs, (unsigned int)pow(2, 13), multirate);
+	}
+
+
+	FilterBank::FilterBank(const std::vector<std::array<float, 2>>& _bandEdges, float _fs, unsigned int _M, bool multirate)
+		: IFilterBank(_bandEdges, _fs)
+		, bands(_bandEdges.size())
+	{
+		UNDA_ASSERT(fs > 0);
+		if (multirate) decimation = BandDecimation(bandEdges, fs);
+		for (size_t i = 0; i < bandEdges.size(); i++) {
+			float bandFs = fs / (float)decimation[i];
+			float lower_fc = bandEdges[i][0] / bandFs, upper_fc = bandEdges[i][1] / bandFs;
+			UNDA_ASSERT(lower_fc > 0 && lower_fc < 0.5);
+			UNDA_ASSERT(upper_fc > 0 && upper_fc < 0.5);
+			bands[i].M = std::max(_M / decimation[i], 32u);
+			bands[i].kernel = designBPF(bands[i].M, lower_fc, upper_fc);
+		}
+	}
+
+	FilterBank::~FilterBank()
+	{
+		for (Band& band : bands) release(band);
+	}
+
+	void FilterBank::release(Band& band)
+	{
+		band.fftSetup = nullptr;
+		band.spectrum.reset();
+		band.scratch.reset();
+		band.N = 0;
+	}
+
+	void FilterBank::prepare(Band& band, size_t signalLength)
+	{
+		size_t nConv = signalLength + band.M - 1;
+		size_t newN = std::max<size_t>((size_t)unda::roundUpToNextPowerOfTwo((unsigned int)nConv), 32);
+		if (newN == band.N) return;
+		release(band);
+		size_t N = band.N = newN;
+		band.fftSetup = FFTCache::getSetup(N);
+		band.spectrum = FFTCache::acquire(N);
+		band.scratch = FFTCache::acquire(3 * N);
+		// Kernel spectra only change with the FFT size. The 1/N of the inverse transform is folded in here.
+		for (size_t i = 0; i < N; i++)
+			band.spectrum[i] = i < band.kernel.size() ? band.kernel[i] : 0.0f;
+		pffft_transform(band.fftSetup, band.spectrum.data(), band.spectrum.data(), band.scratch.data(), pffft_direction_t::PFFFT_FORWARD);
+		for (size_t i = 0; i < N; i++)
+			band.spectrum[i] /= (float)N;
+	}
+
+	void FilterBank::process(Signal* signals)
+	{
+		if (!workers) workers = std::make_unique<utils::WorkerPool>(std::min((unsigned int)bands.size(), std::max(std::thread::hardware_concurrency(), 1u)));
+		workers->run([this, signals](unsigned int thread, unsigned int nThreads) {
+			for (size_t band = thread; band < bands.size(); band += nThreads) processBand(bands[band], signals[band]);
+		});
+	}
+
+	void FilterBank::processBand(Band& band, Signal& signal)
+	{
+		prepare(band, signal.size());
+		size_t N = band.N;
+		float* input = band.scratch.data();
+		float* product = input + N;
+		float* workSpace = product + N;
+		for (size_t i = 0; i < N; i++) {
+			input[i] = i < signal.size() ? signal[i] : 0.0f;
+			product[i] = 0.0f;
+		}
+		pffft_transform(band.fftSetup, input, input, workSpace, pffft_direction_t::PFFFT_FORWARD);
+		pffft_zconvolve_accumulate(band.fftSetup, input, band.spectrum.data(), product, 1.0);
+		pffft_transform(band.fftSetup, product, product, workSpace, pffft_direction_t::PFFFT_BACKWARD);
+		// Same alignment as Filter::convolveToSignal: drop the kernel's group delay.
+		std::copy(product + band.M / 2, product + band.M / 2 + signal.size(), signal.begin());
+		ZeroCrossingFadeInOut(signal);
+	}
+
+
+	PolyphaseInterpolator::PolyphaseInterpolator(unsigned int _factor, unsigned int _tapsPerPhase)
+		: factor(_factor)
+		, tapsPerPhase((unsigned int)simd::roundUp(_tapsPerPhase))
+	{
+		UNDA_ASSERT(factor > 0);
+		phases.assign((size_t)factor * tapsPerPhase, 0.0f);
+		if (factor == 1) {
+			// Plain delay by the centre tap, cancelled by the alignment in process.
+			phases[tapsPerPhase - 1 - tapsPerPhase / 2] = 1.0f;
+			return;
+		}
+		// Cut off at the input Nyquist. designLPF is centred on M / 2 = factor * tapsPerPhase / 2.
+		Signal h = designLPF(factor * tapsPerPhase, 0.5f / (float)factor);
+		for (unsigned int phase = 0; phase < factor; phase++)
+			for (unsigned int tap = 0; tap < tapsPerPhase; tap++)
+				phases[(size_t)phase * tapsPerPhase + tapsPerPhase - 1 - tap] = (float)factor * h[(size_t)tap * factor + phase];
+	}
+
+	void PolyphaseInterpolator::process(const Signal& input, Signal& output, size_t outputLength) const
+	{
+		// Zero padded so every window is in range: tapsPerPhase before, and after for the delay.
+		size_t delay = (size_t)factor * tapsPerPhase / 2;
+		Signal padded((size_t)tapsPerPhase + input.size() + tapsPerPhase, 0.0f);
+		std::copy(input.begin(), input.end(), padded.begin() + tapsPerPhase);
+
+		output.resize(outputLength);
+		for (size_t n = 0; n < outputLength; n++) {
+			size_t t = n + delay, m = t / factor;
+			if (m >= input.size() + tapsPerPhase - 1) { output[n] = 0.0f; continue; }
+			// y[m * factor + p] = sum_j x[m - j] * h[j * factor + p], with the phase stored reversed.
+			const float* x = padded.data() + m + 1;
+			const float* coefficients = phases.data() + (t % factor) * tapsPerPhase;
+			simd::float4 sum = simd::zero();
+			for (unsigned int tap = 0; tap < tapsPerPhase; tap += (unsigned int)simd::width)
+				sum = simd::madd(simd::loadu(x + tap), simd::load(coefficients + tap), sum);
+			output[n] = simd::hsum(sum);
+		}
+	}
+
+
+	enum class biquadType { LPF, HPF, APF };
+
+	std::array<float, 5> designButterworthBiquad(biquadType type, float fc, float fs)
+	{
+		// --- Bristow-Johnson R. Cookbook formulae for audio EQ biquad filter coefficients ---
+		// Q = 1/sqrt(2): two LPF/HPF in series make a Linkwitz-Riley section, whose LP + HP sum is the APF.
+		UNDA_ASSERT(fc > 0 && fc < fs / 2);
+		float w0 = 2.0f * (float)pi * fc / fs;
+		float cosw0 = cosf(w0), alpha = sinf(w0) / (2.0f * 0.70710678f);
+		float a0 = 1.0f + alpha, b0, b1, b2;
+		switch (type) {
+		case biquadType::LPF: b0 = (1.0f - cosw0) / 2.0f; b1 = 1.0f - cosw0;    b2 = b0; break;
+		case biquadType::HPF: b0 = (1.0f + cosw0) / 2.0f; b1 = -(1.0f + cosw0); b2 = b0; break;
+		default:              b0 = 1.0f - alpha;          b1 = -2.0f * cosw0;   b2 = 1.0f + alpha; break;
+		}
+		return { b0 / a0, b1 / a0, b2 / a0, -2.0f * cosw0 / a0, (1.0f - alpha) / a0 };
+	}
+
+
+	CrossoverFilterBank::CrossoverFilterBank(const std::vector<std::array<float, 2>>& _bandEdges, float _fs, size_t _blockSize)
+		: IFilterBank(_bandEdges, _fs)
+		, nLanes(simd::roundUp(_bandEdges.size()))
+		, nStages(0)
+		, blockSize(_blockSize)
+	{
+		UNDA_ASSERT(fs > 0);
+		size_t nBands = bandEdges.size();
+		std::vector<std::vector<std::array<float, 5>>> sections(nBands);
+		for (size_t band = 0; band < nBands; band++) {
+			std::vector<std::array<float, 5>>& stages = sections[band];
+			auto linkwitzRiley = [&](biquadType type, float fc) { stages.push_back(designButterworthBiquad(type, fc, fs)); stages.push_back(stages.back()); };
+			if (band == 0) linkwitzRiley(biquadType::HPF, bandEdges[0][0]);
+			for (size_t crossover = 1; crossover <= band; crossover++)
+				linkwitzRiley(biquadType::HPF, bandEdges[crossover][0]);
+			linkwitzRiley(biquadType::LPF, bandEdges[band][1]);
+			for (size_t crossover = band + 2; crossover < nBands; crossover++)
+				stages.push_back(designButterworthBiquad(biquadType::APF, bandEdges[crossover][0], fs));
+			nStages = std::max(nStages, stages.size());
+		}
+
+		coefficients.assign(nStages * 5 * nLanes, 0.0f);
+		state.assign(nStages * 2 * nLanes, 0.0f);
+		block.assign(blockSize * nLanes, 0.0f);
+		for (size_t lane = 0; lane < nLanes; lane++) {
+			for (size_t stage = 0; stage < nStages; stage++) {
+				std::array<float, 5> biquad = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f }; // Padding stages and lanes pass through
+				if (lane < nBands && stage < sections[lane].size())
+					biquad = sections[lane][stage];
+				for (size_t c = 0; c < 5; c++)
+					coefficients[(stage * 5 + c) * nLanes + lane] = biquad[c];
+			}
+		}
+	}
+
+	void CrossoverFilterBank::reset()
+	{
+		std::fill(state.begin(), state.end(), 0.0f);
+	}
+
+	void CrossoverFilterBank::process(Signal* bands)
+	{
+		size_t length = bands[0].size();
+		std::vector<float*> channels;
+		for (size_t band = 0; band < bandEdges.size(); band++) {
+			UNDA_ASSERT(bands[band].size() == length);
+			channels.push_back(bands[band].data());
+		}
+		reset();
+		process(channels.data(), channels.data(), length);
+	}
+
+	void CrossoverFilterBank::process(const float* const* input, float* const* output, size_t nFrames)
+	{
+		simd::DenormalGuard denormals;
+		size_t nBands = bandEdges.size();
+		for (size_t offset = 0; offset < nFrames; offset += blockSize) {
+			size_t n = std::min(blockSize, nFrames - offset);
+			// Interleave so that one register holds the same sample of 4 bands.
+			for (size_t i = 0; i < n; i++)
+				for (size_t band = 0; band < nBands; band++)
+					block[i * nLanes + band] = input[band][offset + i];
+
+			for (size_t stage = 0; stage < nStages; stage++) {
+				const float* c = coefficients.data() + stage * 5 * nLanes;
+				float* z = state.data() + stage * 2 * nLanes;
+				for (size_t lane = 0; lane < nLanes; lane += simd::width) {
+					simd::float4 b0 = simd::load(c + lane), b1 = simd::load(c + nLanes + lane), b2 = simd::load(c + 2 * nLanes + lane);
+					simd::float4 a1 = simd::load(c + 3 * nLanes + lane), a2 = simd::load(c + 4 * nLanes + lane);
+					simd::float4 z1 = simd::load(z + lane), z2 = simd::load(z + nLanes + lane);
+					for (size_t i = 0; i < n; i++) {
+						// Transposed direct form II
+						float* samples = block.data() + i * nLanes + lane;
+						simd::float4 x = simd::load(samples);
+						simd::float4 y = simd::madd(b0, x, z1);
+						z1 = simd::sub(simd::madd(b1, x, z2), simd::mul(a1, y));
+						z2 = simd::sub(simd::mul(b2, x), simd::mul(a2, y));
+						simd::store(samples, y);
+					}
+					simd::store(z + lane, z1);
+					simd::store(z + nLanes + lane, z2);
+				}
+			}
+
+			for (size_t i = 0; i < n; i++)
+				for (size_t band = 0; band < nBands; band++)
+					output[band][offset + i] = block[i * nLanes + band];
+		}
+	}
 }
\ No newline at end of file
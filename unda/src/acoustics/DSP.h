@@ -3,10 +3,16 @@
 #include "../utils/Settings.h"
 #include "../utils/Utils.h"
 #include "../utils/Maths.h"
-#include <sndfile.h>
+#include "../utils/SIMD.h"
+#include "../utils/WorkerPool.h"
+#include "FFTCache.h"
+#include "AudioFile.h"
 #include <vector>
 #include <pffft.h>
 #include <string>
+#include <array>
+#include <thread>
+#include <memory>
 
 
 namespace unda {
@@ -15,10 +21,14 @@ namespace unda {
 
 	void NormaliseSignal(Signal& audioSamples, Sample scaling = 0.9);
 	Signal NormaliseSignal(const Signal& audioSamples, Sample scaling = 0.9);
-	int WriteAudioFile(const std::vector<Signal>& audioChannels, const std::string& filePath, double samplingFrequency = unda::sampleRate);
+	// fileSampleRate, if given and different, converts on the way out.
+	int WriteAudioFile(const std::vector<Signal>& audioChannels, const std::string& filePath, double samplingFrequency = unda::sampleRate,
+					   AudioSampleFormat format = AudioSampleFormat::PCM16, double fileSampleRate = 0);
+	// Mixed down, normalised and converted to unda::sampleRate.
 	Signal ReadAudioFileIntoMono(const std::string& filePath);
 	void ZeroCrossingFadeInOut(Signal& signal);
 
+	// Reference implementations. Convolve (Convolution.h) picks the fastest algorithm for the lengths.
 	template<typename T>
 	std::vector<T> TimeDomainConvolution(std::vector<T> const& f, std::vector<T> const& g) {
 		// For plebs and 'slow' people like me.
@@ -36,6 +46,17 @@ namespace unda {
 		return out;
 	}
 	Signal FFTConvolution(const Signal& signal, const Signal& kernel);
+	// Blackman windowed-sinc low-pass of M taps centred on M / 2, fc as a fraction of the sampling rate.
+	Signal designLPF(unsigned int M, float fc);
+	// Fractional delay table of phases rows x taps: row p holds a unit impulse at offset + p / phases, as
+	// Blackman windowed sinc over the whole row, normalised to unit sum.
+	simd::AlignedVector<float> DesignFractionalDelay(size_t phases, size_t taps, size_t offset);
+	// Many stems against many IRs: outputs[i] = signals[pairs[i][0]] * kernels[pairs[i][1]].
+	// Every operand is transformed once at a common FFT size, and the products and inverse transforms of
+	// the pairs are shared between nThreads. outputs must hold pairs.size() preallocated channels; each
+	// gets as much of its convolution as fits and is zeroed past it. Returns -1 on a bad pair or layout.
+	int BatchFFTConvolution(const std::vector<Signal>& signals, const std::vector<Signal>& kernels, const std::vector<std::array<size_t, 2>>& pairs,
+							std::vector<Signal>& outputs, unsigned int nThreads = std::thread::hardware_concurrency());
 
 
 	class Filter {
@@ -58,4 +79,123 @@ namespace unda {
 
 		DISABLE_COPY_ASSIGN(Filter);
 	};
+
+
+	enum class BandFilterType { FIR, IIR };
+
+	// Largest power of two decimation per band that keeps the band's upper edge at or below a quarter
+	// of the decimated rate, leaving an octave of transition band for the interpolator.
+	std::vector<unsigned int> BandDecimation(const std::vector<std::array<float, 2>>& bandEdges, float fs);
+
+	// Band-limits several signals with fixed band edges: bands[i] is filtered in place by band i.
+	// Band i runs at fs / getDecimation(i) and its signal length is expected at that rate.
+	class IFilterBank {
+	public:
+		virtual ~IFilterBank() = default;
+
+		size_t getBandCount() const { return bandEdges.size(); }
+		unsigned int getDecimation(size_t band) const { return decimation[band]; }
+		// Impulse response length of a band at its rate, 0 if it doesn't end (IIR).
+		virtual size_t getResponseLength(size_t band) const = 0;
+		virtual void process(Signal* bands) = 0;
+		template<size_t N> void process(std::array<Signal, N>& bands) { UNDA_ASSERT(N == bandEdges.size()); process(bands.data()); }
+
+	protected:
+		IFilterBank(const std::vector<std::array<float, 2>>& _bandEdges, float _fs) : bandEdges(_bandEdges), fs(_fs), decimation(_bandEdges.size(), 1) {}
+		std::vector<std::array<float, 2>> bandEdges;
+		float fs;
+		std::vector<unsigned int> decimation;
+	};
+	// multirate only applies to FIR banks, the IIR crossover always runs at fs.
+	std::unique_ptr<IFilterBank> createFilterBank(BandFilterType type, const std::vector<std::array<float, 2>>& bandEdges, float fs = (float)unda::sampleRate, bool multirate = false);
+
+
+	// Linear-phase windowed-sinc band-pass filterbank.
+	// Kernels are designed once and kept as spectra for the FFT size of the current signal length,
+	// so filtering costs one forward and one backward transform per band, and no kernel transforms.
+	// When multirate, band i is designed at fs / decimation[i] with M / decimation[i] taps (same
+	// resolution in Hz), so the low bands use a fraction of the samples and FFT size of the top band.
+	class FilterBank : public IFilterBank {
+	public:
+		FilterBank(const std::vector<std::array<float, 2>>& _bandEdges, float _fs = (float)unda::sampleRate, unsigned int _M = (unsigned int)pow(2, 13), bool multirate = false);
+		~FilterBank();
+
+		size_t getResponseLength(size_t band) const override { return bands[band].M; }
+		// All bands in parallel.
+		void process(Signal* bands) override;
+		using IFilterBank::process;
+
+	private:
+		struct Band {
+			unsigned int M = 0;
+			Signal kernel;
+			// Frequency domain state for the current FFT size
+			size_t N = 0;
+			PFFFT_Setup* fftSetup = nullptr;	// shared, from FFTCache
+			FFTBuffer spectrum;				// N, pre-scaled by 1/N
+			FFTBuffer scratch;				// input, product, work
+		};
+		std::vector<Band> bands;
+		std::unique_ptr<utils::WorkerPool> workers;	// started on the first process
+
+		void prepare(Band& band, size_t signalLength);
+		void processBand(Band& band, Signal& signal);
+		void release(Band& band);
+
+		DISABLE_COPY_ASSIGN(FilterBank);
+	};
+
+
+	// Integer factor upsampler. The prototype is a Blackman windowed-sinc low-pass at the input Nyquist
+	// with tapsPerPhase * factor taps, split into factor phases, so every output sample costs
+	// tapsPerPhase multiply-adds. Its group delay is removed: output[n] lines up with input[n / factor].
+	class PolyphaseInterpolator {
+	public:
+		PolyphaseInterpolator(unsigned int _factor, unsigned int _tapsPerPhase = 16);
+		~PolyphaseInterpolator() = default;
+
+		unsigned int getFactor() const { return factor; }
+		// Fills outputLength samples at factor times the input rate.
+		void process(const Signal& input, Signal& output, size_t outputLength) const;
+
+	private:
+		unsigned int factor, tapsPerPhase;
+		simd::AlignedVector<float> phases;		// factor x tapsPerPhase, time reversed, gain of factor folded in
+
+		DISABLE_COPY_ASSIGN(PolyphaseInterpolator);
+	};
+
+
+	// Minimum-phase IIR alternative to FilterBank, built as a 4th order Linkwitz-Riley crossover tree
+	// at the inner band edges: band b gets the tree's high-passes below it, a low-pass at its upper edge
+	// and an allpass for every crossover above that, so the bands sum to an allpass (flat magnitude).
+	// The outer edges are 4th order high/low-passes on the first/last band.
+	// Cost is O(samples) per band, with the biquads of all bands run side by side in SIMD lanes, against
+	// an 8192-tap FFT convolution per band for FilterBank. The price is phase. FilterBank is linear-phase
+	// with its group delay removed, so band IRs stay time-aligned with the ISM arrivals. This bank is
+	// causal with group delay growing towards low frequencies (several ms around the 125 Hz crossover),
+	// which smears low frequency onsets and shifts them later than the reflections that caused them.
+	// Fine for auralisation and tails, less so for early reflection analysis.
+	class CrossoverFilterBank : public IFilterBank {
+	public:
+		CrossoverFilterBank(const std::vector<std::array<float, 2>>& _bandEdges, float _fs = (float)unda::sampleRate, size_t _blockSize = unda::dspBlockSize);
+		~CrossoverFilterBank() = default;
+
+		size_t getResponseLength(size_t) const override { return 0; }
+		// Offline: clears the filter state and filters whole bands.
+		void process(Signal* bands) override;
+		using IFilterBank::process;
+		// Streaming: input[band] -> output[band] for nFrames, keeping state across calls. No allocation,
+		// input and output may alias.
+		void process(const float* const* input, float* const* output, size_t nFrames);
+		void reset();
+
+	private:
+		size_t nLanes, nStages, blockSize;
+		simd::AlignedVector<float> coefficients;	// nStages x (b0, b1, b2, a1, a2) x nLanes
+		simd::AlignedVector<float> state;			// nStages x (z1, z2) x nLanes
+		simd::AlignedVector<float> block;			// blockSize x nLanes, bands interleaved
+
+		DISABLE_COPY_ASSIGN(CrossoverFilterBank);
+	};
 }
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "Directivity.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+
+namespace unda {
+	namespace acoustics {
+		template<size_t N>
+		BasicSourceDirectivity<N>::BasicSourceDirectivity(const std::string& path, const std::array<double, 3>& _front, bool _interpolate, double _gridStep)
+			: interpolate(_interpolate)
+			, gridStep(std::max(_gridStep, 0.1))
+		{
+			// Front, then left = up x front with room y up, then up = front x left.
+			std::array<double, 3> front = _front;
+			double norm = sqrt(front[0] * front[0] + front[1] * front[1] + front[2] * front[2]);
+			if (norm <= 0) {
+				UNDA_ERROR("SourceDirectivity: the front direction is zero");
+				return;
+			}
+			for (double& value : front) value /= norm;
+			std::array<double, 3> left = { front[2], 0.0, -front[0] };
+			norm = sqrt(left[0] * left[0] + left[2] * left[2]);
+			if (norm < 1e-9) left = { -1.0, 0.0, 0.0 };
+			else for (double& value : left) value /= norm;
+			frame[0] = front;
+			frame[1] = left;
+			frame[2] = { front[1] * left[2] - front[2] * left[1], front[2] * left[0] - front[0] * left[2], front[0] * left[1] - front[1] * left[0] };
+
+			std::ifstream file(path);
+			if (!file.is_open()) {
+				UNDA_ERROR("SourceDirectivity: can't open " + path);
+				return;
+			}
+			std::string line;
+			size_t lineNumber = 0;
+			while (std::getline(file, line)) {
+				lineNumber++;
+				std::replace(line.begin(), line.end(), ',', ' ');
+				std::istringstream stream(line);
+				double azimuth, elevation;
+				if (!(stream >> azimuth)) continue;		// blank or a comment
+				std::array<float, N> gains;
+				bool complete = (bool)(stream >> elevation);
+				for (size_t bin = 0; bin < N && complete; bin++) {
+					double decibels;
+					complete = (bool)(stream >> decibels);
+					gains[bin] = (float)pow(10.0, decibels / 20.0);
+				}
+				if (!complete) {
+					UNDA_ERROR("SourceDirectivity: " + path + ":" + std::to_string(lineNumber) + " needs an azimuth, an elevation and " + std::to_string(N) + " band gains");
+					continue;
+				}
+				directions.push_back(DirectionFromAngles(azimuth, elevation));
+				measurements.push_back(gains);
+			}
+			if (directions.empty()) {
+				UNDA_ERROR("SourceDirectivity: no directions in " + path);
+				return;
+			}
+
+			// FNV-1a over the gains, directions and frame.
+			checksum = 14695981039346656037ull;
+			auto add = [this](const void* data, size_t size) {
+				const unsigned char* bytes = static_cast<const unsigned char*>(data);
+				for (size_t i = 0; i < size; i++) {
+					checksum ^= bytes[i];
+					checksum *= 1099511628211ull;
+				}
+			};
+			add(measurements.data(), measurements.size() * sizeof(measurements[0]));
+			add(directions.data(), directions.size() * sizeof(directions[0]));
+			add(frame.data(), sizeof(frame));
+			add(&interpolate, sizeof(interpolate));
+			add(&gridStep, sizeof(gridStep));
+
+			grid.build(directions, interpolate, gridStep);
+			buildGains();
+			UNDA_LOG_MESSAGE("SourceDirectivity: " + std::to_string(directions.size()) + " directions from " + path);
+		}
+
+		template<size_t N>
+		void BasicSourceDirectivity<N>::buildGains()
+		{
+			gains.assign(grid.getCellCount() * bandStride, 0.0f);
+			for (size_t index = 0; index < grid.getCellCount(); index++) {
+				const SphericalGrid::Cell& cell = grid.getCell(index);
+				float* cellGains = &gains[index * bandStride];
+				for (size_t rank = 0; rank < 3; rank++) {
+					if (cell.weights[rank] == 0.0f) continue;
+					for (size_t bin = 0; bin < N; bin++) cellGains[bin] += cell.weights[rank] * measurements[cell.measurements[rank]][bin];
+				}
+			}
+		}
+
+		template<size_t N>
+		const float* BasicSourceDirectivity<N>::getGains(double x, double y, double z) const
+		{
+			double local[3];
+			for (int axis = 0; axis < 3; axis++) local[axis] = frame[axis][0] * x + frame[axis][1] * y + frame[axis][2] * z;
+			return &gains[grid.getIndex(local[0], local[1], local[2]) * bandStride];
+		}
+
+		template class BasicSourceDirectivity<6>;
+		template class BasicSourceDirectivity<10>;
+		template class BasicSourceDirectivity<31>;
+	}
+}
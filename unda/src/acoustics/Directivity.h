@@ -0,0 +1,59 @@
+#pragma once
+
+#include "../utils/Settings.h"
+#include "../utils/Utils.h"
+#include "../utils/SIMD.h"
+#include "SphericalGrid.h"
+#include <string>
+#include <vector>
+#include <array>
+#include <cstdint>
+
+
+namespace unda {
+	namespace acoustics {
+
+		// Frequency dependent source directivity (a balloon) over the N bands of BandEdges<N>, from a local text
+		// table. Every line is azimuth, elevation, then N gains in dB, whitespace or comma separated, angles in
+		// degrees with azimuth anticlockwise from the front. Lines starting with # are comments.
+		// The source faces front, in room coordinates, with room y up. Directions go through a SphericalGrid of
+		// gridStep degrees, and every cell's band gains are weighted ahead, ready to multiply.
+		template<size_t N>
+		class BasicSourceDirectivity {
+		public:
+			static constexpr size_t bandStride = simd::wide::roundUp(N);
+
+			BasicSourceDirectivity(const std::string& path, const std::array<double, 3>& _front = { 0.0, 0.0, 1.0 }, bool _interpolate = true, double _gridStep = 2.0);
+			~BasicSourceDirectivity() = default;
+
+			bool isLoaded() const { return !gains.empty(); }
+			size_t getMeasurementCount() const { return directions.size(); }
+			// Covers the table and the orientation, for cache keys.
+			uint64_t getChecksum() const { return checksum; }
+
+			// Linear band gains for sound leaving the source along (x, y, z), in room coordinates, not
+			// necessarily unit length. bandStride aligned floats, zero past N.
+			const float* getGains(double x, double y, double z) const;
+
+		private:
+			bool interpolate;
+			double gridStep;
+			std::array<std::array<double, 3>, 3> frame;		// front, left and up, in room coordinates
+			uint64_t checksum = 0;
+
+			std::vector<std::array<float, 3>> directions;	// unit vectors per measurement, x front, y left, z up
+			std::vector<std::array<float, N>> measurements;	// linear gains
+			SphericalGrid grid;
+			simd::AlignedVector<float> gains;				// grid cell x bandStride
+
+			void buildGains();
+
+			DISABLE_COPY_ASSIGN(BasicSourceDirectivity)
+		};
+		typedef BasicSourceDirectivity<6> SourceDirectivity;
+
+		extern template class BasicSourceDirectivity<6>;
+		extern template class BasicSourceDirectivity<10>;
+		extern template class BasicSourceDirectivity<31>;
+	}
+}
@@ -0,0 +1,240 @@
+#include "FDTD.h"
+#include "../utils/Maths.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace unda {
+	namespace acoustics {
+
+		namespace {
+			// All of the solver's threads finish a step before any starts the next.
+			class StepBarrier {
+			public:
+				explicit StepBarrier(unsigned int _count) : count(_count) {}
+				void wait() {
+					std::unique_lock<std::mutex> lock(mutex);
+					size_t arrival = generation;
+					if (++waiting == count) {
+						waiting = 0;
+						generation++;
+						condition.notify_all();
+					}
+					else condition.wait(lock, [&]() { return generation != arrival; });
+				}
+			private:
+				std::mutex mutex;
+				std::condition_variable condition;
+				unsigned int count, waiting = 0;
+				size_t generation = 0;
+			};
+
+			// The real admittance beta of a locally reacting wall whose absorption averaged over a diffuse field,
+			// 8 beta (1 + beta - beta^2 / (1 + beta) - 2 beta ln(1 + 1 / beta)), is alpha. That peaks at 0.95 for
+			// beta = 0.638 and rises monotonically below, so it's found by bisection there.
+			double RandomIncidenceAdmittance(double alpha)
+			{
+				auto absorption = [](double beta) { return 8.0 * beta * (1.0 + beta - beta * beta / (1.0 + beta) - 2.0 * beta * std::log(1.0 + 1.0 / beta)); };
+				double low = 0.0, high = 0.638;
+				if (alpha >= absorption(high)) return high;
+				for (int i = 0; i < 40 && alpha > 0; i++) {
+					double middle = 0.5 * (low + high);
+					(absorption(middle) < alpha ? low : high) = middle;
+				}
+				return low;
+			}
+		}
+
+		template<size_t N>
+		BasicFDTDSolver<N>::BasicFDTDSolver(const BasicVoxelRoom<N>& room, const std::array<double, 3>& _sourcePosition, const std::array<double, 3>& _receiverPosition, int _nSamples,
+											double _maximumFrequency, double _pointsPerWavelength, double _samplingFrequency)
+			: nSamples(std::max(_nSamples, 1))
+			, samplingFrequency(_samplingFrequency)
+		{
+			const std::array<std::array<float, 2>, N>& edges = BandEdges<N>();
+			while (bandCount < N && edges[bandCount][1] <= _maximumFrequency * 1.001) bandCount++;
+			if (bandCount == 0) {
+				UNDA_ERROR("FDTDSolver: no band lies below " + std::to_string(_maximumFrequency) + " Hz");
+				return;
+			}
+			if (room.cells.size() != room.size[0] * room.size[1] * room.size[2] || room.cells.empty()) {
+				UNDA_ERROR("FDTDSolver: the voxel room needs a cell per grid position");
+				return;
+			}
+
+			// Courant limit, c k / h = 1 / sqrt(3), with the time step k a whole number of output samples.
+			double maximumSpacing = unda::maths::c / (_maximumFrequency * std::max(_pointsPerWavelength, 2.0));
+			decimation = std::max(1u, (unsigned int)std::floor(maximumSpacing * samplingFrequency / (unda::maths::c * std::sqrt(3.0))));
+			spacing = unda::maths::c * (double)decimation * std::sqrt(3.0) / samplingFrequency;
+
+			// Air nodes 1 to air[axis] along each axis, node i centred at (i - 1/2) h, in a halo of solid nodes.
+			std::array<size_t, 3> air;
+			for (int axis = 0; axis < 3; axis++) air[axis] = std::max<size_t>(1, (size_t)std::round(room.dimensions[axis] / spacing));
+			size = { air[0] + 2, air[1] + 2, simd::roundUp(air[2] + 2) };
+			strideY = size[2];
+			strideX = size[1] * size[2];
+			size_t nNodes = size[0] * strideX;
+
+			// The materials' coefficients are random incidence, like Sabine's.
+			std::vector<float> admittance;
+			for (const BasicMaterial<N>& surface : room.surfaces) {
+				double alpha = 0;
+				for (size_t bin = 0; bin < bandCount; bin++) alpha += surface.alphaCoefficients[bin] / (double)bandCount;
+				admittance.push_back((float)RandomIncidenceAdmittance(alpha));
+			}
+			if (admittance.empty()) admittance.push_back(0.0f);
+
+			std::vector<int> materials(nNodes, -1);
+			auto cellIndex = [&](size_t node, int axis) {
+				double position = ((double)node - 0.5) * spacing / std::max(room.dimensions[axis], 1e-6);
+				return std::min(room.size[axis] - 1, (size_t)std::max(0.0, position * (double)room.size[axis]));
+			};
+			for (size_t x = 0; x < size[0]; x++) {
+				for (size_t y = 0; y < size[1]; y++) {
+					for (size_t z = 0; z < size[2]; z++) {
+						int& material = materials[x * strideX + y * strideY + z];
+						if (x == 0 || x > air[0]) material = (int)room.faces[x == 0 ? 0 : 1];
+						else if (y == 0 || y > air[1]) material = (int)room.faces[y == 0 ? 2 : 3];
+						else if (z == 0 || z > air[2]) material = (int)room.faces[z == 0 ? 4 : 5];
+						else {
+							unsigned char cell = room.cells[(cellIndex(x, 0) * room.size[1] + cellIndex(y, 1)) * room.size[2] + cellIndex(z, 2)];
+							material = cell ? (int)cell - 1 : -1;
+						}
+						if (material >= (int)admittance.size()) material = 0;
+					}
+				}
+			}
+
+			// A node with K air neighbours and walls of admittance beta_j on the others:
+			// (1 + g) p[n + 1] = (2 - K l^2) p[n] + l^2 (sum of its air neighbours) - (1 - g) p[n - 1], g = l / 2 sum of beta_j,
+			// which is the interior update with K = 6. Solid nodes are held at zero, so every node can sum all six.
+			const double lambda = 1.0 / std::sqrt(3.0), lambdaSquared = 1.0 / 3.0;
+			const std::array<ptrdiff_t, 6> offsets = { -(ptrdiff_t)strideX, (ptrdiff_t)strideX, -(ptrdiff_t)strideY, (ptrdiff_t)strideY, -1, 1 };
+			centre.assign(nNodes, 0.0f);
+			neighbours.assign(nNodes, 0.0f);
+			previous.assign(nNodes, 0.0f);
+			size_t wallNodes = 0;
+			for (size_t x = 1; x <= air[0]; x++) {
+				for (size_t y = 1; y <= air[1]; y++) {
+					for (size_t z = 1; z <= air[2]; z++) {
+						size_t node = x * strideX + y * strideY + z;
+						if (materials[node] >= 0) continue;
+						double airNeighbours = 0, wall = 0;
+						for (ptrdiff_t offset : offsets) {
+							int material = materials[(size_t)((ptrdiff_t)node + offset)];
+							if (material < 0) airNeighbours++;
+							else wall += admittance[material];
+						}
+						double g = 0.5 * lambda * wall;
+						centre[node] = (float)((2.0 - airNeighbours * lambdaSquared) / (1.0 + g));
+						neighbours[node] = (float)(lambdaSquared / (1.0 + g));
+						previous[node] = (float)((1.0 - g) / (1.0 + g));
+						if (airNeighbours < 6) wallNodes++;
+					}
+				}
+			}
+
+			auto nearestNode = [&](const std::array<double, 3>& position) {
+				std::array<size_t, 3> index;
+				for (int axis = 0; axis < 3; axis++)
+					index[axis] = std::min(air[axis], (size_t)std::max(0.0, std::floor(position[axis] / spacing)) + 1);
+				return index[0] * strideX + index[1] * strideY + index[2];
+			};
+			sourceNode = nearestNode(_sourcePosition);
+			receiverNode = nearestNode(_receiverPosition);
+			if (materials[sourceNode] >= 0) {
+				UNDA_ERROR("FDTDSolver: the source is inside a solid cell");
+			}
+			if (materials[receiverNode] >= 0) {
+				UNDA_ERROR("FDTDSolver: the receiver is inside a solid cell");
+			}
+
+			UNDA_LOG_MESSAGE("FDTDSolver: " + std::to_string(air[0]) + " x " + std::to_string(air[1]) + " x " + std::to_string(air[2]) + " nodes, " +
+				std::to_string(wallNodes) + " on walls, h = " + std::to_string(spacing) + " m at " + std::to_string(samplingFrequency / decimation) + " Hz");
+		}
+
+		template<size_t N>
+		void BasicFDTDSolver<N>::step(const float* current, float* last, size_t xStart, size_t xEnd) const
+		{
+			// Rows are padded to the register width and start aligned, so only the z neighbours are unaligned.
+			// The halo rows round each slab are never written, and read as zero.
+			for (size_t x = xStart; x < xEnd; x++) {
+				for (size_t y = 1; y + 1 < size[1]; y++) {
+					size_t row = x * strideX + y * strideY;
+					for (size_t node = row; node < row + size[2]; node += simd::width) {
+						simd::float4 sum = simd::add(simd::add(simd::loadu(current + node - 1), simd::loadu(current + node + 1)),
+							simd::add(simd::add(simd::load(current + node - strideY), simd::load(current + node + strideY)),
+								simd::add(simd::load(current + node - strideX), simd::load(current + node + strideX))));
+						simd::float4 next = simd::madd(simd::load(neighbours.data() + node), sum, simd::mul(simd::load(centre.data() + node), simd::load(current + node)));
+						simd::store(last + node, simd::sub(next, simd::mul(simd::load(previous.data() + node), simd::load(last + node))));
+					}
+				}
+			}
+		}
+
+		template<size_t N>
+		void BasicFDTDSolver<N>::dispatchCPUThreads()
+		{
+			irs.clear();
+			if (bandCount == 0 || centre.empty()) return;
+			[[maybe_unused]] auto t1 = std::chrono::steady_clock::now();
+
+			size_t nSteps = ((size_t)nSamples + decimation - 1) / decimation;
+			std::array<simd::AlignedVector<float>, 2> pressure;
+			for (simd::AlignedVector<float>& buffer : pressure) buffer.assign(centre.size(), 0.0f);
+			// A pressure impulse of l^2 / h reaches r as 1 / (4 pi r) at the solver's rate. The image sources'
+			// unit impulses are decimation times narrower, so it's scaled down by that to meet them once interpolated.
+			pressure[0][sourceNode] = (float)(1.0 / (3.0 * spacing * (double)decimation));
+			Signal response(nSteps, 0.0f);
+			response[0] = pressure[0][receiverNode];
+
+			unsigned int nThreads = (unsigned int)std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), size[0] - 2);
+			StepBarrier barrier(nThreads);
+			std::vector<std::thread> workers;
+			for (unsigned int thread = 0; thread < nThreads; thread++) {
+				size_t xStart = 1 + (size[0] - 2) * thread / nThreads, xEnd = 1 + (size[0] - 2) * (thread + 1) / nThreads;
+				bool records = receiverNode >= xStart * strideX && receiverNode < xEnd * strideX;
+				workers.push_back(std::thread([&, xStart, xEnd, records]() {
+					simd::DenormalGuard denormals;
+					float* current = pressure[0].data(), * last = pressure[1].data();
+					for (size_t n = 1; n < nSteps; n++) {
+						step(current, last, xStart, xEnd);
+						if (records) response[n] = last[receiverNode];
+						barrier.wait();
+						std::swap(current, last);
+					}
+				}));
+			}
+			for (std::thread& th : workers) th.join();
+
+			// The walls act on dp / dt, so the scheme has a constant pressure mode they don't damp, which the impulse
+			// excites and the ISM doesn't have. A DC blocker two octaves below the lowest band removes it, as the band
+			// filters would otherwise ring on the step it leaves at the end of the IR.
+			const std::array<std::array<float, 2>, N>& edges = BandEdges<N>();
+			double pole = std::exp(-2.0 * unda::maths::pi * 0.25 * edges[0][0] * (double)decimation / samplingFrequency), input = 0, blocked = 0;
+			for (Sample& sample : response) {
+				blocked = (double)sample - input + pole * blocked;
+				input = (double)sample;
+				sample = (Sample)blocked;
+			}
+
+			Signal full;
+			if (decimation > 1) PolyphaseInterpolator(decimation).process(response, full, (size_t)nSamples);
+			else full = response;
+			full.resize((size_t)nSamples, 0.0f);
+			irs.assign(bandCount, full);
+			createFilterBank(BandFilterType::FIR, std::vector<std::array<float, 2>>(edges.begin(), edges.begin() + bandCount), (float)samplingFrequency)->process(irs.data());
+
+			[[maybe_unused]] auto t2 = std::chrono::steady_clock::now();
+			UNDA_LOG_MESSAGE("FDTDSolver: " + std::to_string(nSteps) + " steps on " + std::to_string(nThreads) + " threads in " +
+				std::to_string(std::chrono::duration<double, std::milli>(t2 - t1).count()) + " ms");
+		}
+
+		template class BasicFDTDSolver<6>;
+		template class BasicFDTDSolver<10>;
+		template class BasicFDTDSolver<31>;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Acoustics.h"
+#include "DSP.h"
+#include "Geometry.h"
+#include "../utils/Settings.h"
+#include "../utils/Utils.h"
+#include "../utils/SIMD.h"
+#include <vector>
+#include <array>
+
+
+namespace unda {
+	namespace acoustics {
+
+		// Finite-difference time-domain solver for the bands of BandEdges<N> wholly below maximumFrequency, on the
+		// standard rectilinear scheme with locally reacting walls. The receiver's response is split into those bands.
+		template<size_t N>
+		class BasicFDTDSolver {
+		public:
+			static constexpr size_t nBands = N;
+
+			BasicFDTDSolver(const BasicVoxelRoom<N>& room, const std::array<double, 3>& _sourcePosition, const std::array<double, 3>& _receiverPosition, int _nSamples,
+							double _maximumFrequency = 250.0, double _pointsPerWavelength = 10.0, double _samplingFrequency = unda::sampleRate);
+			~BasicFDTDSolver() = default;
+
+			void dispatchCPUThreads();
+			// Band IRs 0 to getBandCount() - 1, at samplingFrequency. Empty until dispatched.
+			const std::vector<Signal>& getIRs() const { return irs; }
+			size_t getBandCount() const { return bandCount; }
+			// Nodes along x, y and z, halo and padding included.
+			const std::array<size_t, 3>& getGridSize() const { return size; }
+			double getGridSpacing() const { return spacing; }
+			// The solver runs at samplingFrequency / decimation.
+			unsigned int getDecimation() const { return decimation; }
+
+		private:
+			std::array<size_t, 3> size{};
+			size_t strideX = 0, strideY = 0;
+			double spacing = 0;
+			unsigned int decimation = 1;
+			size_t sourceNode = 0, receiverNode = 0;
+			int nSamples;
+			double samplingFrequency;
+			size_t bandCount = 0;
+
+			// p[n + 1] = centre * p[n] + neighbours * (sum of the six neighbours) - previous * p[n - 1]
+			simd::AlignedVector<float> centre, neighbours, previous;
+
+			std::vector<Signal> irs;
+
+			// Slab [xStart, xEnd) of one step, reading current and writing next over last.
+			void step(const float* current, float* last, size_t xStart, size_t xEnd) const;
+
+			DISABLE_COPY_ASSIGN(BasicFDTDSolver)
+		};
+		typedef BasicFDTDSolver<6> FDTDSolver;
+
+		extern template class BasicFDTDSolver<6>;
+		extern template class BasicFDTDSolver<10>;
+		extern template class BasicFDTDSolver<31>;
+	}
+}
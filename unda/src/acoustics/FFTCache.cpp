@@ -0,0 +1,96 @@
+#include "FFTCache.h"
+#include <new>
+#include <stdexcept>
+
+namespace unda {
+	FFTBuffer& FFTBuffer::operator=(FFTBuffer&& other) noexcept
+	{
+		if (this != &other) {
+			reset();
+			buffer = other.buffer;
+			length = other.length;
+			other.buffer = nullptr;
+			other.length = 0;
+		}
+		return *this;
+	}
+
+	void FFTBuffer::reset()
+	{
+		if (buffer) FFTCache::instance().release(buffer, length);
+		buffer = nullptr;
+		length = 0;
+	}
+
+
+	FFTCache& FFTCache::instance()
+	{
+		static FFTCache cache;
+		return cache;
+	}
+
+	FFTCache::~FFTCache()
+	{
+		for (std::pair<const std::pair<size_t, int>, PFFFT_Setup*>& setup : setups) pffft_destroy_setup(setup.second);
+		clearPool();
+	}
+
+	PFFFT_Setup* FFTCache::getSetup(size_t N, pffft_transform_t type)
+	{
+		FFTCache& cache = instance();
+		std::lock_guard<std::mutex> lock(cache.mutex);
+		std::pair<size_t, int> key = { N, (int)type };
+		std::map<std::pair<size_t, int>, PFFFT_Setup*>::iterator found = cache.setups.find(key);
+		if (found != cache.setups.end()) return found->second;
+		PFFFT_Setup* setup = pffft_new_setup((int)N, type);
+		UNDA_ASSERT(setup);
+		if (!setup) throw std::invalid_argument("FFTCache: PFFFT does not support a transform of size " + std::to_string(N));
+		cache.setups[key] = setup;
+		return setup;
+	}
+
+	FFTBuffer FFTCache::acquire(size_t nFloats)
+	{
+		FFTCache& cache = instance();
+		{
+			std::lock_guard<std::mutex> lock(cache.mutex);
+			std::unordered_map<size_t, std::vector<float*>>::iterator free = cache.pool.find(nFloats);
+			if (free != cache.pool.end() && !free->second.empty()) {
+				float* buffer = free->second.back();
+				free->second.pop_back();
+				cache.pooledBytes -= nFloats * sizeof(float);
+				return FFTBuffer(buffer, nFloats);
+			}
+		}
+		float* buffer = (float*)pffft_aligned_malloc(nFloats * sizeof(float));
+		if (!buffer) throw std::bad_alloc();
+		return FFTBuffer(buffer, nFloats);
+	}
+
+	void FFTCache::release(float* buffer, size_t length)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (pooledBytes + length * sizeof(float) <= poolBudgetBytes) {
+				pool[length].push_back(buffer);
+				pooledBytes += length * sizeof(float);
+				return;
+			}
+		}
+		pffft_aligned_free(buffer);
+	}
+
+	void FFTCache::trim()
+	{
+		instance().clearPool();
+	}
+
+	void FFTCache::clearPool()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (std::pair<const size_t, std::vector<float*>>& free : pool)
+			for (float* buffer : free.second) pffft_aligned_free(buffer);
+		pool.clear();
+		pooledBytes = 0;
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "../utils/Utils.h"
+#include <pffft.h>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <utility>
+
+
+namespace unda {
+
+	// pffft_aligned_malloc'd floats on loan from the FFTCache pool, handed back when destroyed.
+	// Contents are undefined on acquire.
+	class FFTBuffer {
+	public:
+		FFTBuffer() = default;
+		FFTBuffer(FFTBuffer&& other) noexcept : buffer(other.buffer), length(other.length) { other.buffer = nullptr; other.length = 0; }
+		FFTBuffer& operator=(FFTBuffer&& other) noexcept;
+		~FFTBuffer() { reset(); }
+
+		void reset();
+		float* data() const { return buffer; }
+		size_t size() const { return length; }
+		float& operator[](size_t i) { return buffer[i]; }
+		const float& operator[](size_t i) const { return buffer[i]; }
+		float* begin() const { return buffer; }
+		float* end() const { return buffer + length; }
+
+	private:
+		friend class FFTCache;
+		FFTBuffer(float* _buffer, size_t _length) : buffer(_buffer), length(_length) {}
+		float* buffer = nullptr;
+		size_t length = 0;
+
+		DISABLE_COPY_ASSIGN(FFTBuffer)
+	};
+
+
+	// Process-wide PFFFT setups and work buffers.
+	// A setup is read-only once made and pffft_transform only writes to the buffers it is passed, so
+	// one setup per size and transform type is shared by every thread and lives until exit. Released
+	// buffers are kept per size for the next acquire, up to poolBudgetBytes in total.
+	class FFTCache {
+	public:
+		static constexpr size_t poolBudgetBytes = 256 * 1024 * 1024;
+
+		// N must suit pffft: a multiple of 32 for real transforms, 16 for complex, with no prime factors
+		// other than 2, 3 and 5. Throws std::invalid_argument otherwise, never returns null.
+		static PFFFT_Setup* getSetup(size_t N, pffft_transform_t type = pffft_transform_t::PFFFT_REAL);
+		// Throws std::bad_alloc if the allocation fails.
+		static FFTBuffer acquire(size_t nFloats);
+		// Frees pooled buffers, buffers still on loan are unaffected.
+		static void trim();
+
+	private:
+		FFTCache() = default;
+		~FFTCache();
+		static FFTCache& instance();
+
+		void release(float* buffer, size_t length);
+		void clearPool();
+
+		std::mutex mutex;
+		std::map<std::pair<size_t, int>, PFFFT_Setup*> setups;
+		std::unordered_map<size_t, std::vector<float*>> pool;
+		size_t pooledBytes = 0;
+
+		friend class FFTBuffer;
+		DISABLE_COPY_ASSIGN(FFTCache)
+	};
+}
@@ -0,0 +1,372 @@
+#include "Geometry.h"
+#include <algorithm>
+#include <cfloat>
+
+namespace unda {
+	namespace acoustics {
+		TriangleBVH::TriangleBVH(const std::vector<Vector3>& vertices)
+		{
+			size_t nTriangles = vertices.size() / 3;
+			std::vector<BuildTriangle> triangles(nTriangles);
+			normals.resize(nTriangles);
+			for (size_t t = 0; t < nTriangles; t++) {
+				const Vector3& a = vertices[3 * t], & b = vertices[3 * t + 1], & c = vertices[3 * t + 2];
+				BuildTriangle& triangle = triangles[t];
+				for (int axis = 0; axis < 3; axis++) {
+					triangle.min[axis] = std::min(a[axis], std::min(b[axis], c[axis]));
+					triangle.max[axis] = std::max(a[axis], std::max(b[axis], c[axis]));
+					triangle.centroid[axis] = (a[axis] + b[axis] + c[axis]) / 3.0f;
+				}
+				triangle.index = (int)t;
+				normals[t] = Normalise(Cross(Subtract(b, a), Subtract(c, a)));
+			}
+			nodes.reserve(nTriangles / 2 + 1);
+			packs.reserve(nTriangles / 2 + 1);
+			buildNode(triangles, 0, nTriangles, vertices);
+		}
+
+		int TriangleBVH::buildLeaf(const std::vector<BuildTriangle>& triangles, size_t begin, size_t end, const std::vector<Vector3>& vertices)
+		{
+			TrianglePack pack{};
+			for (size_t lane = 0; lane < simd::width; lane++) {
+				pack.triangles[lane] = -1;
+				if (begin + lane >= end) continue;
+				int t = triangles[begin + lane].index;
+				const Vector3& a = vertices[3 * t], & b = vertices[3 * t + 1], & c = vertices[3 * t + 2];
+				for (int axis = 0; axis < 3; axis++) {
+					pack.v0[axis][lane] = a[axis];
+					pack.e1[axis][lane] = b[axis] - a[axis];
+					pack.e2[axis][lane] = c[axis] - a[axis];
+				}
+				pack.triangles[lane] = t;
+			}
+			packs.push_back(pack);
+			return ~(int)(packs.size() - 1);
+		}
+
+		int TriangleBVH::buildNode(std::vector<BuildTriangle>& triangles, size_t begin, size_t end, const std::vector<Vector3>& vertices)
+		{
+			// Two levels of binary splits make the four children, a range that already fits a pack isn't split further.
+			std::array<size_t, simd::width + 1> ranges;
+			size_t nRanges = 0;
+			ranges[nRanges++] = begin;
+			if (end - begin > simd::width) {
+				size_t middle = split(triangles, begin, end);
+				for (auto half : { std::make_pair(begin, middle), std::make_pair(middle, end) }) {
+					if (half.second - half.first > simd::width) ranges[nRanges++] = split(triangles, half.first, half.second);
+					ranges[nRanges++] = half.second;
+				}
+			}
+			else ranges[nRanges++] = end;
+
+			int index = (int)nodes.size();
+			nodes.emplace_back();
+			// Unused lanes get an empty box out at FLT_MAX, which no ray enters before tMax. An inverted box
+			// wouldn't do: its slab distances come out at opposite infinities and overlap.
+			for (size_t lane = 0; lane < simd::width; lane++) {
+				for (int i = 0; i < 6; i++) nodes[index].bounds[i][lane] = FLT_MAX;
+				nodes[index].children[lane] = 0;
+			}
+			for (size_t child = 0; child + 1 < nRanges; child++) {
+				size_t first = ranges[child], last = ranges[child + 1];
+				float bounds[6] = { FLT_MAX, FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+				for (size_t t = first; t < last; t++) {
+					for (int axis = 0; axis < 3; axis++) {
+						bounds[axis] = std::min(bounds[axis], triangles[t].min[axis]);
+						bounds[axis + 3] = std::max(bounds[axis + 3], triangles[t].max[axis]);
+					}
+				}
+				int reference = last - first > simd::width ? buildNode(triangles, first, last, vertices) : buildLeaf(triangles, first, last, vertices);
+				// nodes may have grown under the recursion.
+				for (int i = 0; i < 6; i++) nodes[index].bounds[i][child] = bounds[i];
+				nodes[index].children[child] = reference;
+			}
+			return index;
+		}
+
+		size_t TriangleBVH::split(std::vector<BuildTriangle>& triangles, size_t begin, size_t end) const
+		{
+			// Binned surface area heuristic over the widest axis of the centroids, the median where that fails.
+			constexpr size_t nBins = 16;
+			Vector3 low = { FLT_MAX, FLT_MAX, FLT_MAX }, high = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			for (size_t t = begin; t < end; t++) {
+				for (int axis = 0; axis < 3; axis++) {
+					low[axis] = std::min(low[axis], triangles[t].centroid[axis]);
+					high[axis] = std::max(high[axis], triangles[t].centroid[axis]);
+				}
+			}
+			int axis = 0;
+			for (int a = 1; a < 3; a++) if (high[a] - low[a] > high[axis] - low[axis]) axis = a;
+			size_t middle = begin + (end - begin) / 2;
+			auto byCentroid = [axis](const BuildTriangle& a, const BuildTriangle& b) { return a.centroid[axis] < b.centroid[axis]; };
+			float extent = high[axis] - low[axis];
+			if (extent <= 0) {
+				std::nth_element(triangles.begin() + begin, triangles.begin() + middle, triangles.begin() + end, byCentroid);
+				return middle;
+			}
+
+			struct Bin {
+				size_t count = 0;
+				Vector3 min = { FLT_MAX, FLT_MAX, FLT_MAX }, max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			};
+			std::array<Bin, nBins> bins;
+			float binScale = (float)nBins / extent;
+			auto binOf = [&](const BuildTriangle& triangle) { return std::min(nBins - 1, (size_t)((triangle.centroid[axis] - low[axis]) * binScale)); };
+			for (size_t t = begin; t < end; t++) {
+				Bin& bin = bins[binOf(triangles[t])];
+				bin.count++;
+				for (int a = 0; a < 3; a++) {
+					bin.min[a] = std::min(bin.min[a], triangles[t].min[a]);
+					bin.max[a] = std::max(bin.max[a], triangles[t].max[a]);
+				}
+			}
+			auto area = [](const Vector3& min, const Vector3& max) {
+				Vector3 size = Subtract(max, min);
+				return size[0] < 0 ? 0.0f : size[0] * size[1] + size[1] * size[2] + size[2] * size[0];
+			};
+			// Costs of splitting after bin i, from prefix and suffix sweeps.
+			std::array<float, nBins> leftCost{};
+			Bin sweep;
+			for (size_t i = 0; i + 1 < nBins; i++) {
+				sweep.count += bins[i].count;
+				for (int a = 0; a < 3; a++) {
+					sweep.min[a] = std::min(sweep.min[a], bins[i].min[a]);
+					sweep.max[a] = std::max(sweep.max[a], bins[i].max[a]);
+				}
+				leftCost[i] = area(sweep.min, sweep.max) * (float)sweep.count;
+			}
+			sweep = Bin();
+			float bestCost = FLT_MAX;
+			size_t bestBin = nBins;
+			for (size_t i = nBins - 1; i > 0; i--) {
+				sweep.count += bins[i].count;
+				for (int a = 0; a < 3; a++) {
+					sweep.min[a] = std::min(sweep.min[a], bins[i].min[a]);
+					sweep.max[a] = std::max(sweep.max[a], bins[i].max[a]);
+				}
+				float cost = leftCost[i - 1] + area(sweep.min, sweep.max) * (float)sweep.count;
+				if (sweep.count < end - begin && sweep.count > 0 && cost < bestCost) {
+					bestCost = cost;
+					bestBin = i;
+				}
+			}
+			if (bestBin < nBins) {
+				auto first = std::partition(triangles.begin() + begin, triangles.begin() + end, [&](const BuildTriangle& triangle) { return binOf(triangle) < bestBin; });
+				size_t boundary = (size_t)(first - triangles.begin());
+				if (boundary > begin && boundary < end) return boundary;
+			}
+			std::nth_element(triangles.begin() + begin, triangles.begin() + middle, triangles.begin() + end, byCentroid);
+			return middle;
+		}
+
+		template<bool anyHit>
+		bool TriangleBVH::traverse(const Vector3& origin, const Vector3& direction, float tMin, float tMax, RayHit& hit) const
+		{
+			if (nodes.empty()) return false;
+			simd::float4 o[3], d[3], inverse[3];
+			for (int axis = 0; axis < 3; axis++) {
+				o[axis] = simd::set(origin[axis]);
+				d[axis] = simd::set(direction[axis]);
+				// A zero component would make 0 * inf slab distances.
+				float component = std::abs(direction[axis]) > 1e-30f ? direction[axis] : 1e-30f;
+				inverse[axis] = simd::set(1.0f / component);
+			}
+			simd::float4 nearLimit = simd::set(tMin), zero = simd::zero(), one = simd::set(1.0f), tiny = simd::set(1e-20f);
+			float best = tMax;
+			bool found = false;
+
+			// Nearest first: children are pushed farthest first, with their entry distance to skip them once beaten.
+			constexpr size_t stackSize = 256;
+			int stack[stackSize];
+			float stackNear[stackSize];
+			size_t top = 0;
+			stack[top] = 0;
+			stackNear[top++] = tMin;
+			while (top > 0) {
+				top--;
+				int reference = stack[top];
+				if (stackNear[top] > best) continue;
+				if (reference < 0) {
+					const TrianglePack& pack = packs[~reference];
+					simd::float4 e1[3], e2[3], s[3];
+					for (int axis = 0; axis < 3; axis++) {
+						e1[axis] = simd::load(pack.e1[axis]);
+						e2[axis] = simd::load(pack.e2[axis]);
+						s[axis] = simd::sub(o[axis], simd::load(pack.v0[axis]));
+					}
+					simd::float4 p[3] = {
+						simd::sub(simd::mul(d[1], e2[2]), simd::mul(d[2], e2[1])),
+						simd::sub(simd::mul(d[2], e2[0]), simd::mul(d[0], e2[2])),
+						simd::sub(simd::mul(d[0], e2[1]), simd::mul(d[1], e2[0])) };
+					simd::float4 q[3] = {
+						simd::sub(simd::mul(s[1], e1[2]), simd::mul(s[2], e1[1])),
+						simd::sub(simd::mul(s[2], e1[0]), simd::mul(s[0], e1[2])),
+						simd::sub(simd::mul(s[0], e1[1]), simd::mul(s[1], e1[0])) };
+					simd::float4 determinant = simd::madd(e1[0], p[0], simd::madd(e1[1], p[1], simd::mul(e1[2], p[2])));
+					simd::float4 inverseDeterminant = simd::div(one, determinant);
+					simd::float4 u = simd::mul(simd::madd(s[0], p[0], simd::madd(s[1], p[1], simd::mul(s[2], p[2]))), inverseDeterminant);
+					simd::float4 v = simd::mul(simd::madd(d[0], q[0], simd::madd(d[1], q[1], simd::mul(d[2], q[2]))), inverseDeterminant);
+					simd::float4 t = simd::mul(simd::madd(e2[0], q[0], simd::madd(e2[1], q[1], simd::mul(e2[2], q[2]))), inverseDeterminant);
+					simd::float4 mask = simd::bitAnd(simd::lessThan(tiny, simd::mul(determinant, determinant)), simd::lessEqual(zero, u));
+					mask = simd::bitAnd(mask, simd::bitAnd(simd::lessEqual(zero, v), simd::lessEqual(simd::add(u, v), one)));
+					mask = simd::bitAnd(mask, simd::bitAnd(simd::lessThan(nearLimit, t), simd::lessThan(t, simd::set(best))));
+					int bits = simd::movemask(mask);
+					if (!bits) continue;
+					if (anyHit) return true;
+					alignas(simd::alignment) float distances[simd::width];
+					simd::store(distances, t);
+					for (size_t lane = 0; lane < simd::width; lane++) {
+						if (!(bits & (1 << lane)) || distances[lane] >= best) continue;
+						best = distances[lane];
+						hit.distance = best;
+						hit.triangle = pack.triangles[lane];
+						found = true;
+					}
+					continue;
+				}
+
+				const Node& node = nodes[reference];
+				simd::float4 entry = nearLimit, exit = simd::set(best);
+				for (int axis = 0; axis < 3; axis++) {
+					simd::float4 t0 = simd::mul(simd::sub(simd::load(node.bounds[axis]), o[axis]), inverse[axis]);
+					simd::float4 t1 = simd::mul(simd::sub(simd::load(node.bounds[axis + 3]), o[axis]), inverse[axis]);
+					entry = simd::max(entry, simd::min(t0, t1));
+					exit = simd::min(exit, simd::max(t0, t1));
+				}
+				int bits = simd::movemask(simd::lessEqual(entry, exit));
+				if (!bits) continue;
+				alignas(simd::alignment) float entries[simd::width];
+				simd::store(entries, entry);
+				// Insertion sort of at most four by entry distance, descending, onto the stack.
+				size_t first = top;
+				for (size_t lane = 0; lane < simd::width; lane++) {
+					if (!(bits & (1 << lane))) continue;
+					UNDA_ASSERT(top < stackSize);
+					size_t i = top++;
+					while (i > first && stackNear[i - 1] < entries[lane]) {
+						stack[i] = stack[i - 1];
+						stackNear[i] = stackNear[i - 1];
+						i--;
+					}
+					stack[i] = node.children[lane];
+					stackNear[i] = entries[lane];
+				}
+			}
+			return found;
+		}
+
+		bool TriangleBVH::intersect(const Vector3& origin, const Vector3& direction, float tMin, float tMax, RayHit& hit) const
+		{
+			return traverse<false>(origin, direction, tMin, tMax, hit);
+		}
+
+		void TriangleBVH::intersect(RayPacket& packet) const
+		{
+			for (size_t lane = 0; lane < simd::width; lane++) packet.triangle[lane] = -1;
+			simd::float4 o[3], d[3], inverse[3];
+			for (int axis = 0; axis < 3; axis++) {
+				o[axis] = simd::load(packet.origin[axis]);
+				d[axis] = simd::load(packet.direction[axis]);
+				alignas(simd::alignment) float inverses[simd::width];
+				for (size_t lane = 0; lane < simd::width; lane++) {
+					float component = packet.direction[axis][lane];
+					inverses[lane] = 1.0f / (std::abs(component) > 1e-30f ? component : 1e-30f);
+				}
+				inverse[axis] = simd::load(inverses);
+			}
+			simd::float4 nearLimit = simd::load(packet.tMin), best = simd::load(packet.tMax);
+			simd::float4 active = simd::lessThan(nearLimit, best), zero = simd::zero(), one = simd::set(1.0f), tiny = simd::set(1e-20f);
+			if (nodes.empty() || !simd::movemask(active)) {
+				simd::store(packet.distance, best);
+				return;
+			}
+
+			constexpr size_t stackSize = 256;
+			int stack[stackSize];
+			size_t top = 0;
+			stack[top++] = 0;
+			while (top > 0) {
+				int reference = stack[--top];
+				if (reference < 0) {
+					// A triangle at a time against the four rays.
+					const TrianglePack& pack = packs[~reference];
+					for (size_t triangle = 0; triangle < simd::width; triangle++) {
+						if (pack.triangles[triangle] < 0) continue;
+						simd::float4 e1[3], e2[3], s[3];
+						for (int axis = 0; axis < 3; axis++) {
+							e1[axis] = simd::set(pack.e1[axis][triangle]);
+							e2[axis] = simd::set(pack.e2[axis][triangle]);
+							s[axis] = simd::sub(o[axis], simd::set(pack.v0[axis][triangle]));
+						}
+						simd::float4 p[3] = {
+							simd::sub(simd::mul(d[1], e2[2]), simd::mul(d[2], e2[1])),
+							simd::sub(simd::mul(d[2], e2[0]), simd::mul(d[0], e2[2])),
+							simd::sub(simd::mul(d[0], e2[1]), simd::mul(d[1], e2[0])) };
+						simd::float4 q[3] = {
+							simd::sub(simd::mul(s[1], e1[2]), simd::mul(s[2], e1[1])),
+							simd::sub(simd::mul(s[2], e1[0]), simd::mul(s[0], e1[2])),
+							simd::sub(simd::mul(s[0], e1[1]), simd::mul(s[1], e1[0])) };
+						simd::float4 determinant = simd::madd(e1[0], p[0], simd::madd(e1[1], p[1], simd::mul(e1[2], p[2])));
+						simd::float4 inverseDeterminant = simd::div(one, determinant);
+						simd::float4 u = simd::mul(simd::madd(s[0], p[0], simd::madd(s[1], p[1], simd::mul(s[2], p[2]))), inverseDeterminant);
+						simd::float4 v = simd::mul(simd::madd(d[0], q[0], simd::madd(d[1], q[1], simd::mul(d[2], q[2]))), inverseDeterminant);
+						simd::float4 t = simd::mul(simd::madd(e2[0], q[0], simd::madd(e2[1], q[1], simd::mul(e2[2], q[2]))), inverseDeterminant);
+						simd::float4 mask = simd::bitAnd(simd::lessThan(tiny, simd::mul(determinant, determinant)), simd::lessEqual(zero, u));
+						mask = simd::bitAnd(mask, simd::bitAnd(simd::lessEqual(zero, v), simd::lessEqual(simd::add(u, v), one)));
+						mask = simd::bitAnd(mask, simd::bitAnd(simd::lessThan(nearLimit, t), simd::lessThan(t, best)));
+						mask = simd::bitAnd(mask, active);
+						int bits = simd::movemask(mask);
+						if (!bits) continue;
+						best = simd::select(mask, t, best);
+						for (size_t lane = 0; lane < simd::width; lane++)
+							if (bits & (1 << lane)) packet.triangle[lane] = pack.triangles[triangle];
+					}
+					continue;
+				}
+
+				// A child at a time against the four rays, kept if any of them reaches it before its best hit.
+				// The nearest child goes on top, by the closest entry of the rays that reach it.
+				const Node& node = nodes[reference];
+				size_t first = top;
+				float stackKeys[simd::width];
+				for (size_t child = 0; child < simd::width; child++) {
+					if (!node.children[child]) continue;	// unused, the root is never a child
+					simd::float4 entry = nearLimit, exit = best;
+					for (int axis = 0; axis < 3; axis++) {
+						simd::float4 t0 = simd::mul(simd::sub(simd::set(node.bounds[axis][child]), o[axis]), inverse[axis]);
+						simd::float4 t1 = simd::mul(simd::sub(simd::set(node.bounds[axis + 3][child]), o[axis]), inverse[axis]);
+						entry = simd::max(entry, simd::min(t0, t1));
+						exit = simd::min(exit, simd::max(t0, t1));
+					}
+					simd::float4 reached = simd::bitAnd(simd::lessEqual(entry, exit), active);
+					int bits = simd::movemask(reached);
+					if (!bits) continue;
+					alignas(simd::alignment) float entries[simd::width];
+					simd::store(entries, entry);
+					float closest = FLT_MAX;
+					for (size_t lane = 0; lane < simd::width; lane++)
+						if (bits & (1 << lane)) closest = std::min(closest, entries[lane]);
+					UNDA_ASSERT(top < stackSize);
+					size_t i = top++;
+					while (i > first && stackKeys[i - 1 - first] < closest) {
+						stack[i] = stack[i - 1];
+						stackKeys[i - first] = stackKeys[i - 1 - first];
+						i--;
+					}
+					stack[i] = node.children[child];
+					stackKeys[i - first] = closest;
+				}
+			}
+			simd::store(packet.distance, best);
+		}
+
+		bool TriangleBVH::occluded(const Vector3& from, const Vector3& to, float margin) const
+		{
+			Vector3 direction = Subtract(to, from);
+			float length = Length(direction);
+			if (length <= 2 * margin) return false;
+			RayHit hit;
+			return traverse<true>(from, direction, margin / length, 1.0f - margin / length, hit);
+		}
+	}
+}
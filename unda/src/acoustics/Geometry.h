@@ -0,0 +1,113 @@
+#pragma once
+
+#include "Acoustics.h"
+#include "../utils/Settings.h"
+#include "../utils/Utils.h"
+#include "../utils/SIMD.h"
+#include <vector>
+#include <array>
+#include <cmath>
+
+
+namespace unda {
+	namespace acoustics {
+		typedef std::array<float, 3> Vector3;
+
+		inline Vector3 Add(const Vector3& a, const Vector3& b) { return { a[0] + b[0], a[1] + b[1], a[2] + b[2] }; }
+		inline Vector3 Subtract(const Vector3& a, const Vector3& b) { return { a[0] - b[0], a[1] - b[1], a[2] - b[2] }; }
+		inline Vector3 Scale(const Vector3& a, float s) { return { a[0] * s, a[1] * s, a[2] * s }; }
+		inline float Dot(const Vector3& a, const Vector3& b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+		inline Vector3 Cross(const Vector3& a, const Vector3& b) { return { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] }; }
+		inline float Length(const Vector3& a) { return sqrtf(Dot(a, a)); }
+		inline Vector3 Normalise(const Vector3& a) { float length = Length(a); return length > 0 ? Scale(a, 1.0f / length) : Vector3{ 0.0f, 0.0f, 0.0f }; }
+
+		// Room surface for the geometric models: a triangle soup in metres, three vertices per triangle,
+		// and a material per triangle out of surfaces.
+		template<size_t N>
+		struct BasicRoomMesh {
+			std::vector<Vector3> vertices;
+			std::vector<unsigned int> materials;
+			std::vector<BasicMaterial<N>> surfaces;
+			size_t getTriangleCount() const { return materials.size(); }
+		};
+		typedef BasicRoomMesh<6> RoomMesh;
+
+		// Room for the wave models: a voxel grid stretched over [0, dimensions] metres, cells[(x * size[1] + y) * size[2] + z]
+		// 0 for air, otherwise 1 + the index of its material in surfaces. Everything outside the grid is solid,
+		// of material faces[2 * axis] below it along axis and faces[2 * axis + 1] above.
+		template<size_t N>
+		struct BasicVoxelRoom {
+			std::array<size_t, 3> size{};
+			std::array<double, 3> dimensions{};
+			std::vector<unsigned char> cells;
+			std::vector<BasicMaterial<N>> surfaces;
+			std::array<unsigned int, 6> faces{};
+		};
+		typedef BasicVoxelRoom<6> VoxelRoom;
+
+		struct RayHit {
+			float distance = 0;		// in lengths of the ray direction
+			int triangle = -1;
+		};
+
+		// simd::width rays traced together, a lane each, in the layout of the BVH's registers. Lanes with
+		// tMax <= tMin are idle. distance and triangle are the results, triangle -1 for a miss.
+		struct alignas(simd::alignment) RayPacket {
+			float origin[3][simd::width];
+			float direction[3][simd::width];
+			float tMin[simd::width];
+			float tMax[simd::width];
+			float distance[simd::width];
+			int triangle[simd::width];
+		};
+
+		// Bounding volume hierarchy over a triangle soup with four children per node, built by binned SAH.
+		// A node keeps its children's boxes a coordinate per register, so one ray is tested against all four
+		// in a handful of SIMD ops, and leaves are packs of simd::width triangles stored the same way
+		// (first vertex and two edges), intersected together by Moller-Trumbore. Read-only once built, so
+		// any number of threads can trace it.
+		class TriangleBVH {
+		public:
+			explicit TriangleBVH(const std::vector<Vector3>& vertices);
+			~TriangleBVH() = default;
+
+			size_t getTriangleCount() const { return normals.size(); }
+			// Unit, by the winding of the triangle, zero if it's degenerate.
+			const Vector3& getNormal(size_t triangle) const { return normals[triangle]; }
+
+			// Nearest triangle on origin + t * direction with tMin < t < tMax.
+			bool intersect(const Vector3& origin, const Vector3& direction, float tMin, float tMax, RayHit& hit) const;
+			// Whether any triangle lies between from and to, margin metres clear of both ends.
+			bool occluded(const Vector3& from, const Vector3& to, float margin = 1e-3f) const;
+			// Nearest hits of a packet. Nodes are entered once for all the rays that reach them and each
+			// triangle is tested against the four rays at once, which pays off when the rays are coherent
+			// or, as with the ray tracer's batches, there are always four of them in flight.
+			void intersect(RayPacket& packet) const;
+
+		private:
+			struct alignas(simd::alignment) Node {
+				float bounds[6][simd::width];		// min x, y, z and max x, y, z per child
+				int children[simd::width];			// node index, or ~pack for a leaf
+			};
+			struct alignas(simd::alignment) TrianglePack {
+				float v0[3][simd::width], e1[3][simd::width], e2[3][simd::width];
+				int triangles[simd::width];			// -1 for padding, which can't be hit
+			};
+			simd::AlignedVector<Node> nodes;		// root first
+			simd::AlignedVector<TrianglePack> packs;
+			std::vector<Vector3> normals;
+
+			struct BuildTriangle {
+				Vector3 min, max, centroid;
+				int index;
+			};
+			int buildNode(std::vector<BuildTriangle>& triangles, size_t begin, size_t end, const std::vector<Vector3>& vertices);
+			int buildLeaf(const std::vector<BuildTriangle>& triangles, size_t begin, size_t end, const std::vector<Vector3>& vertices);
+			size_t split(std::vector<BuildTriangle>& triangles, size_t begin, size_t end) const;
+
+			template<bool anyHit> bool traverse(const Vector3& origin, const Vector3& direction, float tMin, float tMax, RayHit& hit) const;
+
+			DISABLE_COPY_ASSIGN(TriangleBVH)
+		};
+	}
+}
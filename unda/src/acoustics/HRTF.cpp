@@ -0,0 +1,112 @@
+#include "HRTF.h"
+#include "DSP.h"
+#include <filesystem>
+#include <regex>
+#include <algorithm>
+#include <cmath>
+
+namespace unda {
+	namespace acoustics {
+		HRTFSet::HRTFSet(const std::string& directory, double sampleRate, bool _interpolate, double _gridStep)
+			: interpolate(_interpolate)
+			, gridStep(std::max(_gridStep, 0.1))
+		{
+			std::error_code error;
+			if (!std::filesystem::is_directory(directory, error)) {
+				UNDA_ERROR("HRTFSet: " + directory + " is not a directory");
+				return;
+			}
+			const std::regex kemar("H(-?[0-9]+)e([0-9]+)a\\.wav", std::regex::icase);
+			const std::regex angles("azi(-?[0-9.]+)_ele(-?[0-9.]+)\\.wav", std::regex::icase);
+
+			std::vector<std::array<Signal, 2>> measured;
+			for (const std::filesystem::directory_entry& entry : std::filesystem::recursive_directory_iterator(directory, error)) {
+				if (!entry.is_regular_file()) continue;
+				std::string name = entry.path().filename().string();
+				std::smatch match;
+				double azimuth, elevation;
+				if (std::regex_match(name, match, kemar)) {
+					elevation = std::stod(match[1].str());
+					azimuth = -std::stod(match[2].str());
+				}
+				else if (std::regex_match(name, match, angles)) {
+					azimuth = std::stod(match[1].str());
+					elevation = std::stod(match[2].str());
+				}
+				else continue;
+
+				AudioFileReader reader(entry.path().string(), 4096, sampleRate);
+				if (!reader.isOpen()) continue;
+				if (reader.getChannelCount() != 2) {
+					UNDA_ERROR("HRTFSet: " + name + " is not stereo");
+					continue;
+				}
+				std::array<Signal, 2> pair;
+				pair[0].resize(reader.getFrameCount());
+				pair[1].resize(reader.getFrameCount());
+				float* channels[2] = { pair[0].data(), pair[1].data() };
+				size_t nRead = reader.read(channels, reader.getFrameCount());
+				pair[0].resize(nRead);
+				pair[1].resize(nRead);
+				measured.push_back(std::move(pair));
+				directions.push_back(DirectionFromAngles(azimuth, elevation));
+			}
+			if (measured.empty()) {
+				UNDA_ERROR("HRTFSet: no HRIRs in " + directory);
+				return;
+			}
+
+			// The onset every HRIR shares is only latency. A few samples are kept ahead of the earliest one.
+			size_t onset = SIZE_MAX, longest = 0;
+			for (const std::array<Signal, 2>& pair : measured) {
+				float peak = 0;
+				for (const Signal& ear : pair)
+					for (Sample sample : ear) peak = std::max(peak, std::abs(sample));
+				for (const Signal& ear : pair) {
+					size_t first = 0;
+					while (first < ear.size() && std::abs(ear[first]) < 0.1f * peak) first++;
+					onset = std::min(onset, first);
+				}
+				longest = std::max(longest, pair[0].size());
+			}
+			onset = onset > 4 ? onset - 4 : 0;
+			length = simd::roundUp(std::max(longest, onset + 1) - onset);
+
+			hrirs.assign(measured.size() * 2 * length, 0.0f);
+			for (size_t measurement = 0; measurement < measured.size(); measurement++) {
+				for (size_t ear = 0; ear < 2; ear++) {
+					const Signal& hrir = measured[measurement][ear];
+					if (hrir.size() > onset)
+						std::copy(hrir.begin() + onset, hrir.end(), hrirs.begin() + (measurement * 2 + ear) * length);
+				}
+			}
+			grid.build(directions, interpolate, gridStep);
+			UNDA_LOG_MESSAGE("HRTFSet: " + std::to_string(directions.size()) + " directions, " + std::to_string(length) + " taps");
+		}
+
+		const HRTFSet::Lookup& HRTFSet::lookup(float x, float y, float z) const
+		{
+			return grid.getCell(grid.getIndex(x, y, z));
+		}
+
+		void HRTFSet::getHRIRs(float x, float y, float z, float* left, float* right) const
+		{
+			const Lookup& entry = lookup(x, y, z);
+			float* outputs[2] = { left, right };
+			for (size_t ear = 0; ear < 2; ear++) {
+				const float* first = getHRIR(entry.measurements[0], ear);
+				if (entry.weights[1] == 0.0f) {
+					std::copy(first, first + length, outputs[ear]);
+					continue;
+				}
+				const float* second = getHRIR(entry.measurements[1], ear), *third = getHRIR(entry.measurements[2], ear);
+				simd::float4 w0 = simd::set(entry.weights[0]), w1 = simd::set(entry.weights[1]), w2 = simd::set(entry.weights[2]);
+				for (size_t tap = 0; tap < length; tap += simd::width) {
+					simd::float4 sum = simd::mul(w0, simd::load(first + tap));
+					sum = simd::madd(w1, simd::load(second + tap), sum);
+					simd::store(outputs[ear] + tap, simd::madd(w2, simd::load(third + tap), sum));
+				}
+			}
+		}
+	}
+}
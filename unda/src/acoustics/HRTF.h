@@ -0,0 +1,51 @@
+#pragma once
+
+#include "../utils/Settings.h"
+#include "../utils/Utils.h"
+#include "../utils/SIMD.h"
+#include "SphericalGrid.h"
+#include <string>
+#include <vector>
+#include <array>
+
+
+namespace unda {
+	namespace acoustics {
+
+		// Head-related impulse responses from a local directory of stereo WAV files (left ear first), one per
+		// measured direction, searched recursively. The direction is read from the file name, either the MIT
+		// KEMAR form H<elevation>e<azimuth>a.wav (azimuth clockwise) or azi<azimuth>_ele<elevation>.wav
+		// (azimuth anticlockwise), in degrees.
+		// HRIRs are converted to sampleRate, trimmed by the onset delay they all share, zero padded to whole
+		// SIMD registers and stored aligned. Directions go through a SphericalGrid of gridStep degrees.
+		class HRTFSet {
+		public:
+			typedef SphericalGrid::Cell Lookup;
+
+			HRTFSet(const std::string& directory, double sampleRate = unda::sampleRate, bool _interpolate = true, double _gridStep = 2.0);
+			~HRTFSet() = default;
+
+			bool isLoaded() const { return !directions.empty(); }
+			size_t getMeasurementCount() const { return directions.size(); }
+			// Taps per ear, a multiple of simd::width.
+			size_t getLength() const { return length; }
+
+			// Unit direction as in Ambisonics.h: x to the front, y to the left and z up.
+			const Lookup& lookup(float x, float y, float z) const;
+			const float* getHRIR(size_t measurement, size_t ear) const { return &hrirs[(measurement * 2 + ear) * length]; }
+			// The looked up pair, weighted, into getLength() aligned floats per ear.
+			void getHRIRs(float x, float y, float z, float* left, float* right) const;
+
+		private:
+			bool interpolate;
+			double gridStep;
+
+			std::vector<std::array<float, 3>> directions;	// unit vectors per measurement
+			simd::AlignedVector<float> hrirs;				// measurement x ear x length
+			size_t length = 0;
+			SphericalGrid grid;
+
+			DISABLE_COPY_ASSIGN(HRTFSet)
+		};
+	}
+}
@@ -0,0 +1,241 @@
+#include "IRCache.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+
+namespace unda {
+	namespace acoustics {
+
+		namespace {
+			constexpr char cacheMagic[8] = { 'U', 'N', 'D', 'A', 'I', 'R', '0', '2' };
+			constexpr const char* cacheExtension = ".ir";
+
+			struct CacheHeader {
+				char magic[8];
+				uint64_t hash;
+				uint64_t nSamples;
+				uint32_t nBands;
+				uint32_t padding;
+				IRCacheKey key;
+			};
+
+			inline long long quantise(double metres) { return (long long)std::llround(metres * 1000.0); }
+
+			// FNV-1a, over the individual fields so struct padding never leaks into the key.
+			struct Hasher {
+				uint64_t value = 14695981039346656037ull;
+				template<typename T> void add(const T& field) {
+					const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&field);
+					for (size_t i = 0; i < sizeof(T); i++) {
+						value ^= bytes[i];
+						value *= 1099511628211ull;
+					}
+				}
+			};
+		}
+
+
+		IRCacheKey IRCacheKey::make(const std::array<double, 3>& room, const std::array<double, 3>& source, const std::array<double, 3>& listener,
+									const std::array<std::array<double, 6>, 6>& surfaceReflection, unsigned int order, double sampleRate, int nSamples,
+									BandFilterType bandFilter, bool multirate, int transitionSamples,
+									LateTailModel lateTailModel, uint64_t directivity)
+		{
+			IRCacheKey key;
+			key.room = room;
+			for (int axis = 0; axis < 3; axis++) {
+				key.source[axis] = quantise(source[axis]);
+				key.listener[axis] = quantise(listener[axis]);
+			}
+			key.surfaceReflection = surfaceReflection;
+			key.order = order;
+			key.sampleRate = sampleRate;
+			key.nSamples = nSamples;
+			key.bandFilter = bandFilter;
+			key.multirate = multirate;
+			key.transitionSamples = transitionSamples;
+			key.lateTailModel = lateTailModel;
+			key.directivity = directivity;
+			return key;
+		}
+
+		uint64_t IRCacheKey::hash() const
+		{
+			Hasher hasher;
+			for (double value : room) hasher.add(value);
+			for (long long value : source) hasher.add(value);
+			for (long long value : listener) hasher.add(value);
+			for (const std::array<double, 6>& face : surfaceReflection)
+				for (double value : face) hasher.add(value);
+			hasher.add(order);
+			hasher.add(sampleRate);
+			hasher.add(nSamples);
+			hasher.add(bandFilter);
+			hasher.add(multirate);
+			hasher.add(transitionSamples);
+			hasher.add(lateTailModel);
+			hasher.add(directivity);
+			return hasher.value;
+		}
+
+		std::string IRCacheKey::toString() const
+		{
+			std::stringstream stream;
+			stream << std::hex << std::setw(16) << std::setfill('0') << hash();
+			return stream.str();
+		}
+
+		bool IRCacheKey::operator==(const IRCacheKey& other) const
+		{
+			return room == other.room && source == other.source && listener == other.listener && surfaceReflection == other.surfaceReflection
+				&& order == other.order && sampleRate == other.sampleRate && nSamples == other.nSamples && bandFilter == other.bandFilter
+				&& multirate == other.multirate && transitionSamples == other.transitionSamples
+				&& lateTailModel == other.lateTailModel && directivity == other.directivity;
+		}
+
+
+		CachedIR::~CachedIR()
+		{
+			if (!view) return;
+#ifdef _WIN32
+			UnmapViewOfFile(view);
+#else
+			munmap(view, viewSize);
+#endif
+		}
+
+		std::array<Signal, 6> CachedIR::getBandSignals() const
+		{
+			std::array<Signal, 6> bands;
+			for (size_t band = 0; band < 6; band++)
+				bands[band].assign(getBand(band), getBand(band) + nSamples);
+			return bands;
+		}
+
+
+		IRCache::IRCache(const std::string& _directory, size_t _budgetBytes)
+			: directory(_directory)
+			, budgetBytes(_budgetBytes)
+		{
+			std::error_code error;
+			std::filesystem::create_directories(directory, error);
+			if (error) {
+				UNDA_ERROR("IR cache: could not create " + directory);
+			}
+		}
+
+		std::string IRCache::entryPath(const IRCacheKey& key) const
+		{
+			return (std::filesystem::path(directory) / (key.toString() + cacheExtension)).string();
+		}
+
+		std::unique_ptr<CachedIR> IRCache::load(const IRCacheKey& key)
+		{
+			std::string path = entryPath(key);
+			std::error_code error;
+			if (!std::filesystem::exists(path, error)) return nullptr;
+			size_t fileSize = (size_t)std::filesystem::file_size(path, error);
+			if (error || fileSize < sizeof(CacheHeader)) return nullptr;
+			// Hits count as uses for the eviction order.
+			std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+
+			std::unique_ptr<CachedIR> entry(new CachedIR());
+#ifdef _WIN32
+			HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE) return nullptr;
+			HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			CloseHandle(file);
+			if (!mapping) return nullptr;
+			entry->view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);
+			if (!entry->view) return nullptr;
+#else
+			int file = open(path.c_str(), O_RDONLY);
+			if (file < 0) return nullptr;
+			void* view = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, file, 0);
+			close(file);
+			if (view == MAP_FAILED) return nullptr;
+			entry->view = view;
+#endif
+			entry->viewSize = fileSize;
+
+			const CacheHeader* header = reinterpret_cast<const CacheHeader*>(entry->view);
+			if (!std::equal(std::begin(cacheMagic), std::end(cacheMagic), header->magic) || header->nBands != 6
+				|| !(header->key == key) || fileSize != sizeof(CacheHeader) + (size_t)header->nSamples * 7 * sizeof(float)) {
+				UNDA_LOG_MESSAGE("IR cache: stale or colliding entry " + path);
+				return nullptr;
+			}
+			entry->nSamples = (size_t)header->nSamples;
+			entry->data = reinterpret_cast<const float*>(reinterpret_cast<const unsigned char*>(entry->view) + sizeof(CacheHeader));
+			UNDA_LOG_MESSAGE("IR cache: hit " + path);
+			return entry;
+		}
+
+		bool IRCache::store(const IRCacheKey& key, const Signal& output, const std::array<Signal, 6>& bands)
+		{
+			for (const Signal& band : bands) {
+				if (band.size() != output.size()) { UNDA_ERROR("IR cache: band and output lengths differ"); return false; }
+			}
+			CacheHeader header = CacheHeader();
+			std::copy(std::begin(cacheMagic), std::end(cacheMagic), header.magic);
+			header.hash = key.hash();
+			header.nSamples = (uint64_t)output.size();
+			header.nBands = 6;
+			header.key = key;
+
+			// Written next to the entry and renamed, so concurrent readers never map a partial file.
+			std::string path = entryPath(key), temporaryPath = path + ".tmp";
+			{
+				std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+				if (!file.is_open()) { UNDA_ERROR("IR cache: could not write " + temporaryPath); return false; }
+				file.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+				file.write(reinterpret_cast<const char*>(output.data()), output.size() * sizeof(float));
+				for (const Signal& band : bands)
+					file.write(reinterpret_cast<const char*>(band.data()), band.size() * sizeof(float));
+				if (!file.good()) { UNDA_ERROR("IR cache: could not write " + temporaryPath); return false; }
+			}
+			std::error_code error;
+			std::filesystem::rename(temporaryPath, path, error);
+			if (error) { std::filesystem::remove(temporaryPath, error); return false; }
+			evict();
+			return true;
+		}
+
+		void IRCache::evict()
+		{
+			struct Entry { std::filesystem::path path; std::filesystem::file_time_type lastUse; size_t size; };
+			std::vector<Entry> entries;
+			size_t total = 0;
+			std::error_code error;
+			for (const std::filesystem::directory_entry& file : std::filesystem::directory_iterator(directory, error)) {
+				if (!file.is_regular_file() || file.path().extension() != cacheExtension) continue;
+				entries.push_back({ file.path(), file.last_write_time(), (size_t)file.file_size() });
+				total += entries.back().size;
+			}
+			if (total <= budgetBytes) return;
+
+			std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.lastUse < b.lastUse; });
+			// Never evict the newest entry, even if it alone is over budget.
+			for (size_t i = 0; i + 1 < entries.size() && total > budgetBytes; i++) {
+				if (std::filesystem::remove(entries[i].path, error)) {
+					total -= entries[i].size;
+					UNDA_LOG_MESSAGE("IR cache: evicted " + entries[i].path.string());
+				}
+			}
+		}
+	}
+}
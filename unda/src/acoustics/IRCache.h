@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Acoustics.h"
+#include "DSP.h"
+#include "../utils/Utils.h"
+#include <array>
+#include <string>
+#include <memory>
+#include <cstdint>
+
+
+namespace unda {
+	namespace acoustics {
+
+		// Everything the ISM output depends on. Positions are quantised to millimetres so that
+		// re-exported configurations with float noise still hit the same entry.
+		struct IRCacheKey {
+			std::array<double, 3> room{};
+			std::array<long long, 3> source{}, listener{};
+			std::array<std::array<double, 6>, 6> surfaceReflection{};
+			unsigned int order = 0;
+			double sampleRate = 0;
+			int nSamples = 0;
+			BandFilterType bandFilter = BandFilterType::FIR;
+			bool multirate = false;
+			int transitionSamples = 0;		// hybrid late tail, 0 if off
+			LateTailModel lateTailModel = LateTailModel::Noise;
+			uint64_t directivity = 0;		// SourceDirectivity::getChecksum(), 0 if omnidirectional
+
+			static IRCacheKey make(const std::array<double, 3>& room, const std::array<double, 3>& source, const std::array<double, 3>& listener,
+								   const std::array<std::array<double, 6>, 6>& surfaceReflection, unsigned int order, double sampleRate, int nSamples,
+								   BandFilterType bandFilter = BandFilterType::FIR, bool multirate = false,
+								   int transitionSamples = 0, LateTailModel lateTailModel = LateTailModel::Noise, uint64_t directivity = 0);
+			uint64_t hash() const;
+			std::string toString() const;
+			bool operator==(const IRCacheKey& other) const;
+		};
+
+
+		// Read-only, memory-mapped cache entry.
+		class CachedIR {
+		public:
+			~CachedIR();
+
+			size_t getLength() const { return nSamples; }
+			const float* getOutput() const { return data; }
+			const float* getBand(size_t band) const { return data + (band + 1) * nSamples; }
+			Signal getOutputSignal() const { return Signal(getOutput(), getOutput() + nSamples); }
+			std::array<Signal, 6> getBandSignals() const;
+
+		private:
+			friend class IRCache;
+			CachedIR() = default;
+
+			void* view = nullptr;
+			size_t viewSize = 0;
+			const float* data = nullptr;
+			size_t nSamples = 0;
+
+			DISABLE_COPY_ASSIGN(CachedIR)
+		};
+
+
+		// Content-addressed on-disk store of final and per-band IRs, evicting least recently used
+		// entries once the directory grows over budgetBytes.
+		class IRCache {
+		public:
+			IRCache(const std::string& _directory, size_t _budgetBytes);
+			~IRCache() = default;
+
+			std::unique_ptr<CachedIR> load(const IRCacheKey& key);
+			bool store(const IRCacheKey& key, const Signal& output, const std::array<Signal, 6>& bands);
+
+		private:
+			std::string directory;
+			size_t budgetBytes;
+
+			std::string entryPath(const IRCacheKey& key) const;
+			void evict();
+
+			DISABLE_COPY_ASSIGN(IRCache)
+		};
+	}
+}
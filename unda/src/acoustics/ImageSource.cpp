@@ -44,59 +44,536 @@ namespace unda {
 			}
 		}
 
+		// value * kernel added to fractionalTaps samples from taps.
+		static inline void AddTaps(float* taps, const simd::float4* kernel, size_t nRegisters, float value) {
+			simd::float4 scale = simd::set(value);
+			for (size_t i = 0; i < nRegisters; i++, taps += simd::width)
+				simd::storeu(taps, simd::madd(scale, kernel[i], simd::loadu(taps)));
+		}
+
+		// Lane-wise a * b over a bandStride of aligned band gains.
+		static inline void MultiplyBands(const float* a, const float* b, float* result, size_t bandStride) {
+			for (size_t lane = 0; lane < bandStride; lane += simd::wide::width)
+				simd::wide::store(result + lane, simd::wide::mul(simd::wide::load(a + lane), simd::wide::load(b + lane)));
+		}
+
 
 
-		ImageSourceModel::ImageSourceModel(const std::array<double, 3>& _spaceDimensions, const std::array<double, 3>& _sourcePosition, const std::array<double, 3>& _receiverPosition,	std::array<std::array<double, 6>, 6>& _surfaceReflection, int _nSamples, unsigned int _order)
+		template<size_t N>
+		BasicImageSourceModel<N>::BasicImageSourceModel(const std::array<double, 3>& _spaceDimensions, const std::array<double, 3>& _sourcePosition, const std::array<double, 3>& _receiverPosition,	std::array<std::array<double, N>, 6>& _surfaceReflection, int _nSamples, unsigned int _order)
 			: spaceDimensions(_spaceDimensions)
+			, surfaceReflection(_surfaceReflection)
 			, sourcePosition(_sourcePosition)
 			, receiverPosition(_receiverPosition)
-			, surfaceReflection(_surfaceReflection)
 			, order(_order)
+			, nSamples(_nSamples)
 		{
+			renderPool = std::make_unique<utils::WorkerPool>(getThreadCount());
+			designFractionalDelay();
+			setBandFilterType(BandFilterType::FIR);
 			updateParameters();
 		}
 
-		void ImageSourceModel::dispatchCPUThreads()
+		template<size_t N>
+		BasicImageSourceModel<N>::~BasicImageSourceModel()
+		{
+			cancelProgressive();
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::dispatchCPUThreads()
+		{
+			cancelProgressive();
+			if (!imageSourcesValid)
+				computeImageSources();
+			renderImageSources();
+			if (getTransitionSamples() > 0)
+				addLateTail();
+			computeTail();
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::setListenerPosition(const std::array<double, 3>& newPosition)
+		{
+			cancelProgressive();
+			receiverPosition = newPosition;
+			// Solved for the old position, and far too slow to redo here.
+			if (waveBands) {
+				UNDA_LOG_MESSAGE("Listener moved, dropping the wave solver bands");
+			}
+			waveBands.reset();
+			listener[0] = receiverPosition[0] / timeStep;
+			listener[1] = receiverPosition[1] / timeStep;
+			listener[2] = receiverPosition[2] / timeStep;
+			if (!imageSourcesValid)
+				computeImageSources();
+			renderImageSources();
+			// As computeTail, without writing the files.
+			if (canSplitLateTail()) {
+				synthesiseSplit();
+			}
+			else {
+				if (getTransitionSamples() > 0)
+					addLateTail();
+				synthesiseOutput();
+			}
+			normaliseOutput();
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::setBandFilterType(BandFilterType type, bool multirate)
+		{
+			cancelProgressive();
+			if (filterBank && type == bandFilterType && multirate == multirateBands) return;
+			bandFilterType = type;
+			multirateBands = multirate;
+			fullRateFilterBank.reset();
+			earlyFilterBank.reset();
+			earlyFullRateFilterBank.reset();
+			lateTailShapes.clear();
+			const std::array<std::array<float, 2>, N>& edges = BandEdges<N>();
+			filterBank = createFilterBank(type, std::vector<std::array<float, 2>>(edges.begin(), edges.end()), (float)samplingFrequency, multirate);
+			for (size_t bin = 0; bin < N; bin++) {
+				unsigned int factor = bandDecimation[bin] = filterBank->getDecimation(bin);
+				UNDA_ASSERT((factor & (factor - 1)) == 0);
+				decimationShift[bin] = 0;
+				while ((1u << decimationShift[bin]) < factor) decimationShift[bin]++;
+				interpolators[bin].reset(factor > 1 ? new PolyphaseInterpolator(factor) : nullptr);
+			}
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::designFractionalDelay()
+		{
+			// Row p holds the impulse at tapOffset + p / fractionalPhases.
+			fractionalDelay = DesignFractionalDelay(fractionalPhases, fractionalTaps, tapOffset);
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::setHybridTransition(double _transitionTime, unsigned int _transitionOrder, LateTailModel model)
+		{
+			cancelProgressive();
+			transitionTime = _transitionTime;
+			transitionOrder = _transitionOrder;
+			lateTailModel = model;
+			// The lattice only extends as far as the transition.
+			imageSourcesValid = false;
+			lateTailShapes.clear();
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::setLateField(std::shared_ptr<const BasicEnergyHistogram<N>> _lateField)
+		{
+			cancelProgressive();
+			lateField = _lateField;
+			lateTailShapes.clear();
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::setWaveBands(std::shared_ptr<const std::vector<Signal>> bands)
+		{
+			cancelProgressive();
+			waveBands = bands;
+			if (waveBands && (ambisonicOrder > 0 || hrtf)) {
+				UNDA_LOG_MESSAGE("Wave bands only replace the mono output, the spatial channels keep their geometric low bands.");
+			}
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::setAmbisonicOrder(unsigned int _order)
 		{
+			cancelProgressive();
+			UNDA_ASSERT(_order <= maxAmbisonicOrder);
+			ambisonicOrder = std::min(_order, maxAmbisonicOrder);
+			ambisonicIRs.clear();
+			ambisonicOutput.clear();
+			lateTailShapes.clear();
+		}
 
-			int points_x = (int)ceil(nSamples / (2.0 * room[0]));
-			int points_y = (int)ceil(nSamples / (2.0 * room[1]));
-			int points_z = (int)ceil(nSamples / (2.0 * room[2]));
+		template<size_t N>
+		void BasicImageSourceModel<N>::setHRTF(std::shared_ptr<const HRTFSet> _hrtf)
+		{
+			cancelProgressive();
+			hrtf = _hrtf && _hrtf->isLoaded() ? std::move(_hrtf) : nullptr;
+			binauralIRs.clear();
+			binauralOutput.clear();
+			lateTailShapes.clear();
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::setSourceDirectivity(std::shared_ptr<const BasicSourceDirectivity<N>> _directivity)
+		{
+			cancelProgressive();
+			directivity = _directivity && _directivity->isLoaded() ? std::move(_directivity) : nullptr;
+		}
 
-			unsigned int nThreads = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
-			std::queue<std::function<void()>> tasks;
-			std::mutex mutex;
+		template<size_t N>
+		int BasicImageSourceModel<N>::getTransitionSamples() const
+		{
+			double time = transitionTime;
+			if (transitionOrder > 0) {
+				// Reflections come every mean free path on average.
+				double orderTime = (double)transitionOrder * meanFreePathEstimate / unda::maths::c;
+				time = time > 0 ? std::min(time, orderTime) : orderTime;
+			}
+			return time > 0 ? (int)std::ceil(time * samplingFrequency) : 0;
+		}
+
+		template<size_t N>
+		unsigned int BasicImageSourceModel<N>::getThreadCount() const
+		{
+			return std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+		}
 
-			for (int x = -points_x; x <= points_x; x++) {
-				for (int y = -points_y; y <= points_y; y++) {
-					for (int z = -points_z; z <= points_z; z++) {
-						std::function<void()> task = [&, x, y, z]()->void { computeReflections(x, y, z); };
-						tasks.push(task);
+		template<size_t N>
+		void BasicImageSourceModel<N>::clearWorkerIRs(WorkerIRs& result) const
+		{
+			result.ambisonic.resize(getAmbisonicChannelCount() - 1);
+			result.binaural.resize(hrtf ? 2 : 0);
+			result.hrirs.resize(hrtf ? 2 * hrtf->getLength() : 0);
+			for (size_t channel = 0; channel < getChannelCount(); channel++) {
+				std::array<Signal, N>& bands = result.getChannel(channel);
+				size_t padding = channel < getAmbisonicChannelCount() ? fractionalTaps : fractionalTaps + hrtf->getLength();
+				for (size_t bin = 0; bin < N; bin++) {
+					size_t length = getChannelLength(channel, bin) + padding;
+					// Left zeroed by the last reduction if it was the same length.
+					if (!workerIRsCleared || bands[bin].size() != length) bands[bin].assign(length, Sample());
+				}
+			}
+		}
+
+		template<size_t N>
+		size_t BasicImageSourceModel<N>::getRenderedLength(size_t channel, size_t bin) const
+		{
+			bool ear = channel >= getAmbisonicChannelCount();
+			size_t D = ear ? 1 : bandDecimation[bin];
+			size_t length = ((size_t)getImageSourceLength() + D - 1) / D + fractionalTaps + 1 + (ear ? hrtf->getLength() : 0);
+			return std::min(length, getChannelLength(channel, bin));
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::computeImageSources()
+		{
+			int points[3], length = getImageSourceLength();
+			points[0] = (int)ceil(length / (2.0 * room[0]));
+			points[1] = (int)ceil(length / (2.0 * room[1]));
+			points[2] = (int)ceil(length / (2.0 * room[2]));
+
+			for (int axis = 0; axis < 3; axis++) {
+				ImageSourceAxis& imageAxis = imageSourceAxes[axis];
+				imageAxis.positions.clear();
+				imageAxis.gains.clear();
+				imageAxis.orders.clear();
+				imageAxis.signs.clear();
+				imageAxis.bandStride = bandStride;
+				for (int x = -points[axis]; x <= points[axis]; x++) {
+					for (int q = 0; q <= (int)order; q++) {
+						imageAxis.gains.resize(imageAxis.gains.size() + bandStride, 0.0f);
+						float* reflections = &imageAxis.gains[imageAxis.gains.size() - bandStride];
+						for (size_t bin = 0; bin < N; bin++) {
+							reflections[bin] = (float)(pow(surfaceReflection[2 * axis][bin], std::abs(x - q)) * pow(surfaceReflection[2 * axis + 1][bin], std::abs(x)));
+						}
+						imageAxis.positions.push_back((1 - 2 * (double)q) * source[axis] + 2 * (double)x * room[axis]);
+						imageAxis.orders.push_back((unsigned int)(std::abs(x - q) + std::abs(x)));
+						imageAxis.signs.push_back(imageAxis.orders.back() % 2 ? -1.0f : 1.0f);
 					}
 				}
 			}
-			std::function<void()> consumer = [&]() { 
-				std::function<void()> compute;
-				while (1) {
-					if (mutex.try_lock()) {
-						if (tasks.empty()) { mutex.unlock(); break; }
-						compute = std::move(tasks.front());
-						tasks.pop();
-						mutex.unlock();
-						compute();
+			imageSourcesValid = true;
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::updateListenerOffsets()
+		{
+			// Nearest entries first, so the reflection loops can stop at the IR length.
+			for (int axis = 0; axis < 3; axis++) {
+				const std::vector<double>& positions = imageSourceAxes[axis].positions;
+				std::vector<double>& offsets = listenerOffsets[axis];
+				std::vector<unsigned int>& nearest = nearestEntries[axis];
+				offsets.resize(positions.size());
+				nearest.resize(positions.size());
+				for (unsigned int i = 0; i < (unsigned int)positions.size(); i++) {
+					offsets[i] = positions[i] - listener[axis];
+					nearest[i] = i;
+				}
+				std::sort(nearest.begin(), nearest.end(), [&offsets](unsigned int a, unsigned int b) { return std::abs(offsets[a]) < std::abs(offsets[b]); });
+			}
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::renderImageSources()
+		{
+			updateListenerOffsets();
+
+			// Every worker writes an interleaved slice of the x entries into its own band IRs...
+			workerIRs.resize(renderPool->getThreadCount());
+			renderPool->run([this](unsigned int thread, unsigned int nThreads) {
+				WorkerIRs& result = workerIRs[thread];
+				clearWorkerIRs(result);
+				for (size_t x = thread; x < nearestEntries[0].size(); x += nThreads)
+					computeReflections(nearestEntries[0][x], result);
+			});
+
+			// ...which are then summed, clearing them for the next render.
+			reduceWorkerIRs(true);
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::reduceWorkerIRs(bool clear)
+		{
+			// Over disjoint sample ranges
+			UNDA_ASSERT(workerIRs.size() == renderPool->getThreadCount());
+			size_t nChannels = getChannelCount();
+			ambisonicIRs.resize(getAmbisonicChannelCount() - 1);
+			binauralIRs.resize(hrtf ? 2 : 0);
+			for (size_t channel = 0; channel < nChannels; channel++) {
+				std::array<Signal, N>& target = getChannelIRs(channel);
+				for (size_t bin = 0; bin < N; bin++) target[bin].resize(getChannelLength(channel, bin));
+			}
+			renderPool->run([this, nChannels, clear](unsigned int thread, unsigned int nThreads) {
+				for (size_t channel = 0; channel < nChannels; channel++) {
+					std::array<Signal, N>& target = getChannelIRs(channel);
+					for (size_t bin = 0; bin < N; bin++) {
+						size_t length = target[bin].size(), range = (length + nThreads - 1) / nThreads;
+						size_t first = std::min(length, thread * range), last = std::min(length, first + range);
+						// Nothing reaches past the rendered length, in hybrid mode most of the IR.
+						size_t summed = std::min(last, std::max(first, getRenderedLength(channel, bin)));
+						std::fill(target[bin].begin() + summed, target[bin].begin() + last, Sample());
+						for (size_t n = first; n < summed; n++) {
+							Sample sum = 0;
+							for (WorkerIRs& worker : workerIRs) {
+								Sample& value = worker.getChannel(channel)[bin][n + tapOffset];
+								sum += value;
+								if (clear) value = Sample();
+							}
+							target[bin][n] = sum;
+						}
+						if (!clear || thread > 0) continue;
+						// The taps either side of the IR, which aren't summed.
+						for (WorkerIRs& worker : workerIRs) {
+							Signal& band = worker.getChannel(channel)[bin];
+							std::fill(band.begin(), band.begin() + std::min(band.size(), (size_t)tapOffset), Sample());
+							std::fill(band.begin() + std::min(band.size(), length + tapOffset), band.end(), Sample());
+						}
 					}
 				}
-			};
-			for (unsigned int thread = 0; thread < nThreads; thread++) {
-				workers.push_back(std::thread(consumer));
+			});
+			workerIRsCleared = clear;
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::addLateTail()
+		{
+			// Seeded noise (or the FDN's band responses) decaying at each band's T60, matched to the image sources
+			// just before the transition. The histogram models take the envelope from their late field instead.
+			bool histogramModel = lateTailModel == LateTailModel::RayTraced || lateTailModel == LateTailModel::RadianceTransfer;
+			if (histogramModel && !lateField) {
+				UNDA_LOG_MESSAGE("No late field set, using noise at the Sabine T60.");
 			}
+			std::array<Signal, N> fdnResponses;
+			size_t fdnStart = renderFDNResponses(fdnResponses);
+			std::vector<std::array<Signal, N>*> channels(getChannelCount());
+			for (size_t channel = 0; channel < channels.size(); channel++) channels[channel] = &getChannelIRs(channel);
+			for (size_t bin = 0; bin < N; bin++)
+				addLateTail(bin, matchLateTail(bin), fdnResponses, fdnStart, channels);
+		}
 
-			for (std::thread& th : workers) th.join();
+		template<size_t N>
+		size_t BasicImageSourceModel<N>::renderFDNResponses(std::array<Signal, N>& responses) const
+		{
+			if (lateTailModel != LateTailModel::FDN) return 0;
+			BasicFDNReverb<N> fdn(frequencyDependentT60, (float)samplingFrequency);
+			size_t start = 4 * fdn.getMaximumDelay();
+			responses = fdn.renderBandImpulseResponses((size_t)nSamples + start);
+			return start;
+		}
 
-			computeTail();
+		template<size_t N>
+		typename BasicImageSourceModel<N>::LateTailLevel BasicImageSourceModel<N>::matchLateTail(size_t bin) const
+		{
+			LateTailLevel level;
+			const Signal& ir = irs[bin];
+			double bandRate = samplingFrequency / bandDecimation[bin];
+			size_t transition = level.transition = std::min(ir.size(), (size_t)((double)getImageSourceLength() / bandDecimation[bin]));
+			// At least 10 ms, and enough samples for a stable estimate at the lowest rates.
+			size_t window = std::max({ (size_t)(0.25 * transition), (size_t)(0.01 * bandRate), (size_t)32 });
+			size_t windowStart = transition > window ? transition - window : 0;
+			level.decay = std::log(1000.0) / (frequencyDependentT60[bin] * bandRate);	// per sample, of the amplitude
+
+			double mean = 0, imageEnergy = 0, envelopeEnergy = 0;
+			for (size_t n = windowStart; n < transition; n++) mean += ir[n];
+			mean /= (double)std::max(transition - windowStart, (size_t)1);
+			for (size_t n = windowStart; n < transition; n++) {
+				imageEnergy += ((double)ir[n] - mean) * ((double)ir[n] - mean);
+				envelopeEnergy += std::exp(-2.0 * level.decay * (double)n);
+			}
+			level.active = isLateTailFromHistogram() || (imageEnergy > 0 && envelopeEnergy > 0);
+			if (!level.active) return level;
+
+			// Matched to the variance. The mean (arrivals are all positive) decays alongside rather than stopping dead.
+			double gain = envelopeEnergy > 0 ? std::sqrt(imageEnergy / envelopeEnergy) : 0.0;
+			level.envelope = gain * std::exp(-level.decay * (double)transition);
+			level.offset = mean * std::exp(-level.decay * (double)(transition - (windowStart + transition) / 2));
+			return level;
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::addLateTail(size_t bin, LateTailLevel level, const std::array<Signal, N>& fdnResponses, size_t fdnStart, const std::vector<std::array<Signal, N>*>& channels)
+		{
+			if (!level.active) return;
+			bool fromHistogram = isLateTailFromHistogram();
+			double bandRate = samplingFrequency / bandDecimation[bin], step = std::exp(-level.decay);
+			size_t transition = level.transition, length = getBandLength(bin);
+			// Noise amplitude per band rate sample from the transition on.
+			size_t D = bandDecimation[bin];
+			std::vector<double> envelopes(length - std::min(transition, length));
+			if (envelopes.empty()) return;
+			double envelope = level.envelope, offset = level.offset;
+			for (size_t k = 0; k < envelopes.size(); k++, envelope *= step)
+				envelopes[k] = fromHistogram ? lateField->getAmplitude(bin, (transition + k) * D, D) : envelope;
+			envelope = level.envelope;
+
+			// The late field is taken as diffuse, so every higher ambisonic channel gets its own noise at the
+			// diffuse share of the W level, 1 / (2l + 1) of the energy at degree l with SN3D.
+			for (size_t channel = 1; channel < getAmbisonicChannelCount(); channel++) {
+				if (!channels[channel]) continue;
+				Signal& band = (*channels[channel])[bin];
+				double share = 1.0 / std::sqrt(2.0 * (double)AmbisonicDegree(channel) + 1.0);
+				std::mt19937 generator(lateTailSeed + (unsigned int)(bin + N * channel));
+				std::normal_distribution<float> noise(0.0f, 1.0f);
+				for (size_t n = transition; n < band.size(); n++)
+					band[n] += (Sample)(share * envelopes[n - transition] * noise(generator));
+			}
+			// The ears get their own noise at the W level too, at the full rate, where white noise needs D times
+			// the variance for the same power in band.
+			for (size_t channel = getAmbisonicChannelCount(); channel < channels.size(); channel++) {
+				if (!channels[channel]) continue;
+				Signal& band = (*channels[channel])[bin];
+				double scale = std::sqrt((double)D);
+				std::mt19937 generator(lateTailSeed + (unsigned int)(bin + N * channel));
+				std::normal_distribution<float> noise(0.0f, 1.0f);
+				for (size_t n = transition * D; n < band.size(); n++) {
+					size_t k = std::min(n / D - transition, envelopes.size() - 1);
+					band[n] += (Sample)(scale * envelopes[k] * noise(generator));
+				}
+			}
+			if (!channels[0]) return;
+			Signal& ir = (*channels[0])[bin];
+			if (lateTailModel == LateTailModel::FDN) {
+				// Normalised to a unit envelope, like the noise. Over the whole response rather than a window,
+				// as the network's echo density is still building up at first. The noise is white at the band
+				// rate and mostly removed by the band filter later, this is band-limited already, so it only
+				// gets the in-band share of that energy.
+				const Signal& response = fdnResponses[bin];
+				double responseEnergy = 0, unitEnergy = 0;
+				for (size_t k = 0; k < envelopes.size(); k++) {
+					double value = response[fdnStart + k * D];
+					responseEnergy += value * value;
+					unitEnergy += std::exp(-2.0 * level.decay * (double)k);
+				}
+				if (responseEnergy <= 0) return;
+				double inBand = std::min(1.0, (double)(BandEdges<N>()[bin][1] - BandEdges<N>()[bin][0]) / (bandRate / 2.0));
+				envelope *= std::sqrt(inBand * unitEnergy / responseEnergy);
+				for (size_t k = 0; k < envelopes.size(); k++) {
+					ir[transition + k] += (Sample)(envelope * response[fdnStart + k * D] + offset);
+					offset *= step;
+				}
+				return;
+			}
+
+			std::mt19937 generator(lateTailSeed + bin);
+			std::normal_distribution<float> noise(0.0f, 1.0f);
+			for (size_t n = transition; n < ir.size(); n++) {
+				ir[n] += (Sample)(envelopes[n - transition] * noise(generator) + offset);
+				offset *= step;
+			}
 		}
 
-		void ImageSourceModel::updateParameters()
+		template<size_t N>
+		bool BasicImageSourceModel<N>::canSplitLateTail() const
+		{
+			// A histogram tail changes with the listener, and an IIR bank's response never ends.
+			return getTransitionSamples() > 0 && !isLateTailFromHistogram() && filterBank->getResponseLength(0) > 0;
+		}
+
+		template<size_t N>
+		size_t BasicImageSourceModel<N>::getEarlyLength(size_t channel, size_t bin, const IFilterBank& bank) const
+		{
+			UNDA_ASSERT(bank.getDecimation(bin) == (channel < getAmbisonicChannelCount() ? bandDecimation[bin] : 1));
+			// The whole response rather than the half past the arrival, which covers the interpolator's taps too.
+			return std::min(getRenderedLength(channel, bin) + bank.getResponseLength(bin), getChannelLength(channel, bin));
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::buildLateTailCache()
+		{
+			// Through the same band code as addLateTail, the tail at unit envelope and the mean at unit offset.
+			std::array<Signal, N> fdnResponses;
+			size_t fdnStart = renderFDNResponses(fdnResponses);
+			size_t nChannels = getChannelCount();
+			lateTailShapes.assign(nChannels, std::array<Signal, N>());
+			std::vector<std::array<Signal, N>*> shapes(nChannels), offsets(nChannels, nullptr);
+			for (size_t channel = 0; channel < nChannels; channel++) {
+				shapes[channel] = &lateTailShapes[channel];
+				for (size_t bin = 0; bin < N; bin++) lateTailShapes[channel][bin].assign(getChannelLength(channel, bin), Sample());
+			}
+			offsets[0] = &lateTailOffsets;
+			for (size_t bin = 0; bin < N; bin++) lateTailOffsets[bin].assign(getBandLength(bin), Sample());
+			for (size_t bin = 0; bin < N; bin++) {
+				LateTailLevel level = matchLateTail(bin);
+				level.active = true;
+				level.envelope = 1;
+				level.offset = 0;
+				addLateTail(bin, level, fdnResponses, fdnStart, shapes);
+				level.envelope = 0;
+				level.offset = 1;
+				addLateTail(bin, level, fdnResponses, fdnStart, offsets);
+			}
+
+			const std::array<std::array<float, 2>, N>& edges = BandEdges<N>();
+			if (multirateBands && hrtf && !fullRateFilterBank)
+				fullRateFilterBank = createFilterBank(bandFilterType, std::vector<std::array<float, 2>>(edges.begin(), edges.end()), (float)samplingFrequency, false);
+			for (size_t channel = 0; channel < nChannels; channel++)
+				filterBands(lateTailShapes[channel], multirateBands && channel >= getAmbisonicChannelCount() ? *fullRateFilterBank : *filterBank, (size_t)nSamples);
+			filterBands(lateTailOffsets, *filterBank, (size_t)nSamples);
+
+			earlyFilterBank = createFilterBank(bandFilterType, std::vector<std::array<float, 2>>(edges.begin(), edges.end()), (float)samplingFrequency, multirateBands);
+			if (multirateBands && hrtf)
+				earlyFullRateFilterBank = createFilterBank(bandFilterType, std::vector<std::array<float, 2>>(edges.begin(), edges.end()), (float)samplingFrequency, false);
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::synthesiseSplit()
+		{
+			if (lateTailShapes.size() != getChannelCount()) buildLateTailCache();
+			std::array<LateTailLevel, N> levels;
+			for (size_t bin = 0; bin < N; bin++) levels[bin] = matchLateTail(bin);
+
+			ambisonicOutput.resize(ambisonicIRs.empty() ? 0 : ambisonicIRs.size() + 1);
+			binauralOutput.resize(binauralIRs.size());
+			for (size_t channel = 0; channel < getChannelCount(); channel++) {
+				bool ear = channel >= getAmbisonicChannelCount();
+				IFilterBank& bank = ear && multirateBands ? *earlyFullRateFilterBank : *earlyFilterBank;
+				std::array<Signal, N>& bands = getChannelIRs(channel);
+				for (size_t bin = 0; bin < N; bin++) bands[bin].resize(getEarlyLength(channel, bin, bank));
+				filterBands(bands, bank, (size_t)nSamples);
+				for (size_t bin = 0; bin < N; bin++) {
+					Signal& band = bands[bin];
+					band.resize((size_t)nSamples, Sample());
+					const Signal& shape = lateTailShapes[channel][bin];
+					Sample envelope = levels[bin].active ? (Sample)levels[bin].envelope : Sample();
+					for (size_t n = 0; n < band.size(); n++) band[n] += envelope * shape[n];
+					if (channel > 0 || !levels[bin].active) continue;
+					const Signal& offsets = lateTailOffsets[bin];
+					Sample offset = (Sample)levels[bin].offset;
+					for (size_t n = 0; n < band.size(); n++) band[n] += offset * offsets[n];
+				}
+				sumBands(bands, channel == 0 ? output : ear ? binauralOutput[channel - getAmbisonicChannelCount()] : ambisonicOutput[channel]);
+			}
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::updateParameters()
 		{
 			double volume = spaceDimensions[0] * spaceDimensions[1] * spaceDimensions[2];
 			double floorSurface = spaceDimensions[0] * spaceDimensions[2];
@@ -107,8 +584,7 @@ namespace unda {
 			double rightWallSurface = spaceDimensions[1] * spaceDimensions[2];
 
 			double totalAlpha = 0.0;
-			std::array<double, 6> frequencyDependentT60;
-			for (int bin = 0; bin < 6; bin++) {
+			for (size_t bin = 0; bin < N; bin++) {
 				// Using Sabine's equation to determine space reverberation if n_samples is not known.
 				double alpha =
 					floorSurface * (1 - pow(surfaceReflection[0][bin], 2)) + // floor
@@ -120,24 +596,21 @@ namespace unda {
 				totalAlpha += alpha;
 				frequencyDependentT60[bin] = 0.161 * (volume / alpha);
 			}
-			totalAlpha /= 6.0;
+			totalAlpha /= (double)N;
 			t_60 = 0.161 * (volume / totalAlpha);
 			totalSurface = floorSurface + ceilingSurface + backWallSurface + frontWallSurface + leftWallSurface + rightWallSurface;
 			meanFreePathEstimate = meanFreePath(volume, (double)totalSurface);
 
 
-			UNDA_LOG_MESSAGE("T60: " + std::to_string(frequencyDependentT60[0])
-				+ ", " + std::to_string(frequencyDependentT60[1]) + ", "
-				+ std::to_string(frequencyDependentT60[2]) + ", "
-				+ std::to_string(frequencyDependentT60[3]) + ", "
-				+ std::to_string(frequencyDependentT60[4]) + ", "
-				+ std::to_string(frequencyDependentT60[5]) + ", ");
+			std::string t60s;
+			for (size_t bin = 0; bin < N; bin++) t60s += std::to_string(frequencyDependentT60[bin]) + ", ";
+			UNDA_LOG_MESSAGE("T60: " + t60s);
 			UNDA_LOG_MESSAGE("Predicted total t60: " + std::to_string(t_60));
 			UNDA_LOG_MESSAGE("Volume: " + std::to_string(volume));
 	
 			if (nSamples == 0) nSamples = (int)((std::ceil(t_60)) * samplingFrequency);
-			for (int bin = 0; bin < 6; bin++) {
-				irs[bin].resize(nSamples);
+			for (size_t bin = 0; bin < N; bin++) {
+				irs[bin].resize(getBandLength(bin));
 			}
 
 			source[0]   = sourcePosition[0] / timeStep;
@@ -151,87 +624,379 @@ namespace unda {
 			room[2]     = spaceDimensions[2] / timeStep;
 		}
 
-		void ImageSourceModel::computeReflections(int x, int y, int z) {
-			double Rm[3];
+		template<size_t N>
+		void BasicImageSourceModel<N>::computeReflections(unsigned int x, WorkerIRs& result) {
 			double Rp_plus_Rm[3];
-			double reflections[3][8];  // multidimensional array N x 3; N -> octave bands
-			double distance;
-
-			Rm[0] = 2 * (double)x * room[0];
-			Rm[1] = 2 * (double)y * room[1];
-			Rm[2] = 2 * (double)z * room[2];
+			float signs[3];
+			alignas(simd::wide::alignment) float reflections[bandStride];  // x and y axis gain product
+			double limit = (double)getImageSourceLength() * (double)getImageSourceLength();
+			const ImageSourceAxis& xAxis = imageSourceAxes[0], &yAxis = imageSourceAxes[1], &zAxis = imageSourceAxes[2];
 
-			for (int q = 0; q <= (int)order; q++)
+			Rp_plus_Rm[0] = listenerOffsets[0][x];
+			signs[0] = xAxis.signs[x];
+			if (Rp_plus_Rm[0] * Rp_plus_Rm[0] >= limit) return;
+			for (unsigned int j : nearestEntries[1])
 			{
-						Rp_plus_Rm[0] = (1 - 2 * (double)q) * source[0] - listener[0] + Rm[0];
-						for (int bin = 0; bin < 6; bin++) {
-							reflections[0][bin] = pow(surfaceReflection[0][bin], std::abs(x - q)) * pow(surfaceReflection[1][bin], std::abs(x));
-						}
+				Rp_plus_Rm[1] = listenerOffsets[1][j];
+				signs[1] = yAxis.signs[j];
+				double xy = Rp_plus_Rm[0] * Rp_plus_Rm[0] + Rp_plus_Rm[1] * Rp_plus_Rm[1];
+				if (xy >= limit) break;
+				MultiplyBands(xAxis.getGains(x), yAxis.getGains(j), reflections, bandStride);
 
-				for (int j = 0; j <= (int)order; j++)
+				for (unsigned int k : nearestEntries[2])
 				{
-						Rp_plus_Rm[1] = (1 - 2 * (double)j) * source[1] - listener[1] + Rm[1];
-						for (int bin = 0; bin < 6; bin++) {
-							reflections[1][bin] = pow(surfaceReflection[2][bin], std::abs(y - j)) * pow(surfaceReflection[3][bin], std::abs(y));
-						} 
-
-					for (int k = 0; k <= (int)order; k++)
-					{
-						Rp_plus_Rm[2] = (1 - 2 * (double)k) * source[2] - listener[2] + Rm[2];
-						for (int bin = 0; bin < 6; bin++) {
-							reflections[2][bin] = pow(surfaceReflection[4][bin], std::abs(z - k)) * pow(surfaceReflection[5][bin], std::abs(z));
-						}
+					Rp_plus_Rm[2] = listenerOffsets[2][k];
+					signs[2] = zAxis.signs[k];
+					double squaredDistance = xy + Rp_plus_Rm[2] * Rp_plus_Rm[2];
+					if (squaredDistance >= limit) break;
 
-						distance = sqrt(pow(Rp_plus_Rm[0], 2) + pow(Rp_plus_Rm[1], 2) + pow(Rp_plus_Rm[2], 2));
-						int startPosition = (int)floor(distance);
-						if (startPosition >= 0 && startPosition < nSamples) {
-							for (int bin = 0; bin < 6; bin++) {
-								Sample attenuation = (Sample)MicrophoneAttenuation(Rp_plus_Rm[0], Rp_plus_Rm[1], Rp_plus_Rm[2], microphoneAngle, 'o');
-								irs[bin][startPosition] += (attenuation * (Sample)reflections[0][bin] * (Sample)reflections[1][bin] * (Sample)reflections[2][bin]) / (Sample(4) * (Sample)M_PI * (Sample)distance * (Sample)timeStep);
-							}
-						}
-					}
+					addImage(Rp_plus_Rm, squaredDistance, reflections, zAxis.getGains(k), signs, result);
 				}
 			}
 		}
 
+		template<size_t N>
+		void BasicImageSourceModel<N>::addImage(const double offset[3], double squaredDistance, const float* gains, const float* zGains, const float signs[3], WorkerIRs& result) const
+		{
+			double distance = sqrt(squaredDistance);
+			Sample attenuation = (Sample)MicrophoneAttenuation(offset[0], offset[1], offset[2], microphoneAngle, 'o');
+			attenuation /= (Sample(4) * (Sample)M_PI * (Sample)distance * (Sample)timeStep);
+			// The sound leaves the image towards the listener, -offset, which is the real source's emission
+			// direction with every axis the image is mirrored along flipped back.
+			const float* sourceGains = directivity ? directivity->getGains(-offset[0] * signs[0], -offset[1] * signs[1], -offset[2] * signs[2]) : nullptr;
+			// Band values a register at a time, then one fractionalTaps insertion per band.
+			alignas(simd::wide::alignment) float values[bandStride];
+			simd::wide::floatw scale = simd::wide::set(attenuation);
+			for (size_t lane = 0; lane < bandStride; lane += simd::wide::width) {
+				simd::wide::floatw value = simd::wide::mul(scale, simd::wide::mul(simd::wide::load(gains + lane), simd::wide::load(zGains + lane)));
+				if (sourceGains) value = simd::wide::mul(value, simd::wide::load(sourceGains + lane));
+				simd::wide::store(values + lane, value);
+			}
+			// Arrival direction in ambisonic axes, x front (-z), y left (-x) and z up (y).
+			alignas(simd::alignment) float harmonics[AmbisonicChannelCount(maxAmbisonicOrder)];
+			if (!result.ambisonic.empty()) {
+				float scale = 1.0f / (float)distance;
+				EvaluateSphericalHarmonics(-(float)offset[2] * scale, -(float)offset[0] * scale, (float)offset[1] * scale, harmonics);
+			}
+			// The arrival in fractionalPhases steps at the full rate, rounded down to each band rate by a shift.
+			constexpr size_t nRegisters = fractionalTaps / simd::width;
+			simd::float4 kernel[nRegisters];
+			size_t arrival = (size_t)(distance * (double)fractionalPhases + 0.5), index = 0;
+			for (size_t bin = 0; bin < N; bin++) {
+				// At the band rate, shared by neighbouring bands at the same rate. Scaled by 1 / decimation so the
+				// level after interpolation matches the full rate.
+				if (bin == 0 || bandDecimation[bin] != bandDecimation[bin - 1]) {
+					size_t position = (arrival + (bandDecimation[bin] >> 1)) >> decimationShift[bin];
+					index = position / fractionalPhases;
+					const float* row = &fractionalDelay[(position % fractionalPhases) * fractionalTaps];
+					for (size_t i = 0; i < nRegisters; i++) kernel[i] = simd::load(row + i * simd::width);
+				}
+				// result is offset by tapOffset samples, so the taps start at index - tapOffset.
+				Sample value = values[bin] / (Sample)bandDecimation[bin];
+				AddTaps(&result.bands[bin][index], kernel, nRegisters, value);
+				for (size_t channel = 1; channel <= result.ambisonic.size(); channel++)
+					AddTaps(&result.ambisonic[channel - 1][bin][index], kernel, nRegisters, value * harmonics[channel]);
+			}
+			if (result.binaural.empty()) return;
 
-		void ImageSourceModel::computeTail()
+			// The HRIR pair is looked up (and blended) once, then added at the full rate arrival, to the nearest
+			// sample, for every band.
+			size_t length = hrtf->getLength();
+			float inverseDistance = 1.0f / (float)distance;
+			hrtf->getHRIRs(-(float)offset[2] * inverseDistance, -(float)offset[0] * inverseDistance, (float)offset[1] * inverseDistance, result.hrirs.data(), result.hrirs.data() + length);
+			for (size_t ear = 0; ear < 2; ear++) {
+				const float* hrir = result.hrirs.data() + ear * length;
+				for (size_t bin = 0; bin < N; bin++) {
+					simd::float4 value = simd::set(values[bin]);
+					float* taps = &result.binaural[ear][bin][(size_t)(distance + 0.5) + tapOffset];
+					for (size_t tap = 0; tap < length; tap += simd::width)
+						simd::storeu(taps + tap, simd::madd(value, simd::load(hrir + tap), simd::loadu(taps + tap)));
+				}
+			}
+		}
+
+
+		template<size_t N>
+		typename BasicImageSourceModel<N>::Snapshot BasicImageSourceModel<N>::renderProgressive(std::chrono::milliseconds deadline, std::chrono::milliseconds snapshotInterval, SnapshotCallback onSnapshot)
 		{
-			for (int i = 0; i < 6; i++)
-				WriteAudioFile({ irs[i] }, "frequency_bin_" + std::to_string(i) + ".wav");
+			cancelProgressive();
 			{
-				Filter filter = Filter(Filter::filterType::BPF, 20, 125);
-				filter.convolveToSignal(irs[0]);
+				std::lock_guard<std::mutex> lock(snapshotMutex);
+				snapshot = Snapshot();
 			}
+			std::chrono::steady_clock::time_point deadlineTime = std::chrono::steady_clock::now() + deadline;
 			{
-				Filter filter = Filter(Filter::filterType::BPF, 125, 250);
-				filter.convolveToSignal(irs[1]);
+				std::lock_guard<std::mutex> lock(progressiveMutex);
+				progressiveWorker = std::thread(&BasicImageSourceModel::runProgressive, this, deadlineTime, snapshotInterval, onSnapshot);
 			}
-			{
-				Filter filter = Filter(Filter::filterType::BPF, 250, 500);
-				filter.convolveToSignal(irs[2]);
+
+			// Whatever is there at the deadline, never later.
+			std::unique_lock<std::mutex> lock(snapshotMutex);
+			snapshotPublished.wait_until(lock, deadlineTime, [this]() { return snapshot.complete; });
+			return snapshot;
+		}
+
+		template<size_t N>
+		typename BasicImageSourceModel<N>::Snapshot BasicImageSourceModel<N>::getSnapshot() const
+		{
+			std::lock_guard<std::mutex> lock(snapshotMutex);
+			return snapshot;
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::waitProgressive() const
+		{
+			std::lock_guard<std::mutex> lock(progressiveMutex);
+			if (progressiveWorker.joinable()) progressiveWorker.join();
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::cancelProgressive()
+		{
+			progressiveCancelled = true;
+			waitProgressive();
+			progressiveCancelled = false;
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::runProgressive(std::chrono::steady_clock::time_point deadline, std::chrono::milliseconds snapshotInterval, SnapshotCallback onSnapshot)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now(), lastSnapshot = start;
+			if (!imageSourcesValid)
+				computeImageSources();
+			updateListenerOffsets();
+
+			// Bucket every axis by reflection order. reach[axis] is the highest order with an entry inside the IR.
+			double limit = (double)getImageSourceLength() * (double)getImageSourceLength();
+			unsigned int reach[3];
+			for (int axis = 0; axis < 3; axis++) {
+				const std::vector<unsigned int>& orders = imageSourceAxes[axis].orders;
+				unsigned int maxOrder = orders.empty() ? 0 : *std::max_element(orders.begin(), orders.end());
+				std::vector<size_t>& begin = orderStart[axis];
+				begin.assign((size_t)maxOrder + 2, 0);
+				for (unsigned int entryOrder : orders) begin[(size_t)entryOrder + 1]++;
+				for (size_t o = 1; o < begin.size(); o++) begin[o] += begin[o - 1];
+				std::vector<size_t> cursor(begin.begin(), begin.end() - 1);
+				orderEntries[axis].resize(orders.size());
+				for (unsigned int i = 0; i < (unsigned int)orders.size(); i++) orderEntries[axis][cursor[orders[i]]++] = i;
+
+				std::vector<double>& minimum = orderReach[axis];
+				minimum.assign((size_t)maxOrder + 2, limit);
+				for (size_t o = maxOrder + 1; o-- > 0;) {
+					minimum[o] = minimum[o + 1];
+					for (size_t i = begin[o]; i < begin[o + 1]; i++) {
+						double offset = listenerOffsets[axis][orderEntries[axis][i]];
+						minimum[o] = std::min(minimum[o], offset * offset);
+					}
+				}
+				reach[axis] = 0;
+				while (reach[axis] + 1 <= maxOrder && minimum[reach[axis] + 1] < limit) reach[axis]++;
 			}
-			{
-				Filter filter = Filter(Filter::filterType::BPF, 500, 1000);
-				filter.convolveToSignal(irs[3]);
+
+			unsigned int nThreads = renderPool->getThreadCount();
+			workerIRs.resize(nThreads);
+			for (WorkerIRs& result : workerIRs) clearWorkerIRs(result);
+			// Accumulated over every snapshot from here on.
+			workerIRsCleared = false;
+
+			Snapshot progress;
+			std::vector<std::array<unsigned int, 3>> orderTriples;
+			std::vector<size_t> imageCounts(nThreads);
+			unsigned int lastOrder = reach[0] + reach[1] + reach[2];
+			bool deadlinePassed = false;
+			for (unsigned int order = 0; order <= lastOrder; order++) {
+				// All axis order combinations adding up to this order that can reach the listener in time.
+				orderTriples.clear();
+				for (unsigned int ox = 0; ox <= std::min(order, reach[0]); ox++) {
+					unsigned int rest = order - ox;
+					for (unsigned int oy = rest > reach[2] ? rest - reach[2] : 0; oy <= std::min(rest, reach[1]); oy++) {
+						unsigned int oz = rest - oy;
+						if (orderReach[0][ox] + orderReach[1][oy] + orderReach[2][oz] < limit)
+							orderTriples.push_back({ ox, oy, oz });
+					}
+				}
+
+				renderPool->run([this, &orderTriples, &imageCounts](unsigned int thread, unsigned int nThreads) {
+					for (size_t i = thread; i < orderTriples.size() && !progressiveCancelled; i += nThreads)
+						imageCounts[thread] += renderOrders(orderTriples[i], workerIRs[thread]);
+				});
+				if (progressiveCancelled) return;
+
+				progress.order = order;
+				progress.imageCount = 0;
+				for (size_t count : imageCounts) progress.imageCount += count;
+				if (order == lastOrder) break;
+				std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+				bool atDeadline = !deadlinePassed && now >= deadline;
+				if (atDeadline || now - lastSnapshot >= snapshotInterval) {
+					deadlinePassed = deadlinePassed || atDeadline;
+					progress.elapsed = std::chrono::duration<double, std::milli>(now - start).count();
+					publishSnapshot(progress, onSnapshot, false);
+					// From the end of the publish, so filtering never takes over the render.
+					lastSnapshot = std::chrono::steady_clock::now();
+				}
 			}
-			{
-				Filter filter = Filter(Filter::filterType::BPF, 1000, 2000);
-				filter.convolveToSignal(irs[4]);
+			progress.elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			publishSnapshot(progress, onSnapshot, true);
+		}
+
+		template<size_t N>
+		size_t BasicImageSourceModel<N>::renderOrders(const std::array<unsigned int, 3>& orders, WorkerIRs& result)
+		{
+			size_t count = 0;
+			double Rp_plus_Rm[3];
+			float signs[3];
+			alignas(simd::wide::alignment) float reflections[bandStride];
+			double limit = (double)getImageSourceLength() * (double)getImageSourceLength();
+			const std::vector<unsigned int>& xEntries = orderEntries[0], &yEntries = orderEntries[1], &zEntries = orderEntries[2];
+			for (size_t i = orderStart[0][orders[0]]; i < orderStart[0][orders[0] + 1]; i++) {
+				unsigned int x = xEntries[i];
+				Rp_plus_Rm[0] = listenerOffsets[0][x];
+				signs[0] = imageSourceAxes[0].signs[x];
+				if (Rp_plus_Rm[0] * Rp_plus_Rm[0] >= limit) continue;
+
+				for (size_t j = orderStart[1][orders[1]]; j < orderStart[1][orders[1] + 1]; j++) {
+					unsigned int y = yEntries[j];
+					Rp_plus_Rm[1] = listenerOffsets[1][y];
+					signs[1] = imageSourceAxes[1].signs[y];
+					double xy = Rp_plus_Rm[0] * Rp_plus_Rm[0] + Rp_plus_Rm[1] * Rp_plus_Rm[1];
+					if (xy >= limit) continue;
+					MultiplyBands(imageSourceAxes[0].getGains(x), imageSourceAxes[1].getGains(y), reflections, bandStride);
+
+					for (size_t k = orderStart[2][orders[2]]; k < orderStart[2][orders[2] + 1]; k++) {
+						unsigned int z = zEntries[k];
+						Rp_plus_Rm[2] = listenerOffsets[2][z];
+						signs[2] = imageSourceAxes[2].signs[z];
+						double squaredDistance = xy + Rp_plus_Rm[2] * Rp_plus_Rm[2];
+						if (squaredDistance >= limit) continue;
+						addImage(Rp_plus_Rm, squaredDistance, reflections, imageSourceAxes[2].getGains(z), signs, result);
+						count++;
+					}
+				}
 			}
+			return count;
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::publishSnapshot(Snapshot& progress, const SnapshotCallback& onSnapshot, bool complete)
+		{
+			// The worker IRs keep accumulating, irs and output are rebuilt from them for every snapshot.
+			reduceWorkerIRs();
+			if (getTransitionSamples() > 0)
+				addLateTail();
+			if (complete) {
+				computeTail();
+			}
+			else {
+				synthesiseOutput();
+				normaliseOutput();
+			}
+			progress.complete = complete;
+			progress.output = output;
+			progress.ambisonic = ambisonicOutput;
+			progress.binaural = binauralOutput;
+			for (size_t bin = 0; bin < N; bin++) progress.bands[bin] = irs[bin];
+			// Handled before renderProgressive can return it.
+			if (onSnapshot) onSnapshot(progress);
 			{
-				Filter filter = Filter(Filter::filterType::BPF, 2000, 20000);
-				filter.convolveToSignal(irs[5]);
+				std::lock_guard<std::mutex> lock(snapshotMutex);
+				snapshot = progress;
 			}
+			snapshotPublished.notify_all();
+		}
 
-			output.clear();
-			output.resize(irs[0].size());
-			for (int value = 0; value < output.size(); value++)
-				output[value] = irs[0][value] + irs[1][value] + irs[2][value] + irs[3][value] + irs[4][value] + irs[5][value];
 
-			NormaliseSignal(output);
+		template<size_t N>
+		void BasicImageSourceModel<N>::computeTail()
+		{
+			for (size_t i = 0; i < N; i++)
+				WriteAudioFile({ irs[i] }, "frequency_bin_" + std::to_string(i) + ".wav", samplingFrequency / bandDecimation[i]);
+			synthesiseOutput();
+			normaliseOutput();
 			WriteAudioFile({ output }, "ir.wav", samplingFrequency);
+			if (!ambisonicOutput.empty())
+				WriteAudioFile(ambisonicOutput, "ir_ambisonic.wav", samplingFrequency, AudioSampleFormat::Float32);
+			if (!binauralOutput.empty())
+				WriteAudioFile(binauralOutput, "ir_binaural.wav", samplingFrequency, AudioSampleFormat::Float32);
 		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::synthesiseOutput()
+		{
+			synthesiseBands(irs, output, *filterBank);
+			// Wave solver bands are swapped in after filtering, and the sum corrected to match. The solver only
+			// gives pressure, so this is W; the higher ambisonic channels and the ears keep their geometric bands.
+			for (size_t bin = 0; waveBands && bin < std::min(waveBands->size(), N); bin++) {
+				const Signal& band = (*waveBands)[bin];
+				for (size_t n = 0; n < output.size(); n++) {
+					Sample value = n < band.size() ? band[n] : Sample();
+					output[n] += value - irs[bin][n];
+					irs[bin][n] = value;
+				}
+			}
+			ambisonicOutput.resize(ambisonicIRs.empty() ? 0 : ambisonicIRs.size() + 1);
+			for (size_t channel = 1; channel < ambisonicOutput.size(); channel++)
+				synthesiseBands(ambisonicIRs[channel - 1], ambisonicOutput[channel], *filterBank);
+
+			binauralOutput.resize(binauralIRs.size());
+			if (binauralIRs.empty()) return;
+			if (multirateBands && !fullRateFilterBank) {
+				const std::array<std::array<float, 2>, N>& edges = BandEdges<N>();
+				fullRateFilterBank = createFilterBank(bandFilterType, std::vector<std::array<float, 2>>(edges.begin(), edges.end()), (float)samplingFrequency, false);
+			}
+			for (size_t ear = 0; ear < binauralIRs.size(); ear++)
+				synthesiseBands(binauralIRs[ear], binauralOutput[ear], multirateBands ? *fullRateFilterBank : *filterBank);
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::synthesiseBands(std::array<Signal, N>& bands, Signal& result, IFilterBank& bank) const
+		{
+			filterBands(bands, bank, (size_t)nSamples);
+			sumBands(bands, result);
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::filterBands(std::array<Signal, N>& bands, IFilterBank& bank, size_t length) const
+		{
+			bank.process(bands);
+			// Band-limited at the low rates, so the interpolators only have to reject images.
+			for (size_t bin = 0; bin < N; bin++) {
+				if (!interpolators[bin] || bank.getDecimation(bin) == 1) continue;
+				Signal decimated;
+				decimated.swap(bands[bin]);
+				interpolators[bin]->process(decimated, bands[bin], std::min(length, decimated.size() * bank.getDecimation(bin)));
+			}
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::sumBands(const std::array<Signal, N>& bands, Signal& result) const
+		{
+			result.clear();
+			result.resize(bands[0].size());
+			for (size_t bin = 0; bin < N; bin++)
+				for (size_t value = 0; value < result.size(); value++)
+					result[value] += bands[bin][value];
+		}
+
+		template<size_t N>
+		void BasicImageSourceModel<N>::normaliseOutput()
+		{
+			// The ambisonic and binaural channels keep their levels relative to W.
+			Sample peak = 0;
+			for (Sample sample : output) peak = std::max(peak, std::abs(sample));
+			NormaliseSignal(output);
+			if (peak <= 0) return;
+			Sample gain = Sample(0.9) / peak;
+			if (!ambisonicOutput.empty()) ambisonicOutput[0] = output;
+			for (size_t channel = 1; channel < ambisonicOutput.size(); channel++)
+				for (Sample& sample : ambisonicOutput[channel]) sample *= gain;
+			for (Signal& ear : binauralOutput)
+				for (Sample& sample : ear) sample *= gain;
+		}
+
+
+		template class BasicImageSourceModel<6>;
+		template class BasicImageSourceModel<10>;
+		template class BasicImageSourceModel<31>;
 	}
 }
\ No newline at end of file
@@ -1,10 +1,17 @@
 #pragma once
 
 #include "Acoustics.h"
+#include "Ambisonics.h"
+#include "HRTF.h"
+#include "Directivity.h"
 #include "DSP.h"
+#include "LateReverb.h"
+#include "RayTracer.h"
 #include "../utils/Maths.h"
 #include "../utils/Settings.h"
 #include "../utils/Utils.h"
+#include "../utils/SIMD.h"
+#include "../utils/WorkerPool.h"
 #include <queue>
 #include <mutex>
 
@@ -17,6 +24,12 @@
 #include <functional>
 #include <math.h>
 #include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <condition_variable>
+#include <random>
+#include <memory>
 
 
 #define ROUND(x) ((x) >= 0 ? (long)((x) + 0.5) : (long)((x) - 0.5))
@@ -30,16 +43,89 @@ namespace unda {
 			0 ? true : false;
 		}
 
-		class ImageSourceModel {
+		// One axis of the shoebox image lattice. Image sources are separable, so they're cached as entries per axis.
+		struct ImageSourceAxis {
+			std::vector<double> positions;				// in samples (metres / timeStep)
+			simd::AlignedVector<float> gains;			// reflection product of the two walls normal to the axis, bandStride per entry
+			std::vector<unsigned int> orders;			// number of those reflections, |x - q| + |x|
+			std::vector<float> signs;					// -1 where that number is odd, the image mirrored along the axis
+			size_t bandStride = 0;
+			const float* getGains(size_t entry) const { return &gains[entry * bandStride]; }
+		};
+
+		// Best-so-far result of a progressive render.
+		template<size_t N>
+		struct BasicImageSourceSnapshot {
+			unsigned int order = 0;			// every image up to this reflection order is included
+			size_t imageCount = 0;
+			double elapsed = 0;				// ms since the render started
+			bool complete = false;
+			Signal output;					// normalised, as getOutput()
+			std::array<Signal, N> bands;	// band-limited, at samplingFrequency
+			std::vector<Signal> ambisonic;	// ACN / SN3D, as getAmbisonicOutput(), empty unless enabled
+			std::vector<Signal> binaural;	// left and right, as getBinauralOutput(), empty unless enabled
+		};
+		template<size_t N> using BasicSnapshotCallback = std::function<void(const BasicImageSourceSnapshot<N>&)>;
+
+		// Shoebox image source model over the N bands of BandEdges<N>, with surface reflection coefficients
+		// per face and band. Instantiated for 6 (ImageSourceModel), 10 octave and 31 third-octave bands.
+		template<size_t N>
+		class BasicImageSourceModel {
 		public:
-			ImageSourceModel(const std::array<double, 3>& _spaceDimensions, const std::array<double, 3>& _sourcePosition,
-							 const std::array<double, 3>& _receiverPosition, std::array<std::array<double, 6>, 6>& _surfaceReflection, int _nSamples = 0, unsigned int order=2);
-			~ImageSourceModel() = default;
+			static constexpr size_t nBands = N;
+			typedef BasicImageSourceSnapshot<N> Snapshot;
+			typedef BasicSnapshotCallback<N> SnapshotCallback;
+
+			BasicImageSourceModel(const std::array<double, 3>& _spaceDimensions, const std::array<double, 3>& _sourcePosition,
+								  const std::array<double, 3>& _receiverPosition, std::array<std::array<double, N>, 6>& _surfaceReflection, int _nSamples = 0, unsigned int order=2);
+			~BasicImageSourceModel();
 
-			std::array<Signal, 6> getIRs() { return irs; }
+			// The render's results wait for a progressive render to finish (not from onSnapshot, which runs on it).
+			std::array<Signal, N> getIRs() const { waitProgressive(); return irs; }
+			const Signal& getOutput() const { waitProgressive(); return output; }
+			// IR length in samples, _nSamples or, if that was 0, the T60 rounded up to whole seconds.
+			int getSampleCount() const { return nSamples; }
+			// ACN / SN3D channels, W being getOutput(). Empty unless setAmbisonicOrder was given an order.
+			const std::vector<Signal>& getAmbisonicOutput() const { waitProgressive(); return ambisonicOutput; }
+			// Left and right, normalised by the same gain as getOutput(). Empty unless setHRTF was given a set.
+			const std::vector<Signal>& getBinauralOutput() const { waitProgressive(); return binauralOutput; }
+			const std::array<ImageSourceAxis, 3>& getImageSources() const { waitProgressive(); return imageSourceAxes; }
 
 			void dispatchCPUThreads();
 			void updateParameters();
+			// Fast path for a fixed source: re-renders the output from the cached image sources. In hybrid mode with
+			// FIR bands and a Noise or FDN tail only the early part is filtered, the tail's filtered shape is cached.
+			void setListenerPosition(const std::array<double, 3>& newPosition);
+			// Multirate renders and filters every band at the lowest power of two rate its upper edge allows
+			// (FIR only), then interpolates back to samplingFrequency before the bands are summed.
+			void setBandFilterType(BandFilterType type, bool multirate = false);
+			// Encodes every image source by its arrival direction, front -z and left -x. 0 is mono only.
+			void setAmbisonicOrder(unsigned int order);
+			unsigned int getAmbisonicOrder() const { return ambisonicOrder; }
+			// Adds every image source's HRIR pair by its arrival direction, axes as for ambisonics. nullptr is off.
+			void setHRTF(std::shared_ptr<const HRTFSet> _hrtf);
+			std::shared_ptr<const HRTFSet> getHRTF() const { return hrtf; }
+			// Weights every image source by the balloon's gains in the direction it left the source. nullptr is omni.
+			void setSourceDirectivity(std::shared_ptr<const BasicSourceDirectivity<N>> _directivity);
+
+			// Hybrid mode: image sources up to the transition, then a late tail per band decaying at its Sabine T60.
+			// The earlier of transitionTime and transitionOrder (by the mean free path) wins, 0 is off.
+			void setHybridTransition(double transitionTime, unsigned int transitionOrder = 0, LateTailModel model = LateTailModel::Noise);
+			// Energy histogram for the RayTraced and RadianceTransfer tails, which fall back to Noise until it's set.
+			void setLateField(std::shared_ptr<const BasicEnergyHistogram<N>> _lateField);
+			// Low band IRs from BasicFDTDSolver replacing the mono output's (W's) geometric ones. nullptr is off.
+			void setWaveBands(std::shared_ptr<const std::vector<Signal>> bands);
+			// In samples at samplingFrequency, 0 if not hybrid.
+			int getTransitionSamples() const;
+
+			// Renders by increasing reflection order in the background and returns the best snapshot at the deadline,
+			// an empty one (no output) if none was published by then. onSnapshot runs on the render thread.
+			// The getters above wait for the render, getSnapshot doesn't, and any other call cancels it.
+			Snapshot renderProgressive(std::chrono::milliseconds deadline, std::chrono::milliseconds snapshotInterval = std::chrono::milliseconds(0),
+												  SnapshotCallback onSnapshot = nullptr);
+			Snapshot getSnapshot() const;
+			void waitProgressive() const;
+			void cancelProgressive();
 
 
 		private:
@@ -48,20 +134,89 @@ namespace unda {
 			// Acoustic parameters
 			double meanFreePathEstimate = 0;
 			double t_60 = 0;
+			std::array<double, N> frequencyDependentT60{};
+
+			// Hybrid late tail
+			double transitionTime = 0;
+			unsigned int transitionOrder = 0;
+			LateTailModel lateTailModel = LateTailModel::Noise;
+			std::shared_ptr<const BasicEnergyHistogram<N>> lateField;
+			std::shared_ptr<const std::vector<Signal>> waveBands;
+			static constexpr unsigned int lateTailSeed = 0x5eed;
+			// Image sources are rendered for arrivals below this many samples.
+			int getImageSourceLength() const { return getTransitionSamples() > 0 ? std::min(getTransitionSamples(), nSamples) : nSamples; }
+			bool isLateTailFromHistogram() const { return (lateTailModel == LateTailModel::RayTraced || lateTailModel == LateTailModel::RadianceTransfer) && lateField; }
+			// Band bin's tail from transition (at the band rate) on, matched to the image sources in irs[bin].
+			struct LateTailLevel {
+				size_t transition = 0;
+				double decay = 0, envelope = 0, offset = 0;
+				bool active = false;
+			};
+			LateTailLevel matchLateTail(size_t bin) const;
+			// The network's band responses and the sample they're taken from, for the FDN model.
+			size_t renderFDNResponses(std::array<Signal, N>& responses) const;
+			// Adds band bin's tail to channels, laid out as getChannelIRs, skipping null ones.
+			void addLateTail(size_t bin, LateTailLevel level, const std::array<Signal, N>& fdnResponses, size_t fdnStart, const std::vector<std::array<Signal, N>*>& channels);
+			void addLateTail();
+
+			// Split synthesis for listener moves. The tail's shape only depends on the room, so it's kept filtered
+			// at unit level per channel and band, and channel 0's decaying mean at unit offset. A move filters
+			// the early part through banks of its own (sized for it) and adds the shapes at the matched levels.
+			std::vector<std::array<Signal, N>> lateTailShapes;
+			std::array<Signal, N> lateTailOffsets;
+			std::unique_ptr<IFilterBank> earlyFilterBank, earlyFullRateFilterBank;
+			bool canSplitLateTail() const;
+			void buildLateTailCache();
+			void synthesiseSplit();
+			// The samples of band bin, at its rate in bank, that hold the arrivals and the filter's response to them.
+			size_t getEarlyLength(size_t channel, size_t bin, const IFilterBank& bank) const;
 
 			// X, Y and Z space imensions in metres
 			long double totalSurface = 0.0;
-			const std::array<double, 3>& spaceDimensions;
-			std::array<std::array<double, 6>, 6>& surfaceReflection; // F_cubeFace x Coeff_frequencyBin 
+			std::array<double, 3> spaceDimensions;
+			std::array<std::array<double, N>, 6> surfaceReflection; // F_cubeFace x Coeff_frequencyBin 
 			std::array<double, 3> sourcePosition;
 			std::array<double, 3> receiverPosition;
 			std::array<double, 2> microphoneAngle{ 0, 0 };
 
+			// Band filters, designed once per model and reused for every listener.
+			std::unique_ptr<IFilterBank> filterBank;
+			BandFilterType bandFilterType = BandFilterType::FIR;
+			bool multirateBands = false;
+			// Band i is rendered at samplingFrequency / bandDecimation[i].
+			std::array<unsigned int, N> bandDecimation, decimationShift;
+			std::array<std::unique_ptr<PolyphaseInterpolator>, N> interpolators;
+			size_t getBandLength(size_t bin) const { return ((size_t)nSamples + bandDecimation[bin] - 1) / bandDecimation[bin]; }
+
 			// Impulse Response Data
-			// Frequency-dependent RIRs - [125 - 250, 250 - 500, 500 - 1000, 1000 - 2000, 2000 - 4000, 6000 - 12000]
-			std::array<Signal, 6> irs;
+			// Frequency-dependent RIRs, at the band rates until computeTail brings them to samplingFrequency - BandEdges<N>()
+			std::array<Signal, N> irs;
 			Signal output;
 
+			// Ambisonic band IRs of ACN channels 1 and up, irs being channel 0, and their outputs from W on.
+			unsigned int ambisonicOrder = 0;
+			std::vector<std::array<Signal, N>> ambisonicIRs;
+			std::vector<Signal> ambisonicOutput;
+			size_t getAmbisonicChannelCount() const { return ambisonicOrder > 0 ? AmbisonicChannelCount(ambisonicOrder) : 1; }
+
+			// Binaural band IRs per ear, always at samplingFrequency, filtered by a full rate filter bank.
+			std::shared_ptr<const HRTFSet> hrtf;
+			std::vector<std::array<Signal, N>> binauralIRs;
+			std::vector<Signal> binauralOutput;
+			std::unique_ptr<IFilterBank> fullRateFilterBank;
+
+			std::shared_ptr<const BasicSourceDirectivity<N>> directivity;
+
+			// Accumulated channels: irs, the ambisonic channels past W, then the ears.
+			size_t getChannelCount() const { return getAmbisonicChannelCount() + (hrtf ? 2 : 0); }
+			size_t getChannelLength(size_t channel, size_t bin) const { return channel < getAmbisonicChannelCount() ? getBandLength(bin) : (size_t)nSamples; }
+			// The part of it arrivals before getImageSourceLength() can reach, with their taps.
+			size_t getRenderedLength(size_t channel, size_t bin) const;
+			std::array<Signal, N>& getChannelIRs(size_t channel) {
+				if (channel == 0) return irs;
+				return channel < getAmbisonicChannelCount() ? ambisonicIRs[channel - 1] : binauralIRs[channel - getAmbisonicChannelCount()];
+			}
+
 			// Acoustic Volume variables
 			unsigned int order = 2;
 			double samplingFrequency = unda::sampleRate;
@@ -71,14 +226,80 @@ namespace unda {
 			double listener[3] { 0 };
 			double room[3] { 0 };
 
-			void computeReflections(int x, int y, int z);
+			// Image source cache, valid as long as the source, room and coefficients are unchanged.
+			std::array<ImageSourceAxis, 3> imageSourceAxes;
+			static constexpr size_t bandStride = simd::wide::roundUp(N);
+			bool imageSourcesValid = false;
+			// Per listener: axis entries sorted by distance to the listener, with their offsets.
+			std::array<std::vector<unsigned int>, 3> nearestEntries;
+			std::array<std::vector<double>, 3> listenerOffsets;
 
-			// Thread workers
-			std::vector<std::thread> workers;
+			void computeImageSources();
+			void updateListenerOffsets();
+			// Windowed-sinc table placing arrivals at their exact distance, Blackman with unit DC gain.
+			static constexpr size_t fractionalPhases = 64, fractionalTaps = 16, tapOffset = fractionalTaps / 2 - 1;
+			simd::AlignedVector<float> fractionalDelay;	// fractionalPhases x fractionalTaps
+			void designFractionalDelay();
+
+			// One render thread's band IRs per channel, offset by tapOffset and padded for the arrivals' taps.
+			struct WorkerIRs {
+				std::array<Signal, N> bands;
+				std::vector<std::array<Signal, N>> ambisonic;
+				std::vector<std::array<Signal, N>> binaural;
+				simd::AlignedVector<float> hrirs;	// left and right of the arrival being added
+				std::array<Signal, N>& getChannel(size_t channel) {
+					if (channel == 0) return bands;
+					return channel <= ambisonic.size() ? ambisonic[channel - 1] : binaural[channel - 1 - ambisonic.size()];
+				}
+			};
+			// gains and zGains are bandStride wide and aligned, signs are the axes' mirror signs of the image.
+			void addImage(const double offset[3], double squaredDistance, const float* gains, const float* zGains, const float signs[3], WorkerIRs& result) const;
+			void computeReflections(unsigned int x, WorkerIRs& result);
+			void renderImageSources();
+			// Sums the workers' IRs into the channels, zeroing the workers' as it goes if clear.
+			void reduceWorkerIRs(bool clear = false);
+
+			// Progressive rendering
+			mutable std::thread progressiveWorker;
+			mutable std::mutex progressiveMutex;	// for joining it
+			std::atomic<bool> progressiveCancelled{ false };
+			mutable std::mutex snapshotMutex;
+			std::condition_variable snapshotPublished;
+			Snapshot snapshot;
+			// Per axis, entries grouped by reflection order: orderEntries[orderStart[o]..orderStart[o + 1]),
+			// and the smallest squared listener offset of any order >= o, to prune whole orders.
+			std::array<std::vector<unsigned int>, 3> orderEntries;
+			std::array<std::vector<size_t>, 3> orderStart;
+			std::array<std::vector<double>, 3> orderReach;
+			void runProgressive(std::chrono::steady_clock::time_point deadline, std::chrono::milliseconds snapshotInterval, SnapshotCallback onSnapshot);
+			size_t renderOrders(const std::array<unsigned int, 3>& orders, WorkerIRs& result);
+			void publishSnapshot(Snapshot& progress, const SnapshotCallback& onSnapshot, bool complete);
+
+			// Thread workers, kept for every render rather than started each time.
+			std::unique_ptr<utils::WorkerPool> renderPool;
+			std::vector<WorkerIRs> workerIRs;
+			bool workerIRsCleared = false;
+			unsigned int getThreadCount() const;
+			void clearWorkerIRs(WorkerIRs& result) const;
+			void synthesiseOutput();
+			void synthesiseBands(std::array<Signal, N>& bands, Signal& result, IFilterBank& bank) const;
+			// Filters bands in place and brings them to samplingFrequency, at most length samples.
+			void filterBands(std::array<Signal, N>& bands, IFilterBank& bank, size_t length) const;
+			void sumBands(const std::array<Signal, N>& bands, Signal& result) const;
+			void normaliseOutput();
 			void computeTail();
 
-			DISABLE_COPY_ASSIGN(ImageSourceModel)
+			DISABLE_COPY_ASSIGN(BasicImageSourceModel)
 		};
+		typedef BasicImageSourceModel<6> ImageSourceModel;
+		typedef BasicImageSourceModel<10> OctaveImageSourceModel;
+		typedef BasicImageSourceModel<31> ThirdOctaveImageSourceModel;
+		typedef BasicImageSourceSnapshot<6> ImageSourceSnapshot;
+		typedef BasicSnapshotCallback<6> SnapshotCallback;
+
+		extern template class BasicImageSourceModel<6>;
+		extern template class BasicImageSourceModel<10>;
+		extern template class BasicImageSourceModel<31>;
 
 
 		class GPUImageSourceModel : public ImageSourceModel {
@@ -1,41 +1,157 @@
 #include "LateReverb.h"
 
 namespace unda {
-	void generateTail(float* input, float* output, size_t nSamples, size_t nAllPassFilters)
+	template<size_t N>
+	BasicFDNReverb<N>::BasicFDNReverb(const std::array<double, nBands>& t60, float _fs, size_t _blockSize)
+		: fs(_fs)
+		, blockSize(_blockSize)
+		, crossover(std::vector<std::array<float, 2>>(acoustics::BandEdges<N>().begin(), acoustics::BandEdges<N>().end()), _fs, _blockSize)
 	{
- //       {
- //           float outL, outR, input;
- //           int i;
-
- //           while (nSamples-- > 0)
- //           {
- //               outL = outR = 0;
- //               input = (*inputL + *inputR) * gain;
-
- //               // Accumulate comb filters in parallel
- //               for (i = 0; i < numcombs; i++) {
- //                   outL += combL[i].process(input);
- //                   outR += combR[i].process(input);
- //               }
-
- //               // Feed through allpasses in series
- //               for (i = 0; i < nAllPassFilters; i++) {
- //                   outL = allpassL[i].process(outL);
- //                   outR = allpassR[i].process(outR);
- //               }
-
- //               // Calculate output REPLACING anything already there
- //               output 
- //               //*outputL = outL * wet1 + outR * wet2 + *inputL * dry;
- //               //*outputR = outR * wet1 + outL * wet2 + *inputR * dry;
-
- //               // Increment sample pointers, allowing for interleave 
- //               // (if any)
- //               inputL += skip; // For stereo buffers, skip = 2
- //               inputR += skip;
- //               outputL += skip;
- //               outputR += skip;
- //           }
- //       }
+		UNDA_ASSERT(fs > 0 && blockSize > 0);
+		size_t total = 0;
+		for (size_t line = 0; line < nLines; line++) {
+			combOffset[line] = total;
+			total += combDelays[line] * nLanes;
+		}
+		for (size_t stage = 0; stage < nAllPasses; stage++) {
+			allPassOffset[stage] = total;
+			total += allPassDelays[stage] * nLanes;
+		}
+		delayLines.assign(total, 0.0f);
+		combGains.assign(nLines * nLanes, 0.0f);
+		for (Signal& band : bandBlock) band.assign(blockSize, 0.0f);
+		laneBlock.assign(blockSize * nLanes, 0.0f);
+		setDecay(t60);
 	}
+
+	template<size_t N>
+	void BasicFDNReverb<N>::setDecay(const std::array<double, nBands>& t60)
+	{
+		for (size_t line = 0; line < nLines; line++) {
+			for (size_t band = 0; band < nBands; band++) {
+				UNDA_ASSERT(t60[band] > 0);
+				combGains[line * nLanes + band] = (float)pow(10.0, -3.0 * (double)combDelays[line] / (t60[band] * (double)fs));
+			}
+		}
+	}
+
+	template<size_t N>
+	void BasicFDNReverb<N>::reset()
+	{
+		std::fill(delayLines.begin(), delayLines.end(), 0.0f);
+		combPosition.fill(0);
+		allPassPosition.fill(0);
+		crossover.reset();
+	}
+
+	template<size_t N>
+	void BasicFDNReverb<N>::processBlock(const float* input, size_t nFrames)
+	{
+		// Band split into lanes
+		std::array<const float*, nBands> inputs;
+		std::array<float*, nBands> outputs;
+		for (size_t band = 0; band < nBands; band++) {
+			inputs[band] = input;
+			outputs[band] = bandBlock[band].data();
+		}
+		crossover.process(inputs.data(), outputs.data(), nFrames);
+		for (size_t n = 0; n < nFrames; n++)
+			for (size_t lane = 0; lane < nLanes; lane++)
+				laneBlock[n * nLanes + lane] = lane < nBands ? bandBlock[lane][n] : 0.0f;
+
+		const simd::float4 g = simd::set(allPassGain), minusG = simd::set(-allPassGain);
+		const simd::float4 mixScale = simd::set(1.0f / sqrtf((float)nLines));
+		float* lines = delayLines.data();
+		for (size_t n = 0; n < nFrames; n++) {
+			float* frame = &laneBlock[n * nLanes];
+			for (size_t group = 0; group < nGroups; group++) {
+				size_t lane = group * simd::width;
+				simd::float4 x = simd::load(frame + lane);
+
+				// Allpasses: w[n] = x[n] + g w[n - M], y[n] = w[n - M] - g w[n]
+				for (size_t stage = 0; stage < nAllPasses; stage++) {
+					float* tap = lines + allPassOffset[stage] + allPassPosition[stage] * nLanes + lane;
+					simd::float4 delayed = simd::load(tap);
+					simd::float4 w = simd::madd(g, delayed, x);
+					simd::store(tap, w);
+					x = simd::madd(minusG, w, delayed);
+				}
+
+				// Combs, mixed by an 8 x 8 Hadamard (three butterfly stages) and fed back with the input.
+				simd::float4 v[nLines], sum = simd::zero();
+				for (size_t line = 0; line < nLines; line++) {
+					v[line] = simd::load(lines + combOffset[line] + combPosition[line] * nLanes + lane);
+					sum = simd::add(sum, v[line]);
+					v[line] = simd::mul(v[line], simd::load(&combGains[line * nLanes + lane]));
+				}
+				for (size_t span = 1; span < nLines; span *= 2) {
+					for (size_t first = 0; first < nLines; first += 2 * span) {
+						for (size_t line = first; line < first + span; line++) {
+							simd::float4 a = v[line], b = v[line + span];
+							v[line] = simd::add(a, b);
+							v[line + span] = simd::sub(a, b);
+						}
+					}
+				}
+				for (size_t line = 0; line < nLines; line++)
+					simd::store(lines + combOffset[line] + combPosition[line] * nLanes + lane, simd::madd(v[line], mixScale, x));
+				simd::store(frame + lane, simd::mul(sum, mixScale));
+			}
+			for (size_t stage = 0; stage < nAllPasses; stage++)
+				if (++allPassPosition[stage] == allPassDelays[stage]) allPassPosition[stage] = 0;
+			for (size_t line = 0; line < nLines; line++)
+				if (++combPosition[line] == combDelays[line]) combPosition[line] = 0;
+		}
+	}
+
+	template<size_t N>
+	void BasicFDNReverb<N>::process(const float* input, float* output, size_t nFrames)
+	{
+		simd::DenormalGuard denormalGuard;
+		for (size_t first = 0; first < nFrames; first += blockSize) {
+			size_t length = std::min(blockSize, nFrames - first);
+			processBlock(input + first, length);
+			for (size_t n = 0; n < length; n++) {
+				const float* frame = &laneBlock[n * nLanes];
+				simd::float4 sum = simd::load(frame);
+				for (size_t group = 1; group < nGroups; group++)
+					sum = simd::add(sum, simd::load(frame + group * simd::width));
+				output[first + n] = simd::hsum(sum);
+			}
+		}
+	}
+
+	template<size_t N>
+	void BasicFDNReverb<N>::processBands(const float* input, float* const* bandOutput, size_t nFrames)
+	{
+		simd::DenormalGuard denormalGuard;
+		for (size_t first = 0; first < nFrames; first += blockSize) {
+			size_t length = std::min(blockSize, nFrames - first);
+			processBlock(input + first, length);
+			for (size_t n = 0; n < length; n++)
+				for (size_t band = 0; band < nBands; band++)
+					bandOutput[band][first + n] = laneBlock[n * nLanes + band];
+		}
+	}
+
+	template<size_t N>
+	std::array<Signal, BasicFDNReverb<N>::nBands> BasicFDNReverb<N>::renderBandImpulseResponses(size_t length)
+	{
+		reset();
+		Signal impulse(length, 0.0f);
+		if (length > 0) impulse[0] = 1.0f;
+		std::array<Signal, nBands> responses;
+		std::array<float*, nBands> outputs;
+		for (size_t band = 0; band < nBands; band++) {
+			responses[band].resize(length);
+			outputs[band] = responses[band].data();
+		}
+		processBands(impulse.data(), outputs.data(), length);
+		reset();
+		return responses;
+	}
+
+	template class BasicFDNReverb<6>;
+	template class BasicFDNReverb<10>;
+	template class BasicFDNReverb<31>;
 }
\ No newline at end of file
@@ -1,6 +1,75 @@
 #pragma once
 
+#include "Acoustics.h"
+#include "DSP.h"
+#include "../utils/Settings.h"
+#include "../utils/Utils.h"
+#include "../utils/SIMD.h"
+#include <array>
+#include <vector>
+
 namespace unda {
-	void CombFilter();
-	void generateTail(float* input, float* output, size_t nSamples, size_t nAllPassFilters);
+
+	// Feedback delay network late reverb, with a decay per ISM band.
+	// The input is split by a CrossoverFilterBank and the bands run side by side in SIMD lanes through the
+	// same network: four Schroeder allpasses in series for echo density, then nLines feedback combs mixed
+	// by a Hadamard matrix. Every line's gain in band b is 10^(-3 * delay / (T60[b] * fs)), so band b
+	// decays by 60 dB over T60[b]. Lines are mixed lane-wise, so the matrix is adds and subtracts of whole
+	// registers. Delay lines are aligned, interleaved by lane, and all state is allocated up front:
+	// process never allocates and works through its input in blocks of blockSize.
+	// N is the band layout of acoustics::BandEdges, instantiated for 6, 10 and 31 bands.
+	template<size_t N>
+	class BasicFDNReverb {
+	public:
+		static constexpr size_t nLines = 8;
+		static constexpr size_t nAllPasses = 4;
+		static constexpr size_t nBands = N;
+
+		BasicFDNReverb(const std::array<double, nBands>& t60, float _fs = (float)unda::sampleRate, size_t _blockSize = unda::dspBlockSize);
+		~BasicFDNReverb() = default;
+
+		// Can be called between process calls, delays and state are kept.
+		void setDecay(const std::array<double, nBands>& t60);
+		void reset();
+
+		// Streaming, mono in and out. input and output may alias.
+		void process(const float* input, float* output, size_t nFrames);
+		// Streaming, one output per band (band-limited by the crossover).
+		void processBands(const float* input, float* const* bandOutput, size_t nFrames);
+		// Offline: impulse response per band, at fs.
+		std::array<Signal, nBands> renderBandImpulseResponses(size_t length);
+
+		// Longest line, before which the response is still building up.
+		size_t getMaximumDelay() const { return combDelays[nLines - 1]; }
+
+	private:
+		static constexpr size_t nLanes = simd::roundUp(nBands);
+		static constexpr size_t nGroups = nLanes / simd::width;
+		static constexpr std::array<size_t, nLines> combDelays = { 1433, 1601, 1867, 2053, 2251, 2399, 2687, 2917 };	// primes, 32 to 66 ms
+		static constexpr std::array<size_t, nAllPasses> allPassDelays = { 556, 441, 341, 225 };
+		static constexpr float allPassGain = 0.5f;
+
+		float fs;
+		size_t blockSize;
+		CrossoverFilterBank crossover;
+
+		// Delay lines, [delay][lane], each line aligned at its own offset into one buffer
+		simd::AlignedVector<float> delayLines;
+		std::array<size_t, nLines> combOffset{}, combPosition{};
+		std::array<size_t, nAllPasses> allPassOffset{}, allPassPosition{};
+		simd::AlignedVector<float> combGains;		// nLines x nLanes
+
+		// Block buffers
+		std::array<Signal, nBands> bandBlock;
+		simd::AlignedVector<float> laneBlock;		// blockSize x nLanes
+
+		void processBlock(const float* input, size_t nFrames);
+
+		DISABLE_COPY_ASSIGN(BasicFDNReverb);
+	};
+	typedef BasicFDNReverb<acoustics::bandEdges.size()> FDNReverb;
+
+	extern template class BasicFDNReverb<6>;
+	extern template class BasicFDNReverb<10>;
+	extern template class BasicFDNReverb<31>;
 }
\ No newline at end of file
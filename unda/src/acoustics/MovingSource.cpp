@@ -0,0 +1,227 @@
+#include "MovingSource.h"
+#include "../utils/Maths.h"
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+namespace unda {
+	namespace acoustics {
+		template<size_t N>
+		BasicMovingSourceRenderer<N>::BasicMovingSourceRenderer(const std::array<double, 3>& _spaceDimensions, const std::array<std::array<double, N>, 6>& _surfaceReflection,
+																unsigned int _order, size_t _controlInterval, double _samplingFrequency)
+			: spaceDimensions(_spaceDimensions)
+			, surfaceReflection(_surfaceReflection)
+			, order(_order)
+			, controlInterval(std::max<size_t>(_controlInterval, 1))
+			, samplingFrequency(_samplingFrequency)
+		{
+			computeTaps();
+		}
+
+		template<size_t N>
+		void BasicMovingSourceRenderer<N>::setTrajectory(const std::vector<TrajectoryPoint>& _trajectory)
+		{
+			trajectory = _trajectory;
+			std::stable_sort(trajectory.begin(), trajectory.end(), [](const TrajectoryPoint& a, const TrajectoryPoint& b) { return a.time < b.time; });
+		}
+
+		template<size_t N>
+		void BasicMovingSourceRenderer<N>::computeTaps()
+		{
+			// Per axis, the lattice entries within the order: x images of the room, mirrored when q is 1, off
+			// walls 2 * axis |x - q| times and 2 * axis + 1 |x| times, as in ImageSourceModel.
+			std::array<std::vector<std::array<int, 2>>, 3> entries;
+			for (int axis = 0; axis < 3; axis++) {
+				for (int x = -(int)order; x <= (int)order; x++)
+					for (int q = 0; q <= 1; q++)
+						if ((unsigned int)(std::abs(x - q) + std::abs(x)) <= order) entries[axis].push_back({ x, q });
+			}
+			auto axisOrder = [](const std::array<int, 2>& entry) { return (unsigned int)(std::abs(entry[0] - entry[1]) + std::abs(entry[0])); };
+
+			taps.clear();
+			gains.clear();
+			for (const std::array<int, 2>& ex : entries[0]) {
+				for (const std::array<int, 2>& ey : entries[1]) {
+					if (axisOrder(ex) + axisOrder(ey) > order) continue;
+					for (const std::array<int, 2>& ez : entries[2]) {
+						if (axisOrder(ex) + axisOrder(ey) + axisOrder(ez) > order) continue;
+						Tap tap;
+						tap.x = { ex[0], ey[0], ez[0] };
+						tap.q = { ex[1], ey[1], ez[1] };
+						tap.gainOffset = gains.size();
+						gains.resize(gains.size() + bandStride, 0.0f);
+						for (size_t bin = 0; bin < N; bin++) {
+							double product = 1.0;
+							for (int axis = 0; axis < 3; axis++)
+								product *= pow(surfaceReflection[2 * axis][bin], std::abs(tap.x[axis] - tap.q[axis])) * pow(surfaceReflection[2 * axis + 1][bin], std::abs(tap.x[axis]));
+							gains[tap.gainOffset + bin] = (float)product;
+						}
+						taps.push_back(tap);
+					}
+				}
+			}
+			UNDA_LOG_MESSAGE("MovingSourceRenderer: " + std::to_string(taps.size()) + " image sources up to order " + std::to_string(order));
+		}
+
+		template<size_t N>
+		TrajectoryPoint BasicMovingSourceRenderer<N>::positionAt(double time) const
+		{
+			if (trajectory.empty()) return TrajectoryPoint();
+			if (time <= trajectory.front().time) return trajectory.front();
+			if (time >= trajectory.back().time) return trajectory.back();
+			size_t next = (size_t)(std::upper_bound(trajectory.begin(), trajectory.end(), time, [](double t, const TrajectoryPoint& point) { return t < point.time; }) - trajectory.begin());
+			const TrajectoryPoint& a = trajectory[next - 1], & b = trajectory[next];
+			double span = b.time - a.time, w = span > 0 ? (time - a.time) / span : 1.0;
+			TrajectoryPoint point;
+			point.time = time;
+			for (int axis = 0; axis < 3; axis++) {
+				point.source[axis] = a.source[axis] + w * (b.source[axis] - a.source[axis]);
+				point.listener[axis] = a.listener[axis] + w * (b.listener[axis] - a.listener[axis]);
+			}
+			return point;
+		}
+
+		template<size_t N>
+		double BasicMovingSourceRenderer<N>::pathLength(const Tap& tap, const std::array<double, 3>& source, const std::array<double, 3>& listener) const
+		{
+			double squaredDistance = 0;
+			for (int axis = 0; axis < 3; axis++) {
+				double image = (1 - 2 * (double)tap.q[axis]) * source[axis] + 2 * (double)tap.x[axis] * spaceDimensions[axis];
+				squaredDistance += (image - listener[axis]) * (image - listener[axis]);
+			}
+			return sqrt(squaredDistance);
+		}
+
+		template<size_t N>
+		void BasicMovingSourceRenderer<N>::computeControlFrames(size_t nSamples)
+		{
+			// A frame at both ends of every block, so the last block ramps towards the one past it.
+			nFrames = (nSamples + controlInterval - 1) / controlInterval + 1;
+			delays.resize(nFrames * taps.size());
+			attenuations.resize(nFrames * taps.size());
+			double samplesPerMetre = samplingFrequency / unda::maths::c, minimumDistance = 1.0 / samplesPerMetre;
+			for (size_t frame = 0; frame < nFrames; frame++) {
+				double time = (double)(frame * controlInterval) / samplingFrequency;
+				TrajectoryPoint point = positionAt(time);
+				for (size_t t = 0; t < taps.size(); t++) {
+					// Heard now, from where the source was when it emitted: the path is solved at the emission
+					// time, time - distance / c, by fixed point iteration, which converges in a few steps below
+					// the speed of sound. Taking the current source position instead would give f (1 - v / c)
+					// rather than f / (1 + v / c) for a receding source.
+					double distance = pathLength(taps[t], point.source, point.listener);
+					for (int iteration = 0; iteration < 3; iteration++)
+						distance = pathLength(taps[t], positionAt(time - distance / unda::maths::c).source, point.listener);
+					// Closer than a sample is clamped rather than blowing up the gain.
+					distance = std::max(distance, minimumDistance);
+					delays[frame * taps.size() + t] = distance * samplesPerMetre;
+					attenuations[frame * taps.size() + t] = (float)(1.0 / (4.0 * M_PI * distance));
+				}
+			}
+		}
+
+		template<size_t N>
+		Signal BasicMovingSourceRenderer<N>::render(const Signal& dry)
+		{
+			if (trajectory.empty() || taps.empty() || dry.empty()) {
+				UNDA_ERROR("MovingSourceRenderer: nothing to render");
+				return Signal();
+			}
+			[[maybe_unused]] auto t1 = std::chrono::steady_clock::now();
+
+			// Source and listener stay within the bounding boxes of their trajectory points, and an image
+			// source within the mirrored box, which bounds every path whatever the emission time.
+			std::array<double, 3> sourceMin, sourceMax, listenerMin, listenerMax;
+			for (int axis = 0; axis < 3; axis++) {
+				sourceMin[axis] = listenerMin[axis] = DBL_MAX;
+				sourceMax[axis] = listenerMax[axis] = -DBL_MAX;
+				for (const TrajectoryPoint& point : trajectory) {
+					sourceMin[axis] = std::min(sourceMin[axis], point.source[axis]);
+					sourceMax[axis] = std::max(sourceMax[axis], point.source[axis]);
+					listenerMin[axis] = std::min(listenerMin[axis], point.listener[axis]);
+					listenerMax[axis] = std::max(listenerMax[axis], point.listener[axis]);
+				}
+			}
+			double samplesPerMetre = samplingFrequency / unda::maths::c, maximumDelay = 0;
+			for (const Tap& tap : taps) {
+				double squaredDistance = 0;
+				for (int axis = 0; axis < 3; axis++) {
+					double sign = 1 - 2 * (double)tap.q[axis], offset = 2 * (double)tap.x[axis] * spaceDimensions[axis];
+					double imageMin = std::min(sign * sourceMin[axis], sign * sourceMax[axis]) + offset, imageMax = std::max(sign * sourceMin[axis], sign * sourceMax[axis]) + offset;
+					double reach = std::max(imageMax - listenerMin[axis], listenerMax[axis] - imageMin);
+					squaredDistance += reach * reach;
+				}
+				maximumDelay = std::max(maximumDelay, sqrt(squaredDistance) * samplesPerMetre);
+			}
+			size_t nOutput = dry.size() + (size_t)std::ceil(maximumDelay) + 2;
+			computeControlFrames(nOutput);
+
+			// Band-split dry signal, interleaved, with historyOffset samples of silence ahead of it so a
+			// read at (n - delay) and its interpolation neighbours is always in range.
+			const std::array<std::array<float, 2>, N>& edges = BandEdges<N>();
+			std::unique_ptr<IFilterBank> filterBank = createFilterBank(BandFilterType::FIR, std::vector<std::array<float, 2>>(edges.begin(), edges.end()), (float)samplingFrequency);
+			std::array<Signal, N> bands;
+			for (Signal& band : bands) band = dry;
+			filterBank->process(bands);
+			size_t historyOffset = (size_t)std::ceil(maximumDelay) + 2;
+			simd::AlignedVector<float> history((historyOffset + nOutput + 2) * bandStride, 0.0f);
+			for (size_t n = 0; n < dry.size(); n++)
+				for (size_t bin = 0; bin < N; bin++) history[(historyOffset + n) * bandStride + bin] = bands[bin][n];
+
+			// Blocks of one control interval are independent, every thread takes an interleaved share.
+			Signal output(nOutput, Sample());
+			size_t nBlocks = nFrames - 1, nTaps = taps.size();
+			unsigned int nThreads = std::max(1u, std::thread::hardware_concurrency());
+			std::vector<std::thread> workers;
+			for (unsigned int thread = 0; thread < nThreads; thread++) {
+				workers.push_back(std::thread([&, thread]() {
+					simd::AlignedVector<float> block(controlInterval * bandStride);
+					for (size_t b = thread; b < nBlocks; b += nThreads) {
+						size_t first = b * controlInterval, length = std::min(controlInterval, nOutput - first);
+						std::fill(block.begin(), block.end(), 0.0f);
+						for (size_t t = 0; t < nTaps; t++) {
+							const float* tapGains = &gains[taps[t].gainOffset];
+							double delay = delays[b * nTaps + t], delayStep = (delays[(b + 1) * nTaps + t] - delay) / (double)controlInterval;
+							float attenuation = attenuations[b * nTaps + t], attenuationStep = (attenuations[(b + 1) * nTaps + t] - attenuation) / (float)controlInterval;
+							for (size_t j = 0; j < length; j++, delay += delayStep, attenuation += attenuationStep) {
+								double position = (double)(historyOffset + first + j) - delay;
+								size_t index = (size_t)position;
+								float f = (float)(position - (double)index);
+								// Cubic Lagrange through index - 1 .. index + 2, with the gain folded in.
+								float fm1 = f - 1.0f, fm2 = f - 2.0f, fp1 = f + 1.0f;
+								simd::wide::floatw w0 = simd::wide::set(-attenuation * f * fm1 * fm2 / 6.0f), w1 = simd::wide::set(attenuation * fp1 * fm1 * fm2 / 2.0f);
+								simd::wide::floatw w2 = simd::wide::set(-attenuation * fp1 * f * fm2 / 2.0f), w3 = simd::wide::set(attenuation * fp1 * f * fm1 / 6.0f);
+								const float* frame = &history[(index - 1) * bandStride];
+								float* sum = &block[j * bandStride];
+								for (size_t lane = 0; lane < bandStride; lane += simd::wide::width) {
+									simd::wide::floatw value = simd::wide::mul(w0, simd::wide::load(frame + lane));
+									value = simd::wide::madd(w1, simd::wide::load(frame + bandStride + lane), value);
+									value = simd::wide::madd(w2, simd::wide::load(frame + 2 * bandStride + lane), value);
+									value = simd::wide::madd(w3, simd::wide::load(frame + 3 * bandStride + lane), value);
+									simd::wide::store(sum + lane, simd::wide::madd(value, simd::wide::load(tapGains + lane), simd::wide::load(sum + lane)));
+								}
+							}
+						}
+						// The padding lanes have zero gains, so every lane can be summed.
+						for (size_t j = 0; j < length; j++) {
+							simd::float4 sum = simd::load(&block[j * bandStride]);
+							for (size_t lane = simd::width; lane < bandStride; lane += simd::width)
+								sum = simd::add(sum, simd::load(&block[j * bandStride + lane]));
+							output[first + j] = simd::hsum(sum);
+						}
+					}
+				}));
+			}
+			for (std::thread& th : workers) th.join();
+
+			[[maybe_unused]] auto t2 = std::chrono::steady_clock::now();
+			UNDA_LOG_MESSAGE("MovingSourceRenderer: " + std::to_string(nTaps) + " taps over " + std::to_string(nOutput) + " samples in " +
+				std::to_string(std::chrono::duration<double, std::milli>(t2 - t1).count()) + " ms");
+			return output;
+		}
+
+		template class BasicMovingSourceRenderer<6>;
+		template class BasicMovingSourceRenderer<10>;
+		template class BasicMovingSourceRenderer<31>;
+	}
+}
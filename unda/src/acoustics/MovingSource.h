@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Acoustics.h"
+#include "DSP.h"
+#include "../utils/Settings.h"
+#include "../utils/Utils.h"
+#include "../utils/SIMD.h"
+#include <vector>
+#include <array>
+#include <memory>
+
+
+namespace unda {
+	namespace acoustics {
+
+		// Source and listener positions in metres at a time in seconds.
+		struct TrajectoryPoint {
+			double time = 0;
+			std::array<double, 3> source{};
+			std::array<double, 3> listener{};
+		};
+
+		// Shoebox image sources as taps on one band-split delay line, for a moving source and listener. Each
+		// tap's delay and gain ramp between paths updated every controlInterval samples, giving Doppler shift.
+		template<size_t N>
+		class BasicMovingSourceRenderer {
+		public:
+			static constexpr size_t nBands = N;
+
+			BasicMovingSourceRenderer(const std::array<double, 3>& _spaceDimensions, const std::array<std::array<double, N>, 6>& _surfaceReflection,
+									  unsigned int _order = 2, size_t _controlInterval = unda::dspBlockSize, double _samplingFrequency = unda::sampleRate);
+			~BasicMovingSourceRenderer() = default;
+
+			// Sorted by time. Positions are interpolated linearly in between and held past the ends.
+			void setTrajectory(const std::vector<TrajectoryPoint>& _trajectory);
+			size_t getTapCount() const { return taps.size(); }
+
+			// dry at samplingFrequency, from time 0 of the trajectory. The output runs until the last arrival
+			// of the last dry sample.
+			Signal render(const Signal& dry);
+
+		private:
+			// One image source: lattice indices per axis and its reflection product per band.
+			struct Tap {
+				std::array<int, 3> x{}, q{};
+				size_t gainOffset = 0;	// into gains
+			};
+
+			std::array<double, 3> spaceDimensions;
+			std::array<std::array<double, N>, 6> surfaceReflection;
+			unsigned int order;
+			size_t controlInterval;
+			double samplingFrequency;
+			std::vector<TrajectoryPoint> trajectory;
+
+			static constexpr size_t bandStride = simd::wide::roundUp(N);
+			std::vector<Tap> taps;
+			simd::AlignedVector<float> gains;		// taps x bandStride, zero padded
+			// Per control frame and tap, the delay in samples and the distance gain.
+			std::vector<double> delays;
+			std::vector<float> attenuations;
+			size_t nFrames = 0;
+
+			void computeTaps();
+			TrajectoryPoint positionAt(double time) const;
+			// Image source to listener, in metres.
+			double pathLength(const Tap& tap, const std::array<double, 3>& source, const std::array<double, 3>& listener) const;
+			void computeControlFrames(size_t nSamples);
+
+			DISABLE_COPY_ASSIGN(BasicMovingSourceRenderer)
+		};
+		typedef BasicMovingSourceRenderer<6> MovingSourceRenderer;
+
+		extern template class BasicMovingSourceRenderer<6>;
+		extern template class BasicMovingSourceRenderer<10>;
+		extern template class BasicMovingSourceRenderer<31>;
+	}
+}
@@ -0,0 +1,243 @@
+#include "PolygonImageSource.h"
+#include "../utils/Maths.h"
+#include <thread>
+#include <atomic>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace unda {
+	namespace acoustics {
+		template<size_t N>
+		BasicPolygonImageSourceModel<N>::BasicPolygonImageSourceModel(const BasicRoomMesh<N>& mesh, const std::array<double, 3>& _sourcePosition, const std::array<double, 3>& _receiverPosition,
+																	  int _nSamples, unsigned int _order, double _samplingFrequency)
+			: source({ (float)_sourcePosition[0], (float)_sourcePosition[1], (float)_sourcePosition[2] })
+			, listener({ (float)_receiverPosition[0], (float)_receiverPosition[1], (float)_receiverPosition[2] })
+			, nSamples(std::max(_nSamples, 1))
+			, order(_order)
+			, samplingFrequency(_samplingFrequency)
+			, maximumDistance((float)((double)std::max(_nSamples, 1) * unda::maths::c / _samplingFrequency))
+		{
+			if (mesh.vertices.size() != 3 * mesh.getTriangleCount()) {
+				UNDA_ERROR("PolygonImageSourceModel: the mesh needs three vertices and a material per triangle");
+				return;
+			}
+			triangleMaterials = mesh.materials;
+			for (const BasicMaterial<N>& surface : mesh.surfaces) {
+				std::array<float, N> beta;
+				for (size_t bin = 0; bin < N; bin++) beta[bin] = (float)sqrt(1.0 - surface.alphaCoefficients[bin]);
+				reflection.push_back(beta);
+			}
+			for (unsigned int& material : triangleMaterials) {
+				if (material < reflection.size()) continue;
+				UNDA_ERROR("PolygonImageSourceModel: triangle material " + std::to_string(material) + " out of range, using the first");
+				material = 0;
+			}
+			if (reflection.empty()) reflection.push_back(std::array<float, N>{});
+
+			bvh = std::make_unique<TriangleBVH>(mesh.vertices);
+			buildPlanes(mesh.vertices);
+			orientPlanes();
+			fractionalDelay = DesignFractionalDelay(fractionalPhases, fractionalTaps, tapOffset);
+			UNDA_LOG_MESSAGE("PolygonImageSourceModel: " + std::to_string(bvh->getTriangleCount()) + " triangles in " + std::to_string(planes.size()) + " planes");
+		}
+
+		template<size_t N>
+		void BasicPolygonImageSourceModel<N>::buildPlanes(const std::vector<Vector3>& vertices)
+		{
+			// Facets are coplanar when their normals agree to 1 / 1024, either way round, and their distances
+			// from the origin to 5 mm. A plane keeps the area weighted mean of its facets, with its largest
+			// normal component positive until it's oriented.
+			std::map<std::array<long, 4>, int> keys;
+			std::vector<Vector3> normalSums;
+			std::vector<float> distanceSums, areas;
+			trianglePlanes.assign(bvh->getTriangleCount(), -1);
+			for (size_t t = 0; t < trianglePlanes.size(); t++) {
+				Vector3 normal = bvh->getNormal(t);
+				if (Dot(normal, normal) == 0.0f) continue;
+				int major = 0;
+				for (int axis = 1; axis < 3; axis++) if (std::abs(normal[axis]) > std::abs(normal[major])) major = axis;
+				if (normal[major] < 0) normal = Scale(normal, -1.0f);
+				const Vector3& a = vertices[3 * t], & b = vertices[3 * t + 1], & c = vertices[3 * t + 2];
+				float distance = Dot(normal, a), area = 0.5f * Length(Cross(Subtract(b, a), Subtract(c, a)));
+				std::array<long, 4> key = { lroundf(normal[0] * 1024.0f), lroundf(normal[1] * 1024.0f), lroundf(normal[2] * 1024.0f), lroundf(distance * 200.0f) };
+				auto found = keys.find(key);
+				int plane;
+				if (found == keys.end()) {
+					plane = (int)normalSums.size();
+					keys.emplace(key, plane);
+					normalSums.push_back({ 0.0f, 0.0f, 0.0f });
+					distanceSums.push_back(0.0f);
+					areas.push_back(0.0f);
+				}
+				else plane = found->second;
+				normalSums[plane] = Add(normalSums[plane], Scale(normal, area));
+				distanceSums[plane] += distance * area;
+				areas[plane] += area;
+				trianglePlanes[t] = plane;
+			}
+			planes.resize(normalSums.size());
+			for (size_t p = 0; p < planes.size(); p++) {
+				planes[p].normal = Normalise(normalSums[p]);
+				planes[p].distance = areas[p] > 0 ? distanceSums[p] / areas[p] : 0.0f;
+			}
+		}
+
+		template<size_t N>
+		void BasicPolygonImageSourceModel<N>::orientPlanes()
+		{
+			// A plane faces into the room from the side the source sees it from: rays from the source vote on
+			// every plane they meet first. The source is then reflected only by planes it, or its image, is in
+			// front of. Planes no ray meets face the source's side.
+			constexpr int nRays = 4096;
+			std::vector<int> votes(planes.size(), 0);
+			for (int i = 0; i < nRays; i++) {
+				// Fibonacci sphere
+				float z = 1.0f - 2.0f * ((float)i + 0.5f) / (float)nRays, radius = sqrtf(std::max(0.0f, 1.0f - z * z));
+				float phi = (float)i * 2.39996323f;
+				Vector3 direction = { radius * cosf(phi), radius * sinf(phi), z };
+				RayHit hit;
+				if (!bvh->intersect(source, direction, 1e-4f, maximumDistance, hit) || trianglePlanes[hit.triangle] < 0) continue;
+				int plane = trianglePlanes[hit.triangle];
+				votes[plane] += Dot(direction, planes[plane].normal) < 0 ? 1 : -1;
+			}
+			for (size_t p = 0; p < planes.size(); p++) {
+				bool flip = votes[p] != 0 ? votes[p] < 0 : Dot(planes[p].normal, source) < planes[p].distance;
+				if (!flip) continue;
+				planes[p].normal = Scale(planes[p].normal, -1.0f);
+				planes[p].distance = -planes[p].distance;
+			}
+		}
+
+		template<size_t N>
+		bool BasicPolygonImageSourceModel<N>::validate(const Path& path, unsigned int depth, Arrival& arrival) const
+		{
+			// Unfolded from the listener: towards image d the path must meet a facet of planes[d] before
+			// anything else, then carry on from there towards image d - 1, and finally reach the source.
+			std::array<float, N> gains;
+			gains.fill(1.0f);
+			Vector3 point = listener;
+			for (unsigned int d = depth; d > 0; d--) {
+				Vector3 direction = Subtract(path.images[d], point);
+				float length = Length(direction);
+				RayHit hit;
+				if (length <= 0 || !bvh->intersect(point, direction, 1e-4f / length, 1.0f, hit)) return false;
+				if (trianglePlanes[hit.triangle] != path.planes[d]) return false;
+				point = Add(point, Scale(direction, hit.distance));
+				const std::array<float, N>& beta = reflection[triangleMaterials[hit.triangle]];
+				for (size_t bin = 0; bin < N; bin++) gains[bin] *= beta[bin];
+			}
+			if (bvh->occluded(point, source)) return false;
+
+			double distance = std::max((double)Length(Subtract(path.images[depth], listener)), unda::maths::c / samplingFrequency);
+			arrival.delay = distance * samplingFrequency / unda::maths::c;
+			float attenuation = (float)(1.0 / (4.0 * M_PI * distance));
+			for (size_t bin = 0; bin < N; bin++) arrival.gains[bin] = gains[bin] * attenuation;
+			return true;
+		}
+
+		template<size_t N>
+		void BasicPolygonImageSourceModel<N>::expand(Path& path, unsigned int depth, std::vector<Arrival>& result, size_t& candidates) const
+		{
+			candidates++;
+			Arrival arrival;
+			if (validate(path, depth, arrival)) result.push_back(arrival);
+			if (depth >= order) return;
+
+			const Vector3& image = path.images[depth];
+			for (size_t p = 0; p < planes.size(); p++) {
+				if ((int)p == path.planes[depth]) continue;
+				// Only a plane the image is in front of can reflect it. Any path through a descendant passes
+				// the child's plane and is at least as long as the child's distance to the listener, so the
+				// whole subtree goes once that's past the end of the IR.
+				float height = Dot(planes[p].normal, image) - planes[p].distance;
+				if (height <= 1e-4f) continue;
+				Vector3 child = Subtract(image, Scale(planes[p].normal, 2.0f * height));
+				if (Length(Subtract(child, listener)) > maximumDistance) continue;
+				path.images[depth + 1] = child;
+				path.planes[depth + 1] = (int)p;
+				expand(path, depth + 1, result, candidates);
+			}
+		}
+
+		template<size_t N>
+		void BasicPolygonImageSourceModel<N>::dispatchCPUThreads()
+		{
+			arrivals.clear();
+			candidateCount = 0;
+			if (!bvh) return;
+			[[maybe_unused]] auto t1 = std::chrono::steady_clock::now();
+
+			// The direct path, then the first order branches, handed out one at a time.
+			Path root;
+			root.images.assign(order + 1, source);
+			root.planes.assign(order + 1, -1);
+			Arrival direct;
+			candidateCount++;
+			if (validate(root, 0, direct)) arrivals.push_back(direct);
+
+			unsigned int nThreads = std::max(1u, std::thread::hardware_concurrency());
+			std::vector<std::vector<Arrival>> workerArrivals(nThreads);
+			std::vector<size_t> workerCandidates(nThreads, 0);
+			std::atomic<size_t> nextPlane{ 0 };
+			std::vector<std::thread> workers;
+			if (order > 0) {
+				for (unsigned int thread = 0; thread < nThreads; thread++) {
+					workers.push_back(std::thread([&, thread]() {
+						Path path = root;
+						for (size_t p = nextPlane++; p < planes.size(); p = nextPlane++) {
+							float height = Dot(planes[p].normal, source) - planes[p].distance;
+							if (height <= 1e-4f) continue;
+							path.images[1] = Subtract(source, Scale(planes[p].normal, 2.0f * height));
+							path.planes[1] = (int)p;
+							if (Length(Subtract(path.images[1], listener)) > maximumDistance) continue;
+							expand(path, 1, workerArrivals[thread], workerCandidates[thread]);
+						}
+					}));
+				}
+			}
+			for (std::thread& th : workers) th.join();
+			for (unsigned int thread = 0; thread < nThreads; thread++) {
+				arrivals.insert(arrivals.end(), workerArrivals[thread].begin(), workerArrivals[thread].end());
+				candidateCount += workerCandidates[thread];
+			}
+			renderArrivals();
+
+			[[maybe_unused]] auto t2 = std::chrono::steady_clock::now();
+			UNDA_LOG_MESSAGE("PolygonImageSourceModel: " + std::to_string(arrivals.size()) + " of " + std::to_string(candidateCount) + " image sources up to order " +
+				std::to_string(order) + " in " + std::to_string(std::chrono::duration<double, std::milli>(t2 - t1).count()) + " ms");
+		}
+
+		template<size_t N>
+		void BasicPolygonImageSourceModel<N>::renderArrivals()
+		{
+			// Every arrival at its exact delay through the fractional delay table, as in ImageSourceModel, into
+			// band IRs offset by tapOffset and padded for the taps.
+			for (Signal& band : irs) band.assign((size_t)nSamples + fractionalTaps, Sample());
+			for (const Arrival& arrival : arrivals) {
+				size_t position = (size_t)(arrival.delay * (double)fractionalPhases + 0.5), index = position / fractionalPhases;
+				if (index >= (size_t)nSamples) continue;
+				const float* row = &fractionalDelay[(position % fractionalPhases) * fractionalTaps];
+				for (size_t bin = 0; bin < N; bin++)
+					for (size_t tap = 0; tap < fractionalTaps; tap++) irs[bin][index + tap] += arrival.gains[bin] * row[tap];
+			}
+			for (Signal& band : irs) {
+				band.erase(band.begin(), band.begin() + tapOffset);
+				band.resize((size_t)nSamples);
+			}
+
+			const std::array<std::array<float, 2>, N>& edges = BandEdges<N>();
+			std::unique_ptr<IFilterBank> filterBank = createFilterBank(BandFilterType::FIR, std::vector<std::array<float, 2>>(edges.begin(), edges.end()), (float)samplingFrequency);
+			filterBank->process(irs);
+			output.assign((size_t)nSamples, Sample());
+			for (size_t bin = 0; bin < N; bin++)
+				for (size_t n = 0; n < output.size(); n++) output[n] += irs[bin][n];
+			NormaliseSignal(output);
+		}
+
+		template class BasicPolygonImageSourceModel<6>;
+		template class BasicPolygonImageSourceModel<10>;
+		template class BasicPolygonImageSourceModel<31>;
+	}
+}
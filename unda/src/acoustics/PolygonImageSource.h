@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Acoustics.h"
+#include "DSP.h"
+#include "Geometry.h"
+#include "../utils/Settings.h"
+#include "../utils/Utils.h"
+#include "../utils/SIMD.h"
+#include <vector>
+#include <array>
+#include <memory>
+
+
+namespace unda {
+	namespace acoustics {
+
+		// Image source model of a room of any shape, given as a triangle mesh in metres, with coplanar triangles
+		// merged into planes. An image counts if its path, traced through a TriangleBVH, meets its planes in turn.
+		template<size_t N>
+		class BasicPolygonImageSourceModel {
+		public:
+			static constexpr size_t nBands = N;
+
+			BasicPolygonImageSourceModel(const BasicRoomMesh<N>& mesh, const std::array<double, 3>& _sourcePosition, const std::array<double, 3>& _receiverPosition,
+										 int _nSamples, unsigned int _order = 2, double _samplingFrequency = unda::sampleRate);
+			~BasicPolygonImageSourceModel() = default;
+
+			const std::array<Signal, N>& getIRs() const { return irs; }
+			const Signal& getOutput() const { return output; }
+			size_t getPlaneCount() const { return planes.size(); }
+			// Of the last dispatch: images generated, and images with a valid path.
+			size_t getCandidateCount() const { return candidateCount; }
+			size_t getImageCount() const { return arrivals.size(); }
+
+			void dispatchCPUThreads();
+
+		private:
+			// Points x with Dot(normal, x) = distance, the normal facing into the room once oriented.
+			struct Plane {
+				Vector3 normal;
+				float distance;
+			};
+			struct Arrival {
+				double delay;				// in samples
+				std::array<float, N> gains;	// reflections and distance
+			};
+			// One thread's walk down a branch: images[d] is the image after d reflections, off planes[d].
+			struct Path {
+				std::vector<Vector3> images;
+				std::vector<int> planes;
+			};
+
+			std::unique_ptr<TriangleBVH> bvh;
+			std::vector<Plane> planes;
+			std::vector<int> trianglePlanes;				// -1 for degenerate triangles
+			std::vector<unsigned int> triangleMaterials;
+			std::vector<std::array<float, N>> reflection;	// per material, sqrt(1 - alpha)
+
+			Vector3 source, listener;
+			int nSamples;
+			unsigned int order;
+			double samplingFrequency;
+			float maximumDistance;		// metres travelled in nSamples
+
+			std::vector<Arrival> arrivals;
+			size_t candidateCount = 0;
+			std::array<Signal, N> irs;
+			Signal output;
+
+			static constexpr size_t fractionalPhases = 64, fractionalTaps = 16, tapOffset = fractionalTaps / 2 - 1;
+			simd::AlignedVector<float> fractionalDelay;
+
+			void buildPlanes(const std::vector<Vector3>& vertices);
+			void orientPlanes();
+			void expand(Path& path, unsigned int depth, std::vector<Arrival>& result, size_t& candidates) const;
+			bool validate(const Path& path, unsigned int depth, Arrival& arrival) const;
+			void renderArrivals();
+
+			DISABLE_COPY_ASSIGN(BasicPolygonImageSourceModel)
+		};
+		typedef BasicPolygonImageSourceModel<6> PolygonImageSourceModel;
+
+		extern template class BasicPolygonImageSourceModel<6>;
+		extern template class BasicPolygonImageSourceModel<10>;
+		extern template class BasicPolygonImageSourceModel<31>;
+	}
+}
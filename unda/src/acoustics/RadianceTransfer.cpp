@@ -0,0 +1,275 @@
+#include "RadianceTransfer.h"
+#include "../utils/Maths.h"
+#include <thread>
+#include <atomic>
+#include <random>
+#include <map>
+#include <unordered_map>
+#include <limits>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace unda {
+	namespace acoustics {
+		template<size_t N>
+		BasicRadianceTransfer<N>::BasicRadianceTransfer(const BasicRoomMesh<N>& mesh, int _nSamples, double _patchSize, size_t _raysPerPatch,
+														double _binLength, double _samplingFrequency)
+			: nSamples(std::max(_nSamples, 1))
+			, samplingFrequency(_samplingFrequency)
+			, raysPerPatch(std::max<size_t>(_raysPerPatch, 1))
+		{
+			size_t binSamples = std::max<size_t>(1, (size_t)std::round(_binLength * samplingFrequency));
+			binLength = (double)binSamples / samplingFrequency;
+			nBins = ((size_t)nSamples + binSamples - 1) / binSamples;
+			if (mesh.vertices.size() != 3 * mesh.getTriangleCount()) {
+				UNDA_ERROR("RadianceTransfer: the mesh needs three vertices and a material per triangle");
+				return;
+			}
+			[[maybe_unused]] auto t1 = std::chrono::steady_clock::now();
+			bvh = std::make_unique<TriangleBVH>(mesh.vertices);
+			buildPatches(mesh, std::max(_patchSize, 0.01));
+			computeTransfers();
+			[[maybe_unused]] auto t2 = std::chrono::steady_clock::now();
+			UNDA_LOG_MESSAGE("RadianceTransfer: " + std::to_string(patches.size()) + " patches, " + std::to_string(transfers.size()) + " transfers in " +
+				std::to_string(std::chrono::duration<double, std::milli>(t2 - t1).count()) + " ms");
+		}
+
+		template<size_t N>
+		void BasicRadianceTransfer<N>::buildPatches(const BasicRoomMesh<N>& mesh, double patchSize)
+		{
+			// Triangles facing within about 15 degrees, either way round, with their centroids in the same
+			// patchSize cell, are a patch.
+			constexpr size_t nPatchSamples = 16;
+			std::map<std::array<long, 6>, unsigned int> keys;
+			std::vector<std::vector<unsigned int>> patchTriangles;
+			trianglePatches.assign(bvh->getTriangleCount(), ~0u);
+			for (size_t t = 0; t < trianglePatches.size(); t++) {
+				Vector3 normal = bvh->getNormal(t);
+				if (Dot(normal, normal) == 0.0f) continue;
+				int major = 0;
+				for (int axis = 1; axis < 3; axis++) if (std::abs(normal[axis]) > std::abs(normal[major])) major = axis;
+				if (normal[major] < 0) normal = Scale(normal, -1.0f);
+				Vector3 centroid = Scale(Add(Add(mesh.vertices[3 * t], mesh.vertices[3 * t + 1]), mesh.vertices[3 * t + 2]), 1.0f / 3.0f);
+				std::array<long, 6> key = { lroundf(normal[0] * 4.0f), lroundf(normal[1] * 4.0f), lroundf(normal[2] * 4.0f),
+					(long)std::floor(centroid[0] / patchSize), (long)std::floor(centroid[1] / patchSize), (long)std::floor(centroid[2] / patchSize) };
+				auto found = keys.find(key);
+				if (found == keys.end()) {
+					found = keys.emplace(key, (unsigned int)patchTriangles.size()).first;
+					patchTriangles.emplace_back();
+				}
+				patchTriangles[found->second].push_back((unsigned int)t);
+				trianglePatches[t] = found->second;
+			}
+
+			patches.resize(patchTriangles.size());
+			for (size_t p = 0; p < patches.size(); p++) {
+				Patch& patch = patches[p];
+				std::vector<float> areas;
+				Vector3 normalSum = { 0.0f, 0.0f, 0.0f }, centreSum = { 0.0f, 0.0f, 0.0f };
+				patch.reflection.fill(0.0f);
+				for (unsigned int t : patchTriangles[p]) {
+					const Vector3& a = mesh.vertices[3 * t], & b = mesh.vertices[3 * t + 1], & c = mesh.vertices[3 * t + 2];
+					float area = 0.5f * Length(Cross(Subtract(b, a), Subtract(c, a)));
+					Vector3 normal = bvh->getNormal(t);
+					if (Dot(normal, normalSum) < 0) normal = Scale(normal, -1.0f);
+					normalSum = Add(normalSum, Scale(normal, area));
+					centreSum = Add(centreSum, Scale(Add(Add(a, b), c), area / 3.0f));
+					unsigned int material = mesh.materials[t] < mesh.surfaces.size() ? mesh.materials[t] : 0;
+					for (size_t bin = 0; bin < N; bin++)
+						patch.reflection[bin] += area * (mesh.surfaces.empty() ? 1.0f : (float)(1.0 - mesh.surfaces[material].alphaCoefficients[bin]));
+					patch.area += area;
+					areas.push_back(area);
+				}
+				patch.normal = Normalise(normalSum);
+				int major = 0;
+				for (int axis = 1; axis < 3; axis++) if (std::abs(patch.normal[axis]) > std::abs(patch.normal[major])) major = axis;
+				if (patch.normal[major] < 0) patch.normal = Scale(patch.normal, -1.0f);
+				if (patch.area > 0) {
+					patch.centre = Scale(centreSum, 1.0f / patch.area);
+					for (float& reflection : patch.reflection) reflection /= patch.area;
+				}
+				else patch.centre = mesh.vertices[3 * patchTriangles[p][0]];
+
+				// Seeded by patch, so the transfers don't change from run to run.
+				std::mt19937 generator((unsigned int)p);
+				std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+				std::discrete_distribution<size_t> pick(areas.begin(), areas.end());
+				for (size_t s = 0; s < nPatchSamples; s++) {
+					unsigned int t = patchTriangles[p][patch.area > 0 ? pick(generator) : 0];
+					float u = uniform(generator), v = uniform(generator);
+					if (u + v > 1.0f) { u = 1.0f - u; v = 1.0f - v; }
+					const Vector3& a = mesh.vertices[3 * t];
+					patch.samples.push_back(Add(a, Add(Scale(Subtract(mesh.vertices[3 * t + 1], a), u), Scale(Subtract(mesh.vertices[3 * t + 2], a), v))));
+				}
+			}
+		}
+
+		template<size_t N>
+		Vector3 BasicRadianceTransfer<N>::getNodeNormal(size_t node) const
+		{
+			const Vector3& normal = patches[node / 2].normal;
+			return node % 2 ? Scale(normal, -1.0f) : normal;
+		}
+
+		template<size_t N>
+		float BasicRadianceTransfer<N>::getVisibility(const Patch& patch, const Vector3& normal, const Vector3& point) const
+		{
+			constexpr size_t nTests = 4;
+			size_t count = std::min(nTests, patch.samples.size()), visible = 0;
+			for (size_t s = 0; s < count; s++)
+				if (!bvh->occluded(Add(patch.samples[s], Scale(normal, 1e-3f)), point)) visible++;
+			return count ? (float)visible / (float)count : 0.0f;
+		}
+
+		template<size_t N>
+		void BasicRadianceTransfer<N>::computeTransfers()
+		{
+			// Every node shoots its rays on its own, into its own list, then they're turned round by receiving node.
+			struct Outgoing {
+				unsigned int to, delay;
+				float factor;
+			};
+			size_t nNodes = 2 * patches.size();
+			std::vector<std::vector<Outgoing>> outgoing(nNodes);
+			std::atomic<size_t> nextNode{ 0 };
+			unsigned int nThreads = (unsigned int)std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), std::max<size_t>(nNodes, 1));
+			std::vector<std::thread> workers;
+			for (unsigned int thread = 0; thread < nThreads; thread++) {
+				workers.push_back(std::thread([&]() {
+					std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+					std::unordered_map<unsigned int, std::pair<size_t, double>> hits;
+					for (size_t node = nextNode++; node < nNodes; node = nextNode++) {
+						const Patch& patch = patches[node / 2];
+						if (patch.samples.empty()) continue;
+						std::mt19937 generator((unsigned int)node);
+						Vector3 normal = getNodeNormal(node);
+						Vector3 tangent = Normalise(std::abs(normal[0]) < 0.9f ? Cross(normal, { 1.0f, 0.0f, 0.0f }) : Cross(normal, { 0.0f, 1.0f, 0.0f }));
+						Vector3 bitangent = Cross(normal, tangent);
+						hits.clear();
+						for (size_t ray = 0; ray < raysPerPatch; ray++) {
+							// Lambert: cosine weighted about the side's normal.
+							float r = uniform(generator), angle = 2.0f * (float)unda::maths::pi * uniform(generator), sine = sqrtf(r);
+							Vector3 direction = Add(Add(Scale(tangent, sine * cosf(angle)), Scale(bitangent, sine * sinf(angle))), Scale(normal, sqrtf(std::max(0.0f, 1.0f - r))));
+							Vector3 origin = Add(patch.samples[ray % patch.samples.size()], Scale(normal, 1e-3f));
+							RayHit hit;
+							if (!bvh->intersect(origin, direction, 0.0f, std::numeric_limits<float>::max(), hit) || trianglePatches[hit.triangle] == ~0u) continue;
+							unsigned int target = 2 * trianglePatches[hit.triangle] + (Dot(direction, patches[trianglePatches[hit.triangle]].normal) < 0 ? 0 : 1);
+							if (target == node) continue;
+							std::pair<size_t, double>& entry = hits[target];
+							entry.first++;
+							entry.second += (double)hit.distance;
+						}
+						for (const auto& [target, entry] : hits) {
+							double distance = entry.second / (double)entry.first;
+							unsigned int delay = std::max(1u, (unsigned int)std::lround(distance / (unda::maths::c * binLength)));
+							outgoing[node].push_back({ target, delay, (float)entry.first / (float)raysPerPatch });
+						}
+					}
+				}));
+			}
+			for (std::thread& th : workers) th.join();
+
+			transferStart.assign(nNodes + 1, 0);
+			for (const std::vector<Outgoing>& list : outgoing)
+				for (const Outgoing& transfer : list) transferStart[transfer.to + 1]++;
+			for (size_t node = 0; node < nNodes; node++) transferStart[node + 1] += transferStart[node];
+			transfers.resize(transferStart[nNodes]);
+			std::vector<size_t> filled(transferStart.begin(), transferStart.end() - 1);
+			for (size_t node = 0; node < nNodes; node++)
+				for (const Outgoing& transfer : outgoing[node]) transfers[filled[transfer.to]++] = { (unsigned int)node, transfer.delay, transfer.factor };
+		}
+
+		template<size_t N>
+		void BasicRadianceTransfer<N>::setSource(const std::array<double, 3>& sourcePosition)
+		{
+			if (!bvh) return;
+			[[maybe_unused]] auto t1 = std::chrono::steady_clock::now();
+			// The source's energy on every node it sees: the solid angle of the patch over 4 pi, no closer than
+			// the patch's own radius.
+			Vector3 source = { (float)sourcePosition[0], (float)sourcePosition[1], (float)sourcePosition[2] };
+			size_t nNodes = 2 * patches.size();
+			std::vector<float> direct(nNodes, 0.0f);
+			std::vector<size_t> directBin(nNodes, nBins);
+			for (size_t p = 0; p < patches.size(); p++) {
+				const Patch& patch = patches[p];
+				Vector3 toSource = Subtract(source, patch.centre);
+				float distance = Length(toSource);
+				if (distance <= 0 || patch.area <= 0) continue;
+				float cosine = Dot(patch.normal, toSource) / distance;
+				size_t node = 2 * p + (cosine > 0 ? 0 : 1);
+				float visibility = getVisibility(patch, getNodeNormal(node), source);
+				if (visibility <= 0) continue;
+				float squaredDistance = std::max(distance * distance, patch.area / (float)unda::maths::pi);
+				direct[node] = patch.area * std::abs(cosine) * visibility / (4.0f * (float)unda::maths::pi * squaredDistance);
+				directBin[node] = (size_t)std::lround((double)distance / (unda::maths::c * binLength));
+			}
+
+			// Bins only reach back, so each is a sparse product with the ones before it. A thread per band.
+			std::atomic<size_t> nextBand{ 0 };
+			unsigned int nThreads = (unsigned int)std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), N);
+			std::vector<std::thread> workers;
+			for (unsigned int thread = 0; thread < nThreads; thread++) {
+				workers.push_back(std::thread([&]() {
+					for (size_t bin = nextBand++; bin < N; bin = nextBand++) {
+						std::vector<float>& leaving = radiosity[bin];
+						leaving.assign(nBins * nNodes, 0.0f);
+						for (size_t k = 0; k < nBins; k++) {
+							float* current = leaving.data() + k * nNodes;
+							for (size_t node = 0; node < nNodes; node++) {
+								float incoming = directBin[node] == k ? direct[node] : 0.0f;
+								for (size_t i = transferStart[node]; i < transferStart[node + 1]; i++) {
+									const Transfer& transfer = transfers[i];
+									if (transfer.delay <= k) incoming += transfer.factor * leaving[(k - transfer.delay) * nNodes + transfer.from];
+								}
+								current[node] = patches[node / 2].reflection[bin] * incoming;
+							}
+						}
+					}
+				}));
+			}
+			for (std::thread& th : workers) th.join();
+
+			[[maybe_unused]] auto t2 = std::chrono::steady_clock::now();
+			UNDA_LOG_MESSAGE("RadianceTransfer: " + std::to_string(nBins) + " bins propagated in " + std::to_string(std::chrono::duration<double, std::milli>(t2 - t1).count()) + " ms");
+		}
+
+		template<size_t N>
+		BasicEnergyHistogram<N> BasicRadianceTransfer<N>::getLateField(const std::array<double, 3>& listenerPosition) const
+		{
+			BasicEnergyHistogram<N> histogram;
+			histogram.samplingFrequency = samplingFrequency;
+			histogram.binSamples = std::max<size_t>(1, (size_t)std::round(binLength * samplingFrequency));
+			for (std::vector<double>& bins : histogram.energy) bins.assign(nBins, 0.0);
+			if (!bvh || radiosity[0].empty()) return histogram;
+
+			// A Lambertian patch sends cos / pi of its energy per steradian; over 4 pi, as the histograms are on the
+			// image source scale.
+			Vector3 listener = { (float)listenerPosition[0], (float)listenerPosition[1], (float)listenerPosition[2] };
+			size_t nNodes = 2 * patches.size();
+			for (size_t p = 0; p < patches.size(); p++) {
+				const Patch& patch = patches[p];
+				Vector3 toListener = Subtract(listener, patch.centre);
+				float distance = Length(toListener);
+				if (distance <= 0 || patch.area <= 0) continue;
+				float cosine = Dot(patch.normal, toListener) / distance;
+				size_t node = 2 * p + (cosine > 0 ? 0 : 1);
+				float visibility = getVisibility(patch, getNodeNormal(node), listener);
+				if (visibility <= 0) continue;
+				float squaredDistance = std::max(distance * distance, patch.area / (float)unda::maths::pi);
+				double gain = (double)(std::abs(cosine) * visibility) / (4.0 * unda::maths::pi * unda::maths::pi * (double)squaredDistance);
+				size_t delay = (size_t)std::lround((double)distance / (unda::maths::c * binLength));
+				for (size_t bin = 0; bin < N; bin++) {
+					const std::vector<float>& leaving = radiosity[bin];
+					std::vector<double>& energy = histogram.energy[bin];
+					for (size_t k = 0; k + delay < nBins; k++) energy[k + delay] += gain * (double)leaving[k * nNodes + node];
+				}
+			}
+			return histogram;
+		}
+
+		template class BasicRadianceTransfer<6>;
+		template class BasicRadianceTransfer<10>;
+		template class BasicRadianceTransfer<31>;
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Acoustics.h"
+#include "Geometry.h"
+#include "RayTracer.h"
+#include "../utils/Settings.h"
+#include "../utils/Utils.h"
+#include "../utils/SIMD.h"
+#include <vector>
+#include <array>
+#include <memory>
+
+
+namespace unda {
+	namespace acoustics {
+
+		// Acoustic radiance transfer over a room mesh, for the late field of one static room. Sparse patch to patch
+		// transfers are traced once; setSource propagates energy over them, and getLateField gathers it at a listener.
+		template<size_t N>
+		class BasicRadianceTransfer {
+		public:
+			static constexpr size_t nBands = N;
+
+			BasicRadianceTransfer(const BasicRoomMesh<N>& mesh, int _nSamples, double _patchSize = 1.0, size_t _raysPerPatch = 256,
+								  double _binLength = 0.004, double _samplingFrequency = unda::sampleRate);
+			~BasicRadianceTransfer() = default;
+
+			void setSource(const std::array<double, 3>& sourcePosition);
+			// Reflected energy at the listener from the last source, zero before setSource. Casts a few shadow
+			// rays per patch for its visibility, but doesn't propagate again.
+			BasicEnergyHistogram<N> getLateField(const std::array<double, 3>& listenerPosition) const;
+
+			size_t getPatchCount() const { return patches.size(); }
+			size_t getTransferCount() const { return transfers.size(); }
+
+		private:
+			struct Patch {
+				Vector3 centre, normal;				// normal with its largest component positive
+				float area = 0;
+				std::array<float, N> reflection;	// 1 - alpha, area weighted over its triangles
+				std::vector<Vector3> samples;		// area weighted points on it, for ray origins and visibility
+			};
+			// Fraction of the energy leaving node from that reaches the receiving node, delay bins later.
+			struct Transfer {
+				unsigned int from;
+				unsigned int delay;
+				float factor;
+			};
+
+			std::unique_ptr<TriangleBVH> bvh;
+			std::vector<Patch> patches;
+			std::vector<unsigned int> trianglePatches;
+			// Node 2 p + side is patch p's front (0) or back (1). Its incoming transfers are
+			// transfers[transferStart[node], transferStart[node + 1]).
+			std::vector<size_t> transferStart;
+			std::vector<Transfer> transfers;
+
+			int nSamples;
+			double samplingFrequency, binLength;
+			size_t nBins, raysPerPatch;
+
+			// Energy leaving every node, [band][bin * nodes + node], from the last setSource.
+			std::array<std::vector<float>, N> radiosity;
+
+			void buildPatches(const BasicRoomMesh<N>& mesh, double patchSize);
+			void computeTransfers();
+			// Unit normal of node's side, and the fraction of the patch's samples with a clear line to point.
+			Vector3 getNodeNormal(size_t node) const;
+			float getVisibility(const Patch& patch, const Vector3& normal, const Vector3& point) const;
+
+			DISABLE_COPY_ASSIGN(BasicRadianceTransfer)
+		};
+		typedef BasicRadianceTransfer<6> RadianceTransfer;
+
+		extern template class BasicRadianceTransfer<6>;
+		extern template class BasicRadianceTransfer<10>;
+		extern template class BasicRadianceTransfer<31>;
+	}
+}
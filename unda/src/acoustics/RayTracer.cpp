@@ -0,0 +1,194 @@
+#include "RayTracer.h"
+#include "../utils/Maths.h"
+#include <thread>
+#include <atomic>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace unda {
+	namespace acoustics {
+		template<size_t N>
+		double BasicEnergyHistogram<N>::getAmplitude(size_t bin, size_t n, unsigned int decimation) const
+		{
+			const std::vector<double>& bins = energy[bin];
+			if (bins.empty() || binSamples == 0 || n >= bins.size() * binSamples) return 0.0;
+			double position = std::max(0.0, ((double)n + 0.5) / (double)binSamples - 0.5);
+			size_t k = std::min((size_t)position, bins.size() - 1);
+			double w = position - (double)k, next = k + 1 < bins.size() ? bins[k + 1] : bins[k];
+			// Energy per full rate sample, of which a band rate sample carries 1 / decimation.
+			double density = ((1.0 - w) * bins[k] + w * next) / (double)binSamples;
+			return std::sqrt(std::max(density, 0.0) / (double)std::max(decimation, 1u));
+		}
+
+		template<size_t N>
+		BasicRayTracer<N>::BasicRayTracer(const BasicRoomMesh<N>& mesh, const std::array<double, 3>& _sourcePosition, const std::array<double, 3>& _receiverPosition, int _nSamples,
+										  size_t _nRays, double _receiverRadius, float _scattering, double _binLength, double _samplingFrequency)
+			: source({ (float)_sourcePosition[0], (float)_sourcePosition[1], (float)_sourcePosition[2] })
+			, receiver({ (float)_receiverPosition[0], (float)_receiverPosition[1], (float)_receiverPosition[2] })
+			, nRays(std::max<size_t>(_nRays, 1))
+			, receiverRadius(std::max(_receiverRadius, 1e-3))
+			, maximumDistance((double)std::max(_nSamples, 1) * unda::maths::c / _samplingFrequency)
+			, scattering(std::min(std::max(_scattering, 0.0f), 1.0f))
+		{
+			histogram.samplingFrequency = _samplingFrequency;
+			histogram.binSamples = std::max<size_t>(1, (size_t)std::round(_binLength * _samplingFrequency));
+			size_t nBins = ((size_t)std::max(_nSamples, 1) + histogram.binSamples - 1) / histogram.binSamples;
+			for (std::vector<double>& bins : histogram.energy) bins.assign(nBins, 0.0);
+
+			if (mesh.vertices.size() != 3 * mesh.getTriangleCount()) {
+				UNDA_ERROR("RayTracer: the mesh needs three vertices and a material per triangle");
+				return;
+			}
+			triangleMaterials = mesh.materials;
+			for (const BasicMaterial<N>& surface : mesh.surfaces) {
+				std::array<float, N> alpha;
+				for (size_t bin = 0; bin < N; bin++) alpha[bin] = (float)surface.alphaCoefficients[bin];
+				absorption.push_back(alpha);
+			}
+			if (absorption.empty()) absorption.push_back(std::array<float, N>{});
+			for (unsigned int& material : triangleMaterials) if (material >= absorption.size()) material = 0;
+			bvh = std::make_unique<TriangleBVH>(mesh.vertices);
+		}
+
+		template<size_t N>
+		void BasicRayTracer<N>::addReceiverEnergy(const Ray& ray, float length, BasicEnergyHistogram<N>& result, size_t& hits) const
+		{
+			// Closest approach of the segment's line, then the chord of the sphere within the segment. Summed over
+			// rays, chord / volume is 1 / (4 pi r^2) of the energy for the direct sound, which is 4 pi times the
+			// squared 1 / (4 pi r) of an image source.
+			Vector3 toReceiver = Subtract(receiver, ray.origin);
+			float along = Dot(toReceiver, ray.direction), squaredMiss = Dot(toReceiver, toReceiver) - along * along;
+			float squaredRadius = (float)(receiverRadius * receiverRadius);
+			if (squaredMiss >= squaredRadius) return;
+			float half = sqrtf(squaredRadius - squaredMiss);
+			float chord = std::min(along + half, length) - std::max(along - half, 0.0f);
+			if (chord <= 0) return;
+			double arrival = (ray.travelled + (double)std::min(std::max(along, 0.0f), length)) * result.samplingFrequency / unda::maths::c;
+			size_t k = (size_t)(arrival / (double)result.binSamples);
+			if (k >= result.energy[0].size()) return;
+			double volume = 4.0 / 3.0 * M_PI * receiverRadius * receiverRadius * receiverRadius;
+			double scale = (double)chord / (volume * 4.0 * M_PI);
+			for (size_t bin = 0; bin < N; bin++) result.energy[bin][k] += scale * (double)ray.energy[bin];
+			hits++;
+		}
+
+		template<size_t N>
+		size_t BasicRayTracer<N>::traceBatch(size_t batch, BasicEnergyHistogram<N>& result) const
+		{
+			std::seed_seq sequence{ seed, (unsigned int)batch };
+			std::mt19937 generator(sequence);
+			std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+			const float initialEnergy = 1.0f / (float)nRays, threshold = 1e-9f * initialEnergy;
+			size_t first = batch * batchSize, count = std::min(batchSize, nRays - first), launched = 0, hits = 0;
+
+			auto launch = [&](Ray& ray) {
+				float z = 2.0f * uniform(generator) - 1.0f, phi = 2.0f * (float)M_PI * uniform(generator), radius = sqrtf(std::max(0.0f, 1.0f - z * z));
+				ray.origin = source;
+				ray.direction = { radius * cosf(phi), radius * sinf(phi), z };
+				ray.travelled = 0;
+				ray.energy.fill(initialEnergy);
+				launched++;
+			};
+			std::array<Ray, simd::width> rays;
+			std::array<bool, simd::width> live;
+			for (size_t lane = 0; lane < simd::width; lane++) {
+				live[lane] = launched < count;
+				if (live[lane]) launch(rays[lane]);
+			}
+
+			RayPacket packet;
+			while (std::any_of(live.begin(), live.end(), [](bool value) { return value; })) {
+				for (size_t lane = 0; lane < simd::width; lane++) {
+					for (int axis = 0; axis < 3; axis++) {
+						packet.origin[axis][lane] = rays[lane].origin[axis];
+						packet.direction[axis][lane] = rays[lane].direction[axis];
+					}
+					packet.tMin[lane] = live[lane] ? 1e-4f : 0.0f;
+					packet.tMax[lane] = live[lane] ? (float)(maximumDistance - rays[lane].travelled) : 0.0f;
+				}
+				bvh->intersect(packet);
+
+				for (size_t lane = 0; lane < simd::width; lane++) {
+					if (!live[lane]) continue;
+					Ray& ray = rays[lane];
+					int triangle = packet.triangle[lane];
+					float length = triangle < 0 ? packet.tMax[lane] : packet.distance[lane];
+					addReceiverEnergy(ray, length, result, hits);
+
+					// A miss is out of time, or out through a hole in the mesh.
+					bool ended = triangle < 0;
+					if (!ended) {
+						const std::array<float, N>& alpha = absorption[triangleMaterials[triangle]];
+						float loudest = 0;
+						for (size_t bin = 0; bin < N; bin++) {
+							ray.energy[bin] *= 1.0f - alpha[bin];
+							loudest = std::max(loudest, ray.energy[bin]);
+						}
+						ended = loudest < threshold;
+					}
+					if (!ended) {
+						Vector3 normal = bvh->getNormal((size_t)triangle);
+						if (Dot(normal, ray.direction) > 0) normal = Scale(normal, -1.0f);
+						Vector3 hit = Add(ray.origin, Scale(ray.direction, length));
+						if (uniform(generator) < scattering) {
+							// Lambert: cosine weighted about the normal.
+							Vector3 tangent = Normalise(std::abs(normal[0]) < 0.9f ? Cross(normal, { 1.0f, 0.0f, 0.0f }) : Cross(normal, { 0.0f, 1.0f, 0.0f }));
+							Vector3 bitangent = Cross(normal, tangent);
+							float r = uniform(generator), angle = 2.0f * (float)M_PI * uniform(generator), sine = sqrtf(r);
+							ray.direction = Normalise(Add(Add(Scale(tangent, sine * cosf(angle)), Scale(bitangent, sine * sinf(angle))), Scale(normal, sqrtf(std::max(0.0f, 1.0f - r)))));
+						}
+						else ray.direction = Subtract(ray.direction, Scale(normal, 2.0f * Dot(ray.direction, normal)));
+						ray.origin = Add(hit, Scale(normal, 1e-4f));
+						ray.travelled += (double)length;
+						ended = ray.travelled >= maximumDistance;
+					}
+					if (!ended) continue;
+					live[lane] = launched < count;
+					if (live[lane]) launch(ray);
+				}
+			}
+			return hits;
+		}
+
+		template<size_t N>
+		void BasicRayTracer<N>::trace()
+		{
+			for (std::vector<double>& bins : histogram.energy) std::fill(bins.begin(), bins.end(), 0.0);
+			receiverHits = 0;
+			if (!bvh) return;
+			[[maybe_unused]] auto t1 = std::chrono::steady_clock::now();
+
+			size_t nBatches = (nRays + batchSize - 1) / batchSize;
+			unsigned int nThreads = (unsigned int)std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), nBatches);
+			std::vector<BasicEnergyHistogram<N>> workerHistograms(nThreads, histogram);
+			std::vector<size_t> workerHits(nThreads, 0);
+			std::atomic<size_t> nextBatch{ 0 };
+			std::vector<std::thread> workers;
+			for (unsigned int thread = 0; thread < nThreads; thread++) {
+				workers.push_back(std::thread([&, thread]() {
+					for (size_t batch = nextBatch++; batch < nBatches; batch = nextBatch++)
+						workerHits[thread] += traceBatch(batch, workerHistograms[thread]);
+				}));
+			}
+			for (std::thread& th : workers) th.join();
+			for (unsigned int thread = 0; thread < nThreads; thread++) {
+				for (size_t bin = 0; bin < N; bin++)
+					for (size_t k = 0; k < histogram.energy[bin].size(); k++) histogram.energy[bin][k] += workerHistograms[thread].energy[bin][k];
+				receiverHits += workerHits[thread];
+			}
+
+			[[maybe_unused]] auto t2 = std::chrono::steady_clock::now();
+			UNDA_LOG_MESSAGE("RayTracer: " + std::to_string(nRays) + " rays, " + std::to_string(receiverHits) + " receiver crossings in " +
+				std::to_string(std::chrono::duration<double, std::milli>(t2 - t1).count()) + " ms");
+		}
+
+		template struct BasicEnergyHistogram<6>;
+		template struct BasicEnergyHistogram<10>;
+		template struct BasicEnergyHistogram<31>;
+		template class BasicRayTracer<6>;
+		template class BasicRayTracer<10>;
+		template class BasicRayTracer<31>;
+	}
+}
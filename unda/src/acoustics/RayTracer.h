@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Acoustics.h"
+#include "Geometry.h"
+#include "../utils/Settings.h"
+#include "../utils/Utils.h"
+#include "../utils/SIMD.h"
+#include <vector>
+#include <array>
+#include <memory>
+
+
+namespace unda {
+	namespace acoustics {
+
+		// Energy reaching the receiver per band, in bins of binSamples: the summed squared image source amplitudes.
+		template<size_t N>
+		struct BasicEnergyHistogram {
+			double samplingFrequency = unda::sampleRate;
+			size_t binSamples = 0;
+			std::array<std::vector<double>, N> energy;
+
+			// RMS of band rate noise carrying the same energy at full rate sample n, zero past the end.
+			double getAmplitude(size_t bin, size_t n, unsigned int decimation = 1) const;
+		};
+		typedef BasicEnergyHistogram<6> EnergyHistogram;
+
+		// Stochastic ray tracer over a room mesh, for the late field of rooms that aren't boxes. Rays are traced
+		// through the BVH four at a time, in batches seeded by their index so the result doesn't depend on threads.
+		template<size_t N>
+		class BasicRayTracer {
+		public:
+			static constexpr size_t nBands = N;
+			static constexpr size_t batchSize = 1024;
+
+			BasicRayTracer(const BasicRoomMesh<N>& mesh, const std::array<double, 3>& _sourcePosition, const std::array<double, 3>& _receiverPosition, int _nSamples,
+						   size_t _nRays = 20000, double _receiverRadius = 0.5, float _scattering = 0.1f, double _binLength = 0.001, double _samplingFrequency = unda::sampleRate);
+			~BasicRayTracer() = default;
+
+			void setSeed(unsigned int _seed) { seed = _seed; }
+			void trace();
+			const BasicEnergyHistogram<N>& getHistogram() const { return histogram; }
+			size_t getReceiverHits() const { return receiverHits; }
+
+		private:
+			// One ray in flight.
+			struct Ray {
+				Vector3 origin, direction;		// direction is unit length
+				double travelled = 0;			// metres
+				std::array<float, N> energy;
+			};
+
+			std::unique_ptr<TriangleBVH> bvh;
+			std::vector<unsigned int> triangleMaterials;
+			std::vector<std::array<float, N>> absorption;		// per material, alpha
+
+			Vector3 source, receiver;
+			size_t nRays;
+			double receiverRadius, maximumDistance;
+			float scattering;
+			unsigned int seed = 0x5eed;
+
+			BasicEnergyHistogram<N> histogram;
+			size_t receiverHits = 0;
+
+			// Batch batch into histogram, returning the segments that crossed the receiver.
+			size_t traceBatch(size_t batch, BasicEnergyHistogram<N>& result) const;
+			void addReceiverEnergy(const Ray& ray, float length, BasicEnergyHistogram<N>& result, size_t& hits) const;
+
+			DISABLE_COPY_ASSIGN(BasicRayTracer)
+		};
+		typedef BasicRayTracer<6> RayTracer;
+
+		extern template struct BasicEnergyHistogram<6>;
+		extern template struct BasicEnergyHistogram<10>;
+		extern template struct BasicEnergyHistogram<31>;
+		extern template class BasicRayTracer<6>;
+		extern template class BasicRayTracer<10>;
+		extern template class BasicRayTracer<31>;
+	}
+}
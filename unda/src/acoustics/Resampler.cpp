@@ -0,0 +1,59 @@
+#include "Resampler.h"
+#include "DSP.h"
+#include <numeric>
+
+namespace unda {
+	Resampler::Resampler(double _inputRate, double _outputRate, unsigned int _tapsPerPhase)
+		: tapsPerPhase(simd::roundUp(std::max(2u, _tapsPerPhase)))
+	{
+		UNDA_ASSERT(_inputRate > 0 && _outputRate > 0);
+		size_t inputRate = (size_t)std::llround(_inputRate), outputRate = (size_t)std::llround(_outputRate);
+		size_t divisor = std::gcd(inputRate, outputRate);
+		L = outputRate / divisor;
+		M = inputRate / divisor;
+
+		phases.assign(L * tapsPerPhase, 0.0f);
+		if (isIdentity()) {
+			// Plain delay by the centre tap, cancelled like the filter's group delay.
+			phases[tapsPerPhase - 1 - tapsPerPhase / 2] = 1.0f;
+		}
+		else {
+			// designLPF is centred on L * tapsPerPhase / 2, a whole number of input samples.
+			Signal h = designLPF((unsigned int)(L * tapsPerPhase), 0.92f * 0.5f / (float)std::max(L, M));
+			for (size_t p = 0; p < L; p++)
+				for (size_t tap = 0; tap < tapsPerPhase; tap++)
+					phases[p * tapsPerPhase + tapsPerPhase - 1 - tap] = (float)L * h[tap * L + p];
+		}
+		reset();
+	}
+
+	void Resampler::reset()
+	{
+		history.assign(tapsPerPhase - 1, 0.0f);
+		position = tapsPerPhase - 1 + tapsPerPhase / 2;
+		phase = 0;
+	}
+
+	size_t Resampler::process(const float* input, size_t nInput, float* output)
+	{
+		history.insert(history.end(), input, input + nInput);
+		size_t nOutput = 0;
+		while (position < history.size()) {
+			const float* window = history.data() + position + 1 - tapsPerPhase;
+			const float* taps = phases.data() + phase * tapsPerPhase;
+			simd::float4 sum = simd::zero();
+			for (size_t tap = 0; tap < tapsPerPhase; tap += simd::width)
+				sum = simd::madd(simd::loadu(window + tap), simd::load(taps + tap), sum);
+			output[nOutput++] = simd::hsum(sum);
+
+			phase += M;
+			position += phase / L;
+			phase %= L;
+		}
+		// Keep what the next outputs still reach back to.
+		size_t consumed = std::min(position + 1 - tapsPerPhase, history.size());
+		history.erase(history.begin(), history.begin() + consumed);
+		position -= consumed;
+		return nOutput;
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "../utils/Utils.h"
+#include "../utils/SIMD.h"
+#include <vector>
+
+
+namespace unda {
+
+	// Streaming rational sample rate converter, up by L and down by M with L / M = outputRate / inputRate
+	// in lowest terms (160 / 147 for 44.1 to 48 kHz).
+	// The prototype is a Blackman windowed-sinc at 0.92 of the lower Nyquist with L * tapsPerPhase taps,
+	// stored as L time-reversed phases of tapsPerPhase taps, so an output sample is one SIMD dot product
+	// over the last tapsPerPhase inputs. The group delay is compensated: output[k] is the input at
+	// k * M / L, which needs getLatency() inputs past it, fed as zeros at the end of a stream.
+	class Resampler {
+	public:
+		Resampler(double _inputRate, double _outputRate, unsigned int _tapsPerPhase = 64);
+		~Resampler() = default;
+
+		bool isIdentity() const { return L == M; }
+		size_t getLatency() const { return tapsPerPhase / 2; }
+		// Upper bound on the outputs of one process call of nInput samples.
+		size_t getMaximumOutput(size_t nInput) const { return (nInput * L) / M + 2; }
+		// Outputs for a whole signal of nInput samples.
+		size_t getOutputLength(size_t nInput) const { return (nInput * L + M - 1) / M; }
+
+		// Consumes all of input. Returns the number of samples written to output.
+		size_t process(const float* input, size_t nInput, float* output);
+		void reset();
+
+	private:
+		size_t L, M;
+		size_t tapsPerPhase;
+		simd::AlignedVector<float> phases;		// L x tapsPerPhase, time-reversed, gain L folded in
+
+		// Inputs still needed: tapsPerPhase - 1 of history, then everything not yet passed.
+		std::vector<float> history;
+		size_t position = 0;		// index into history of the newest input under the filter
+		size_t phase = 0;
+
+		DISABLE_COPY_ASSIGN(Resampler)
+	};
+}
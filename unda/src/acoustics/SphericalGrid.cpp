@@ -0,0 +1,63 @@
+#include "SphericalGrid.h"
+#include "../utils/Maths.h"
+#include <algorithm>
+#include <cmath>
+
+namespace unda {
+	namespace acoustics {
+		std::array<float, 3> DirectionFromAngles(double azimuth, double elevation)
+		{
+			double a = azimuth * M_PI / 180.0, e = elevation * M_PI / 180.0;
+			return { (float)(cos(e) * cos(a)), (float)(cos(e) * sin(a)), (float)sin(e) };
+		}
+
+		void SphericalGrid::build(const std::vector<std::array<float, 3>>& directions, bool interpolate, double gridStep)
+		{
+			gridStep = std::max(gridStep, 0.1);
+			nAzimuths = (size_t)std::round(360.0 / gridStep);
+			nElevations = (size_t)std::round(180.0 / gridStep) + 1;
+			cells.assign(nAzimuths * nElevations, Cell());
+			if (directions.empty()) return;
+			for (size_t e = 0; e < nElevations; e++) {
+				for (size_t a = 0; a < nAzimuths; a++) {
+					std::array<float, 3> centre = DirectionFromAngles((double)a * 360.0 / (double)nAzimuths, -90.0 + (double)e * 180.0 / (double)(nElevations - 1));
+					// The three closest measurements, by largest dot product.
+					std::array<float, 3> best = { -2.0f, -2.0f, -2.0f };
+					Cell& cell = cells[e * nAzimuths + a];
+					for (unsigned int m = 0; m < (unsigned int)directions.size(); m++) {
+						float dot = centre[0] * directions[m][0] + centre[1] * directions[m][1] + centre[2] * directions[m][2];
+						for (size_t rank = 0; rank < 3; rank++) {
+							if (dot <= best[rank]) continue;
+							for (size_t shift = 2; shift > rank; shift--) {
+								best[shift] = best[shift - 1];
+								cell.measurements[shift] = cell.measurements[shift - 1];
+							}
+							best[rank] = dot;
+							cell.measurements[rank] = m;
+							break;
+						}
+					}
+
+					cell.weights = { 1.0f, 0.0f, 0.0f };
+					if (!interpolate || directions.size() < 3) continue;
+					float angles[3], sum = 0;
+					for (size_t rank = 0; rank < 3; rank++) angles[rank] = acosf(std::min(1.0f, best[rank]));
+					if (angles[0] < 1e-3f) continue;
+					for (size_t rank = 0; rank < 3; rank++) sum += cell.weights[rank] = 1.0f / angles[rank];
+					for (float& weight : cell.weights) weight /= sum;
+				}
+			}
+		}
+
+		size_t SphericalGrid::getIndex(double x, double y, double z) const
+		{
+			double norm = sqrt(x * x + y * y + z * z);
+			double azimuth = atan2(y, x) * 180.0 / M_PI;
+			if (azimuth < 0) azimuth += 360.0;
+			double elevation = norm > 0 ? asin(std::max(-1.0, std::min(1.0, z / norm))) * 180.0 / M_PI : 0.0;
+			size_t a = (size_t)std::llround(azimuth * (double)nAzimuths / 360.0) % nAzimuths;
+			size_t e = (size_t)std::llround((elevation + 90.0) * (double)(nElevations - 1) / 180.0);
+			return std::min(e, nElevations - 1) * nAzimuths + a;
+		}
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../utils/Settings.h"
+#include "../utils/Utils.h"
+#include <vector>
+#include <array>
+
+
+namespace unda {
+	namespace acoustics {
+
+		// Unit vector, x to the front, y to the left and z up, for angles in degrees with azimuth anticlockwise.
+		std::array<float, 3> DirectionFromAngles(double azimuth, double elevation);
+
+		// Grid of gridStep degree cells over a set of measured directions, each cell holding its nearest
+		// measurement, or its three nearest weighted by inverse angular distance when interpolating, so a
+		// lookup is two roundings and an index. Shared by HRTFSet and BasicSourceDirectivity.
+		class SphericalGrid {
+		public:
+			struct Cell {
+				std::array<unsigned int, 3> measurements{};
+				std::array<float, 3> weights{};
+			};
+
+			SphericalGrid() = default;
+			~SphericalGrid() = default;
+
+			// Unit directions as DirectionFromAngles gives them.
+			void build(const std::vector<std::array<float, 3>>& directions, bool interpolate, double gridStep);
+			bool isBuilt() const { return !cells.empty(); }
+			size_t getCellCount() const { return cells.size(); }
+
+			// The cell (x, y, z) falls in, not necessarily unit length.
+			size_t getIndex(double x, double y, double z) const;
+			const Cell& getCell(size_t index) const { return cells[index]; }
+
+		private:
+			size_t nAzimuths = 0, nElevations = 0;
+			std::vector<Cell> cells;	// elevation x azimuth
+		};
+	}
+}
@@ -202,6 +202,7 @@ namespace unda {
             mesh.aabb.max.z /= maxAABB;
         }
 
+        minimum = absMin;
         volume = absMax - absMin;
         normaliseMeshes();
     }
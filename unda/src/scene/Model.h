@@ -85,6 +85,8 @@ namespace unda {
 
 		double getModelScale() { return normalisationScale; }
 		glm::vec3 getVolume() { return volume; }
+		// World position of the volume's lowest corner, the origin of room coordinates.
+		glm::vec3 getMinimum() { return minimum; }
 
 		bool exportModel(const std::string& filename, bool overwrite = false);
 		void recomputeAABBs() { normaliseMeshes(); calculateAABB(); }
@@ -97,6 +99,7 @@ namespace unda {
 	private:
 
 		glm::vec3 volume = glm::vec3();
+		glm::vec3 minimum = glm::vec3();
 		double normalisationScale = 1.0;
 		bool isBuffered = false;
 		std::vector<Mesh> meshes;
@@ -48,6 +48,93 @@ namespace unda {
 
 	// ---------------------------------------------------------------------------
 
+	// The reduced surface as a room for the geometric models: the mesh's bounding box is fitted to the scene
+	// dimensions in metres, and every triangle takes the SurfaceAbsorption row of the box face it's closest to
+	// being, by the major axis of its normal and the half of the room it's in.
+	static acoustics::RoomMesh RoomMeshFromModel(Model& model, const std::array<double, 3>& spaceDimensions, const std::array<std::array<double, 6>, 6>& alphaCoefficients)
+	{
+		acoustics::RoomMesh room;
+		for (int face = 0; face < 6; face++) room.surfaces.push_back(acoustics::Material("Face " + std::to_string(face), alphaCoefficients[face]));
+		for (Mesh& mesh : model.getMeshes()) {
+			if (!mesh.vertices) continue;
+			const std::vector<Vertex>& vertices = *mesh.vertices;
+			if (mesh.indices && !mesh.indices->empty())
+				for (unsigned int index : *mesh.indices) room.vertices.push_back({ vertices[index].x, vertices[index].y, vertices[index].z });
+			else
+				for (const Vertex& vertex : vertices) room.vertices.push_back({ vertex.x, vertex.y, vertex.z });
+		}
+		room.vertices.resize(room.vertices.size() / 3 * 3);
+		if (room.vertices.empty()) return room;
+
+		acoustics::Vector3 low = room.vertices[0], high = room.vertices[0];
+		for (const acoustics::Vector3& vertex : room.vertices) {
+			for (int axis = 0; axis < 3; axis++) {
+				low[axis] = std::min(low[axis], vertex[axis]);
+				high[axis] = std::max(high[axis], vertex[axis]);
+			}
+		}
+		for (acoustics::Vector3& vertex : room.vertices)
+			for (int axis = 0; axis < 3; axis++)
+				vertex[axis] = high[axis] > low[axis] ? (vertex[axis] - low[axis]) / (high[axis] - low[axis]) * (float)spaceDimensions[axis] : 0.0f;
+		for (size_t t = 0; t < room.vertices.size(); t += 3) {
+			acoustics::Vector3 normal = acoustics::Cross(acoustics::Subtract(room.vertices[t + 1], room.vertices[t]), acoustics::Subtract(room.vertices[t + 2], room.vertices[t]));
+			int axis = 0;
+			for (int a = 1; a < 3; a++) if (std::abs(normal[a]) > std::abs(normal[axis])) axis = a;
+			float centre = (room.vertices[t][axis] + room.vertices[t + 1][axis] + room.vertices[t + 2][axis]) / 3.0f;
+			room.materials.push_back(2 * axis + (centre > 0.5f * (float)spaceDimensions[axis] ? 1 : 0));
+		}
+		return room;
+	}
+
+	// The marching cubes input field as a voxel room: its occupied cells stretched to the scene dimensions, as the
+	// surface is by RoomMeshFromModel, each taking the SurfaceAbsorption row of the box face nearest to it.
+	static acoustics::VoxelRoom VoxelRoomFromField(const LatticeVector3D& field, const std::array<double, 3>& spaceDimensions, const std::array<std::array<double, 6>, 6>& alphaCoefficients)
+	{
+		acoustics::VoxelRoom room;
+		for (int face = 0; face < 6; face++) {
+			room.surfaces.push_back(acoustics::Material("Face " + std::to_string(face), alphaCoefficients[face]));
+			room.faces[face] = face;
+		}
+		room.dimensions = spaceDimensions;
+		std::array<size_t, 3> fieldSize = { field.sizeX, field.sizeY, field.sizeZ }, low = fieldSize, high = { 0, 0, 0 };
+		for (size_t x = 0; x < field.sizeX; x++) {
+			for (size_t y = 0; y < field.sizeY; y++) {
+				for (size_t z = 0; z < field.sizeZ; z++) {
+					if (field.getValue(x, y, z).value <= 0.5f) continue;
+					std::array<size_t, 3> index = { x, y, z };
+					for (int axis = 0; axis < 3; axis++) {
+						low[axis] = std::min(low[axis], index[axis]);
+						high[axis] = std::max(high[axis], index[axis] + 1);
+					}
+				}
+			}
+		}
+		// An empty field is an empty box.
+		if (high[0] == 0) {
+			low = { 0, 0, 0 };
+			high = fieldSize;
+		}
+		for (int axis = 0; axis < 3; axis++) room.size[axis] = std::max<size_t>(1, high[axis] - low[axis]);
+		room.cells.assign(room.size[0] * room.size[1] * room.size[2], 0);
+		for (size_t x = 0; x < room.size[0]; x++) {
+			for (size_t y = 0; y < room.size[1]; y++) {
+				for (size_t z = 0; z < room.size[2]; z++) {
+					std::array<size_t, 3> index = { x, y, z };
+					if (low[0] + x >= field.sizeX || low[1] + y >= field.sizeY || low[2] + z >= field.sizeZ || field.getValue(low[0] + x, low[1] + y, low[2] + z).value <= 0.5f) continue;
+					int nearest = 0;
+					double distance = 2.0;
+					for (int axis = 0; axis < 3; axis++) {
+						double position = ((double)index[axis] + 0.5) / (double)room.size[axis];
+						if (position < distance) { distance = position; nearest = 2 * axis; }
+						if (1.0 - position < distance) { distance = 1.0 - position; nearest = 2 * axis + 1; }
+					}
+					room.cells[(x * room.size[1] + y) * room.size[2] + z] = (unsigned char)(nearest + 1);
+				}
+			}
+		}
+		return room;
+	}
+
 	Scene::Scene() :
 		boundingBoxRenderer(nullptr)
 	{
@@ -133,21 +220,208 @@ namespace unda {
 		std::array<double, 3> spaceDimensions = { (double)sceneVolume.x, (double)sceneVolume.y, (double)sceneVolume.z };
 		std::array<double, 3> source = configuration["IR"]["SourcePosition"].get<std::array<double, 3>>();
 		std::array<double, 3> listener = configuration["IR"]["ListenerPosition"].get<std::array<double, 3>>();
+		roomDimensions = sceneVolume;
+		roomOrigin = inputScene->getMinimum();
+		listenerPosition = glm::vec3((float)listener[0], (float)listener[1], (float)listener[2]);
 
 		int nThreads = 30, ISM_sampleRate = (int)unda::sampleRate, nTaps = 2048; //11025
 		int nSamples = (int)std::round((double)ISM_sampleRate * configuration["IR"]["TailLength"].get<double>());
-		acoustics::ImageSourceModel* ism = new acoustics::ImageSourceModel(spaceDimensions, source, listener, betaCoefficients, 0, configuration["IR"]["Order"].get<unsigned int>());
-		if (configuration["IR"]["GenerateIR"].get<int>())
-			ism->dispatchCPUThreads();
+		unsigned int order = configuration["IR"]["Order"].get<unsigned int>();
+		imageSourceModel = std::make_unique<acoustics::ImageSourceModel>(spaceDimensions, source, listener, betaCoefficients, nSamples, order);
+		// A TailLength of 0 means the T60, which only the image source model works out, so every other model
+		// and the cache key take its length.
+		nSamples = imageSourceModel->getSampleCount();
+		if (configuration["DSP"].contains("CalibrateConvolution") && configuration["DSP"]["CalibrateConvolution"].get<int>())
+			SetConvolutionCostModel(ConvolutionCostModel::calibrate());
+		BandFilterType bandFilter = BandFilterType::FIR;
+		if (configuration["DSP"].contains("BandFilter") && configuration["DSP"]["BandFilter"].get<std::string>() == "IIR")
+			bandFilter = BandFilterType::IIR;
+		bool multirate = configuration["DSP"].contains("Multirate") && configuration["DSP"]["Multirate"].get<int>();
+		imageSourceModel->setBandFilterType(bandFilter, multirate);
+		acoustics::LateTailModel lateTailModel = acoustics::LateTailModel::Noise;
+		if (configuration["IR"].contains("Hybrid") && configuration["IR"]["Hybrid"]["Enabled"].get<int>()) {
+			if (configuration["IR"]["Hybrid"].contains("Model") && configuration["IR"]["Hybrid"]["Model"].get<std::string>() == "FDN")
+				lateTailModel = acoustics::LateTailModel::FDN;
+			if (configuration["IR"]["Hybrid"].contains("Model") && configuration["IR"]["Hybrid"]["Model"].get<std::string>() == "RayTraced" && marchingCubesModel)
+				lateTailModel = acoustics::LateTailModel::RayTraced;
+			if (configuration["IR"]["Hybrid"].contains("Model") && configuration["IR"]["Hybrid"]["Model"].get<std::string>() == "RadianceTransfer" && marchingCubesModel)
+				lateTailModel = acoustics::LateTailModel::RadianceTransfer;
+			imageSourceModel->setHybridTransition(configuration["IR"]["Hybrid"]["TransitionTime"].get<double>(), configuration["IR"]["Hybrid"]["TransitionOrder"].get<unsigned int>(), lateTailModel);
+		}
+		if (lateTailModel == acoustics::LateTailModel::RayTraced) {
+			// The late field of the reduced surface rather than the box's Sabine decay.
+			acoustics::RayTracer rayTracer(RoomMeshFromModel(*marchingCubesModel, spaceDimensions, alphaCoeffiecients), source, listener, nSamples,
+				(size_t)configuration["IR"]["RayTracing"]["Rays"].get<double>(), configuration["IR"]["RayTracing"]["ReceiverRadius"].get<double>(),
+				configuration["IR"]["RayTracing"]["Scattering"].get<float>());
+			rayTracer.trace();
+			imageSourceModel->setLateField(std::make_shared<acoustics::EnergyHistogram>(rayTracer.getHistogram()));
+		}
+		if (lateTailModel == acoustics::LateTailModel::RadianceTransfer) {
+			radianceTransfer = std::make_unique<acoustics::RadianceTransfer>(RoomMeshFromModel(*marchingCubesModel, spaceDimensions, alphaCoeffiecients), nSamples,
+				configuration["IR"]["RadianceTransfer"]["PatchSize"].get<double>(), (size_t)configuration["IR"]["RadianceTransfer"]["RaysPerPatch"].get<double>(),
+				configuration["IR"]["RadianceTransfer"]["BinLength"].get<double>());
+			radianceTransfer->setSource(source);
+			imageSourceModel->setLateField(std::make_shared<acoustics::EnergyHistogram>(radianceTransfer->getLateField(listener)));
+		}
+		if (configuration["IR"].contains("AmbisonicOrder"))
+			imageSourceModel->setAmbisonicOrder(configuration["IR"]["AmbisonicOrder"].get<unsigned int>());
+		if (configuration["IR"].contains("Binaural") && configuration["IR"]["Binaural"]["Enabled"].get<int>()) {
+			bool interpolate = configuration["IR"]["Binaural"]["Interpolate"].get<int>() != 0;
+			imageSourceModel->setHRTF(std::make_shared<acoustics::HRTFSet>(configuration["IR"]["Binaural"]["Directory"].get<std::string>(), unda::sampleRate, interpolate));
+		}
+		uint64_t directivityChecksum = 0;
+		if (configuration["IR"].contains("Directivity") && configuration["IR"]["Directivity"]["Enabled"].get<int>()) {
+			bool interpolate = configuration["IR"]["Directivity"]["Interpolate"].get<int>() != 0;
+			std::shared_ptr<acoustics::SourceDirectivity> directivity = std::make_shared<acoustics::SourceDirectivity>(configuration["IR"]["Directivity"]["File"].get<std::string>(),
+				configuration["IR"]["Directivity"]["Front"].get<std::array<double, 3>>(), interpolate);
+			if (directivity->isLoaded()) directivityChecksum = directivity->getChecksum();
+			imageSourceModel->setSourceDirectivity(directivity);
+		}
 
-		delete ism;	
-		{
+		// The low bands from the wave equation over the voxel field, where the geometric models fall short.
+		bool waveBands = configuration["IR"].contains("Wave") && configuration["IR"]["Wave"]["Enabled"].get<int>();
+		if (waveBands) {
+			acoustics::FDTDSolver solver(VoxelRoomFromField(marchingCubes->getScalarField(), spaceDimensions, alphaCoeffiecients), source, listener, nSamples,
+				configuration["IR"]["Wave"]["MaximumFrequency"].get<double>(), configuration["IR"]["Wave"]["PointsPerWavelength"].get<double>());
+			solver.dispatchCPUThreads();
+			imageSourceModel->setWaveBands(std::make_shared<std::vector<Signal>>(solver.getIRs()));
+		}
+
+		// Polygonal ISM over the reduced surface instead of the shoebox, for rooms that are far from boxes.
+		std::unique_ptr<acoustics::PolygonImageSourceModel> meshModel;
+		if (configuration["IR"].contains("Mesh") && configuration["IR"]["Mesh"]["Enabled"].get<int>() && marchingCubesModel)
+			meshModel = std::make_unique<acoustics::PolygonImageSourceModel>(RoomMeshFromModel(*marchingCubesModel, spaceDimensions, alphaCoeffiecients), source, listener,
+				nSamples, configuration["IR"]["Mesh"]["Order"].get<unsigned int>());
+
+		// Identical IR blocks are served from the on-disk cache instead of re-running the ISM. The key doesn't
+		// cover the geometry or the spatial channels, so neither the mesh or voxel based models nor those are cached.
+		std::unique_ptr<acoustics::CachedIR> cachedIR;
+		acoustics::IRCacheKey cacheKey = acoustics::IRCacheKey::make(spaceDimensions, source, listener, betaCoefficients, order, (double)ISM_sampleRate, nSamples, bandFilter, multirate,
+			imageSourceModel->getTransitionSamples(), lateTailModel, directivityChecksum);
+		bool meshTail = lateTailModel == acoustics::LateTailModel::RayTraced || lateTailModel == acoustics::LateTailModel::RadianceTransfer;
+		bool spatialOutput = imageSourceModel->getAmbisonicOrder() > 0 || imageSourceModel->getHRTF();
+		if (!meshModel && !waveBands && !meshTail && !spatialOutput && configuration["IR"].contains("Cache") && configuration["IR"]["Cache"]["Enabled"].get<int>()) {
+			size_t budget = (size_t)configuration["IR"]["Cache"]["BudgetMB"].get<double>() * 1024 * 1024;
+			irCache = std::make_unique<acoustics::IRCache>(configuration["IR"]["Cache"]["Directory"].get<std::string>(), budget);
+			cachedIR = irCache->load(cacheKey);
+		}
+		auralisation = std::make_unique<PartitionedConvolver>((size_t)nSamples);
+		Signal ir;
+		std::vector<Signal> ambisonicIR, binauralIR;
+		// The camera is the listener, in room coordinates, except for the mesh model, which has no fast listener path.
+		listenerFollowsCamera = !meshModel && configuration["IR"].contains("ListenerFollowsCamera") && configuration["IR"]["ListenerFollowsCamera"].get<int>();
+		// From the configured listener, so the first frame doesn't move it.
+		if (listenerFollowsCamera)
+			camera->setPosition(roomOrigin + listenerPosition);
+		if (meshModel) {
+			meshModel->dispatchCPUThreads();
+			ir = meshModel->getOutput();
+			WriteAudioFile({ ir }, "ir_mesh.wav");
+			auralisation->setImpulseResponse(ir);
+		}
+		else if (cachedIR) {
+			ir = cachedIR->getOutputSignal();
+			WriteAudioFile({ ir }, "ir.wav");
+			auralisation->setImpulseResponse(ir);
+		}
+		else if (configuration["IR"].contains("Progressive") && configuration["IR"]["Progressive"]["Enabled"].get<int>()) {
+			// Early reflections by the deadline, the rest is refined in the background.
+			std::chrono::milliseconds deadline((long long)configuration["IR"]["Progressive"]["DeadlineMs"].get<double>());
+			std::chrono::milliseconds interval((long long)configuration["IR"]["Progressive"]["SnapshotIntervalMs"].get<double>());
+			acoustics::ImageSourceSnapshot snapshot = imageSourceModel->renderProgressive(deadline, interval,
+				[this, cacheKey](const acoustics::ImageSourceSnapshot& progress) {
+					UNDA_LOG_MESSAGE("ISM order " + std::to_string(progress.order) + ": " + std::to_string(progress.imageCount) + " images, " + std::to_string(progress.elapsed) + " ms");
+					auralisation->setImpulseResponse(progress.output);
+					if (progress.complete && irCache) irCache->store(cacheKey, progress.output, progress.bands);
+				});
+			ir = snapshot.output;
+			ambisonicIR = snapshot.ambisonic;
+			binauralIR = snapshot.binaural;
+		}
+		else {
+			imageSourceModel->dispatchCPUThreads();
+			ir = imageSourceModel->getOutput();
+			ambisonicIR = imageSourceModel->getAmbisonicOutput();
+			binauralIR = imageSourceModel->getBinauralOutput();
+			if (irCache) irCache->store(cacheKey, imageSourceModel->getOutput(), imageSourceModel->getIRs());
+			auralisation->setImpulseResponse(ir);
+		}
+
+		playbackSignal = ReadAudioFileIntoMono("drums.wav");
+		if (ir.empty()) {
+			// Progressive, with nothing by the deadline. Live playback still gets the snapshots as they come.
+			UNDA_LOG_MESSAGE("No IR by the deadline, test_reverb.wav is not written");
+		}
+		else {
 			//Filter filter = Filter(Filter::filterType::BPF, 300, 3000);
-			Signal ir = ReadAudioFileIntoMono("ir.wav");
+			// Streamed block by block, as an audio callback would, then trimmed by the convolver's latency.
+			// Through a convolver of its own, so background snapshots and listener moves only ever swap
+			// auralisation's IR and the file is the same from run to run.
+			PartitionedConvolver convolver(ir.size());
+			convolver.setImpulseResponse(ir);
+			Signal audio = playbackSignal;
+			size_t latency = convolver.getLatency();
+			audio.resize(audio.size() + ir.size() - 1 + latency, Sample());
+			Signal out(audio.size());
+			for (size_t n = 0; n < audio.size(); n += unda::dspBlockSize)
+				convolver.process(audio.data() + n, out.data() + n, std::min(unda::dspBlockSize, audio.size() - n));
+			out.erase(out.begin(), out.begin() + latency);
+			// Live playback takes the same gain, later IRs are clipped rather than renormalised.
+			Sample peak = 0;
+			for (Sample sample : out) peak = std::max(peak, std::abs(sample));
+			if (peak > 0) playbackGain = Sample(0.9) / peak;
+			NormaliseSignal(out);
+			double outputSampleRate = configuration["DSP"].contains("OutputSampleRate") ? configuration["DSP"]["OutputSampleRate"].get<double>() : unda::sampleRate;
+			WriteAudioFile({ out }, "test_reverb.wav", unda::sampleRate, AudioSampleFormat::PCM16, outputSampleRate);
+		}
+
+		// Live: the dry signal looped through auralisation, so listener moves and snapshots are heard as they land.
+		if (configuration["DSP"].contains("Playback") && configuration["DSP"]["Playback"].get<int>() && !playbackSignal.empty()) {
+			audioOutput = std::make_unique<AudioOutput>(unda::sampleRate, auralisation->getBlockSize());
+			audioOutput->start([this](float* output, size_t nFrames) {
+				for (size_t n = 0; n < nFrames; n++) {
+					output[n] = playbackSignal[playbackPosition];
+					playbackPosition = (playbackPosition + 1) % playbackSignal.size();
+				}
+				auralisation->process(output, output, nFrames);
+				for (size_t n = 0; n < nFrames; n++) output[n] *= playbackGain;
+			});
+		}
+		listenerThread = std::thread(&Scene::runListenerUpdates, this);
+
+		if (!ambisonicIR.empty() || !binauralIR.empty()) {
+			// The dry signal against every channel of the spatial IRs in one batch, which transforms it once.
+			std::vector<Signal> kernels = ambisonicIR;
+			kernels.insert(kernels.end(), binauralIR.begin(), binauralIR.end());
+			std::vector<Signal> audio = { ReadAudioFileIntoMono("drums.wav") };
+			std::vector<std::array<size_t, 2>> pairs;
+			std::vector<Signal> outputs;
+			for (size_t channel = 0; channel < kernels.size(); channel++) {
+				pairs.push_back({ 0, channel });
+				outputs.emplace_back(audio[0].size() + kernels[channel].size() - 1, Sample());
+			}
+			BatchFFTConvolution(audio, kernels, pairs, outputs);
+			// Float, as the IRs are, so the channels keep their levels.
+			if (!ambisonicIR.empty())
+				WriteAudioFile(std::vector<Signal>(outputs.begin(), outputs.begin() + ambisonicIR.size()), "test_ambisonic.wav", unda::sampleRate, AudioSampleFormat::Float32);
+			if (!binauralIR.empty())
+				WriteAudioFile(std::vector<Signal>(outputs.begin() + ambisonicIR.size(), outputs.end()), "test_binaural.wav", unda::sampleRate, AudioSampleFormat::Float32);
+		}
+
+		if (configuration["IR"].contains("Trajectory") && configuration["IR"]["Trajectory"]["Enabled"].get<int>()) {
+			// Flyover: the source moves from SourcePosition to SourceEnd over the length of the dry signal,
+			// rendered through time-varying image source taps rather than the static IR.
 			Signal audio = ReadAudioFileIntoMono("drums.wav");
-			Signal out = FFTConvolution(audio, ir);
+			acoustics::MovingSourceRenderer flyover(spaceDimensions, betaCoefficients, configuration["IR"]["Trajectory"]["Order"].get<unsigned int>());
+			std::vector<acoustics::TrajectoryPoint> trajectory(2);
+			trajectory[0].source = source;
+			trajectory[0].listener = trajectory[1].listener = listener;
+			trajectory[1].source = configuration["IR"]["Trajectory"]["SourceEnd"].get<std::array<double, 3>>();
+			trajectory[1].time = (double)audio.size() / unda::sampleRate;
+			flyover.setTrajectory(trajectory);
+			Signal out = flyover.render(audio);
 			NormaliseSignal(out);
-			WriteAudioFile({ out }, "test_reverb.wav");
+			WriteAudioFile({ out }, "test_trajectory.wav");
 		}
 	
 	}
@@ -155,6 +429,15 @@ namespace unda {
 
 	Scene::~Scene()
 	{
+		// Both use the model and the convolver.
+		audioOutput.reset();
+		{
+			std::lock_guard<std::mutex> lock(listenerMutex);
+			stopListener = true;
+		}
+		listenerRequested.notify_one();
+		if (listenerThread.joinable()) listenerThread.join();
+		imageSourceModel.reset();
 		boundingBoxRenderer.cleanUp();
 		models.clear();
 
@@ -179,6 +462,51 @@ namespace unda {
 	void Scene::update()
 	{
 		camera->handleInput();
+		// Every listenerStep metres rather than every frame.
+		glm::vec3 position = glm::clamp(camera->getPosition() - roomOrigin, glm::vec3(0.0f), roomDimensions);
+		if (listenerFollowsCamera && glm::distance(position, listenerPosition) >= listenerStep)
+			setListenerPosition(position);
+	}
+
+	void Scene::setListenerPosition(const glm::vec3& position)
+	{
+		if (!imageSourceModel || !auralisation || !listenerThread.joinable()) return;
+		listenerPosition = glm::clamp(position, glm::vec3(0.0f), roomDimensions);
+		{
+			std::lock_guard<std::mutex> lock(listenerMutex);
+			requestedListener = listenerPosition;
+			listenerPending = true;
+		}
+		listenerRequested.notify_one();
+	}
+
+	void Scene::runListenerUpdates()
+	{
+		while (true) {
+			glm::vec3 position;
+			{
+				std::unique_lock<std::mutex> lock(listenerMutex);
+				listenerRequested.wait(lock, [this]() { return listenerPending || stopListener; });
+				if (stopListener) return;
+				position = requestedListener;
+				listenerPending = false;
+			}
+			updateListener(position);
+		}
+	}
+
+	void Scene::updateListener(const glm::vec3& position)
+	{
+		// Image sources stay cached in the model, only the band IRs are re-rendered, and the radiance
+		// transfer's late field is gathered again.
+		[[maybe_unused]] auto t1 = std::chrono::steady_clock::now();
+		std::array<double, 3> listener = { (double)position.x, (double)position.y, (double)position.z };
+		if (radianceTransfer)
+			imageSourceModel->setLateField(std::make_shared<acoustics::EnergyHistogram>(radianceTransfer->getLateField(listener)));
+		imageSourceModel->setListenerPosition(listener);
+		auralisation->setImpulseResponse(imageSourceModel->getOutput());
+		[[maybe_unused]] double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t1).count();
+		UNDA_LOG_MESSAGE("Listener update: " + std::to_string(elapsed) + " ms" + (elapsed > listenerBudget ? ", over the " + std::to_string(listenerBudget) + " ms budget" : ""));
 	}
 
 	void Scene::addModel(unda::Model* newModel)
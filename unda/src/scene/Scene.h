@@ -12,13 +12,23 @@
 #include "Terrain.h"
 #include "../rendering/VectorMarchingCubes.h"
 #include "../acoustics/ImageSource.h"
+#include "../acoustics/IRCache.h"
+#include "../acoustics/MovingSource.h"
+#include "../acoustics/PolygonImageSource.h"
+#include "../acoustics/FDTD.h"
+#include "../acoustics/RadianceTransfer.h"
+#include "../acoustics/Convolution.h"
 #include "../acoustics/DSP.h"
+#include "../acoustics/AudioOutput.h"
 
 #include <vector>
 #include <string>
 #include <memory>
 #include <filesystem>
 #include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <json.hpp>
 
 using json = nlohmann::json;
@@ -55,12 +65,42 @@ namespace unda {
 		const std::vector<Light*>& getLights() { return lights; };
 		const std::vector<std::shared_ptr<Model>>& getModels() { return models; };
 
+		// Re-renders the IR for a listener at position, in room coordinates, on the listener thread and swaps
+		// it into the convolver when done. Returns straight away; only the latest position is rendered.
+		void setListenerPosition(const glm::vec3& position);
+
 		Camera* getCamera() { return camera; };
 		const std::unordered_map<std::string, Model*>& getBoundingBoxes() const { return boundingBoxes; }
 
 	protected:
 		virtual void init();
 		std::shared_ptr<Model> inputScene, marchingCubesModel;
+		// The cache outlives the model: progressive renders store their final IR from the render thread.
+		std::unique_ptr<acoustics::IRCache> irCache;
+		// Likewise, progressive snapshots and listener moves are swapped into the convolver as they arrive,
+		// and heard through audioOutput, which loops the dry signal through it.
+		std::unique_ptr<PartitionedConvolver> auralisation;
+		std::unique_ptr<AudioOutput> audioOutput;
+		Signal playbackSignal;
+		size_t playbackPosition = 0;
+		Sample playbackGain = 1;
+		std::unique_ptr<acoustics::ImageSourceModel> imageSourceModel;
+		// Kept for listener moves, which only gather its late field again.
+		std::unique_ptr<acoustics::RadianceTransfer> radianceTransfer;
+		bool listenerFollowsCamera = false;
+		float listenerStep = 0.25f;
+		// Room coordinates are world coordinates less roomOrigin, the scene's lowest corner.
+		glm::vec3 listenerPosition = glm::vec3(), roomDimensions = glm::vec3(), roomOrigin = glm::vec3();
+
+		// Listener moves, off the frame loop. A move should fit listenerBudget, longer ones are logged.
+		static constexpr double listenerBudget = 10.0;	// ms
+		std::thread listenerThread;
+		std::mutex listenerMutex;
+		std::condition_variable listenerRequested;
+		glm::vec3 requestedListener = glm::vec3();
+		bool listenerPending = false, stopListener = false;
+		void runListenerUpdates();
+		void updateListener(const glm::vec3& position);
 
 		std::unordered_map<std::string, Model*> boundingBoxes;
 		std::vector<std::unique_ptr<Model>> boundingBoxesModels;
@@ -0,0 +1,158 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <limits>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+	#include <xmmintrin.h>
+	#define UNDA_SSE 1
+#else
+	#define UNDA_SSE 0
+#endif
+#if defined(__AVX512F__) || defined(__AVX__)
+	#include <immintrin.h>
+#endif
+
+namespace unda {
+	namespace simd {
+		// Lanes per register and the alignment load/store expect.
+		constexpr size_t width = 4;
+		constexpr size_t alignment = 16;
+
+		constexpr size_t roundUp(size_t n) { return (n + width - 1) / width * width; }
+
+		// Registers as wide as the target allows, for loops over independent bands: 16 lanes with AVX-512,
+		// 8 with AVX, otherwise float4.
+		namespace wide {
+#if defined(__AVX512F__)
+			constexpr size_t width = 16;
+			typedef __m512 floatw;
+
+			inline floatw load(const float* p)            { return _mm512_load_ps(p); }
+			inline void   store(float* p, floatw a)       { _mm512_store_ps(p, a); }
+			inline floatw set(float a)                    { return _mm512_set1_ps(a); }
+			inline floatw mul(floatw a, floatw b)         { return _mm512_mul_ps(a, b); }
+			inline floatw madd(floatw a, floatw b, floatw c) { return _mm512_add_ps(_mm512_mul_ps(a, b), c); } // a * b + c
+#elif defined(__AVX__)
+			constexpr size_t width = 8;
+			typedef __m256 floatw;
+
+			inline floatw load(const float* p)            { return _mm256_load_ps(p); }
+			inline void   store(float* p, floatw a)       { _mm256_store_ps(p, a); }
+			inline floatw set(float a)                    { return _mm256_set1_ps(a); }
+			inline floatw mul(floatw a, floatw b)         { return _mm256_mul_ps(a, b); }
+			inline floatw madd(floatw a, floatw b, floatw c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); } // a * b + c
+#else
+			constexpr size_t width = 4;
+#endif
+			constexpr size_t alignment = width * sizeof(float);
+			constexpr size_t roundUp(size_t n) { return (n + width - 1) / width * width; }
+		}
+
+#if UNDA_SSE
+		typedef __m128 float4;
+
+		inline float4 load(const float* p)            { return _mm_load_ps(p); }
+		inline float4 loadu(const float* p)           { return _mm_loadu_ps(p); }
+		inline void   store(float* p, float4 a)       { _mm_store_ps(p, a); }
+		inline void   storeu(float* p, float4 a)      { _mm_storeu_ps(p, a); }
+		inline float4 set(float a)                    { return _mm_set1_ps(a); }
+		inline float4 set(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+		inline float4 zero()                          { return _mm_setzero_ps(); }
+		inline float4 add(float4 a, float4 b)         { return _mm_add_ps(a, b); }
+		inline float4 sub(float4 a, float4 b)         { return _mm_sub_ps(a, b); }
+		inline float4 mul(float4 a, float4 b)         { return _mm_mul_ps(a, b); }
+		inline float4 madd(float4 a, float4 b, float4 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); } // a * b + c
+		inline float4 sqrt(float4 a)                  { return _mm_sqrt_ps(a); }
+		inline float4 min(float4 a, float4 b)         { return _mm_min_ps(a, b); }
+		inline float4 max(float4 a, float4 b)         { return _mm_max_ps(a, b); }
+		inline float4 div(float4 a, float4 b)         { return _mm_div_ps(a, b); }
+		// Comparisons give all bits set in the lanes where they hold, for select, bitAnd and movemask.
+		inline float4 lessThan(float4 a, float4 b)    { return _mm_cmplt_ps(a, b); }
+		inline float4 lessEqual(float4 a, float4 b)   { return _mm_cmple_ps(a, b); }
+		inline float4 bitAnd(float4 a, float4 b)      { return _mm_and_ps(a, b); }
+		inline float4 select(float4 mask, float4 a, float4 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); } // mask ? a : b
+		inline int    movemask(float4 a)              { return _mm_movemask_ps(a); }
+		inline float  hsum(float4 a) {
+			__m128 shuffled = _mm_movehl_ps(a, a);
+			__m128 sums = _mm_add_ps(a, shuffled);
+			shuffled = _mm_shuffle_ps(sums, sums, _MM_SHUFFLE(1, 1, 1, 1));
+			return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+		}
+#else
+		struct float4 { float v[4]; };
+
+		inline float4 load(const float* p)            { return { { p[0], p[1], p[2], p[3] } }; }
+		inline float4 loadu(const float* p)           { return load(p); }
+		inline void   store(float* p, float4 a)       { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+		inline void   storeu(float* p, float4 a)      { store(p, a); }
+		inline float4 set(float a)                    { return { { a, a, a, a } }; }
+		inline float4 set(float a, float b, float c, float d) { return { { a, b, c, d } }; }
+		inline float4 zero()                          { return set(0.0f); }
+		inline float4 add(float4 a, float4 b)         { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+		inline float4 sub(float4 a, float4 b)         { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+		inline float4 mul(float4 a, float4 b)         { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+		inline float4 madd(float4 a, float4 b, float4 c) { return add(mul(a, b), c); }
+		inline float4 sqrt(float4 a)                  { for (int i = 0; i < 4; i++) a.v[i] = ::sqrtf(a.v[i]); return a; }
+		inline float4 min(float4 a, float4 b)         { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return a; }
+		inline float4 max(float4 a, float4 b)         { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return a; }
+		inline float4 div(float4 a, float4 b)         { for (int i = 0; i < 4; i++) a.v[i] /= b.v[i]; return a; }
+		// Masks are all ones or all zeros per lane, as with SSE.
+		inline float  laneMask(bool value)            { unsigned int bits = value ? 0xffffffffu : 0u; float mask; std::memcpy(&mask, &bits, sizeof(mask)); return mask; }
+		inline bool   laneSet(float mask)             { unsigned int bits; std::memcpy(&bits, &mask, sizeof(bits)); return bits != 0; }
+		inline float4 lessThan(float4 a, float4 b)    { for (int i = 0; i < 4; i++) a.v[i] = laneMask(a.v[i] < b.v[i]); return a; }
+		inline float4 lessEqual(float4 a, float4 b)   { for (int i = 0; i < 4; i++) a.v[i] = laneMask(a.v[i] <= b.v[i]); return a; }
+		inline float4 bitAnd(float4 a, float4 b)      { for (int i = 0; i < 4; i++) a.v[i] = laneMask(laneSet(a.v[i]) && laneSet(b.v[i])); return a; }
+		inline float4 select(float4 mask, float4 a, float4 b) { for (int i = 0; i < 4; i++) if (!laneSet(mask.v[i])) a.v[i] = b.v[i]; return a; }
+		inline int    movemask(float4 a)              { int bits = 0; for (int i = 0; i < 4; i++) bits |= laneSet(a.v[i]) << i; return bits; }
+		inline float  hsum(float4 a)                  { return (a.v[0] + a.v[1]) + (a.v[2] + a.v[3]); }
+#endif
+#if !defined(__AVX512F__) && !defined(__AVX__)
+		namespace wide {
+			typedef float4 floatw;
+
+			inline floatw load(const float* p)            { return simd::load(p); }
+			inline void   store(float* p, floatw a)       { simd::store(p, a); }
+			inline floatw set(float a)                    { return simd::set(a); }
+			inline floatw mul(floatw a, floatw b)         { return simd::mul(a, b); }
+			inline floatw madd(floatw a, floatw b, floatw c) { return simd::madd(a, b, c); }
+		}
+#endif
+
+		// Flushes denormals to zero while in scope. Decaying recursive filters otherwise crawl
+		// through denormal arithmetic at the end of every tail.
+		class DenormalGuard {
+		public:
+#if UNDA_SSE
+			DenormalGuard() : mxcsr(_mm_getcsr()) { _mm_setcsr(mxcsr | 0x8040); } // FTZ | DAZ
+			~DenormalGuard() { _mm_setcsr(mxcsr); }
+		private:
+			unsigned int mxcsr;
+#else
+			DenormalGuard() {}
+#endif
+			DenormalGuard(const DenormalGuard&) = delete;
+			void operator=(const DenormalGuard&) = delete;
+		};
+
+		// Allocator for std::vector storage that can be used with load/store, float4 or wide.
+		template<typename T>
+		struct AlignedAllocator {
+			typedef T value_type;
+			AlignedAllocator() = default;
+			template<typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+			template<typename U> struct rebind { typedef AlignedAllocator<U> other; };
+
+			T* allocate(size_t n) {
+				if (n > std::numeric_limits<size_t>::max() / sizeof(T)) throw std::bad_array_new_length();
+				return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(wide::alignment)));
+			}
+			void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(wide::alignment)); }
+			template<typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+			template<typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+		};
+		template<typename T> using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+	}
+}
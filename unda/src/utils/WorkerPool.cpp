@@ -0,0 +1,57 @@
+#include "WorkerPool.h"
+#include <algorithm>
+
+namespace unda {
+	namespace utils {
+		WorkerPool::WorkerPool(unsigned int nThreads)
+		{
+			for (unsigned int thread = 1; thread < std::max(nThreads, 1u); thread++)
+				threads.push_back(std::thread(&WorkerPool::work, this, thread));
+		}
+
+		WorkerPool::~WorkerPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			started.notify_all();
+			for (std::thread& thread : threads) thread.join();
+		}
+
+		void WorkerPool::run(const Job& _job)
+		{
+			unsigned int nThreads = getThreadCount();
+			if (nThreads > 1) {
+				std::lock_guard<std::mutex> lock(mutex);
+				job = &_job;
+				pending = nThreads - 1;
+				generation++;
+			}
+			started.notify_all();
+			_job(0, nThreads);
+			if (nThreads == 1) return;
+			std::unique_lock<std::mutex> lock(mutex);
+			finished.wait(lock, [this]() { return pending == 0; });
+			job = nullptr;
+		}
+
+		void WorkerPool::work(unsigned int thread)
+		{
+			size_t done = 0;
+			while (true) {
+				const Job* current;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					started.wait(lock, [this, done]() { return stopping || generation != done; });
+					if (stopping) return;
+					done = generation;
+					current = job;
+				}
+				(*current)(thread, getThreadCount());
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--pending == 0) finished.notify_one();
+			}
+		}
+	}
+}
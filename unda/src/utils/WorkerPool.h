@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Utils.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+
+namespace unda {
+	namespace utils {
+
+		// Threads started once and woken for every job, for work run too often to start threads each time.
+		// The calling thread takes part as thread 0, so a pool of one runs jobs inline.
+		class WorkerPool {
+		public:
+			typedef std::function<void(unsigned int thread, unsigned int nThreads)> Job;
+
+			explicit WorkerPool(unsigned int nThreads = std::thread::hardware_concurrency());
+			~WorkerPool();
+
+			unsigned int getThreadCount() const { return (unsigned int)threads.size() + 1; }
+			// Runs job on every thread and returns once they've all finished. One caller at a time.
+			void run(const Job& job);
+
+		private:
+			std::vector<std::thread> threads;
+			std::mutex mutex;
+			std::condition_variable started, finished;
+			const Job* job = nullptr;
+			size_t generation = 0;
+			unsigned int pending = 0;
+			bool stopping = false;
+
+			void work(unsigned int thread);
+
+			DISABLE_COPY_ASSIGN(WorkerPool)
+		};
+	}
+}